@@ -0,0 +1,119 @@
+/**
+ * @file ArchiveIndex.cpp
+ * @author Pekka Mikkola <pmikkol@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This file is part of bwtc.
+ *
+ * bwtc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * bwtc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with bwtc.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Implementation of ArchiveIndex.
+ */
+
+#include <cassert>
+#include <vector>
+
+#include "ArchiveIndex.hpp"
+#include "globaldefs.hpp"
+#include "Streams.hpp"
+#include "Utils.hpp"
+
+namespace bwtc {
+
+const byte ArchiveIndex::kMagic[4] = {'B', 'W', 'T', 'I'};
+
+namespace {
+
+size_t writePacked(uint64 integer, OutStream* out) {
+  int bytes;
+  uint64 packed = utils::packInteger(integer, &bytes);
+  for(int i = 0; i < bytes; ++i) {
+    out->writeByte(packed & 0xff);
+    packed >>= 8;
+  }
+  return bytes;
+}
+
+uint64 readPacked(InStream* in) {
+  size_t bytes;
+  return utils::readPackedInteger(*in, bytes);
+}
+
+} //anonymous namespace
+
+void ArchiveIndex::addBlock(uint64 offset, uint64 originalSize,
+                            bool unchanged) {
+  Block block;
+  block.offset = offset;
+  block.originalSize = originalSize;
+  block.unchanged = unchanged;
+  m_blocks.push_back(block);
+}
+
+void ArchiveIndex::addSlice(uint64 offset, uint64 size) {
+  assert(!m_blocks.empty());
+  Slice slice;
+  slice.offset = offset;
+  slice.size = size;
+  m_blocks.back().slices.push_back(slice);
+}
+
+size_t ArchiveIndex::write(OutStream* out, uint64 position) const {
+  size_t bytes = writePacked(m_blocks.size(), out);
+  for(size_t i = 0; i < m_blocks.size(); ++i) {
+    const Block& block = m_blocks[i];
+    bytes += writePacked(block.offset, out);
+    bytes += writePacked(block.originalSize, out);
+    bytes += writePacked(block.unchanged ? 1 : 0, out);
+    bytes += writePacked(block.slices.size(), out);
+    for(size_t j = 0; j < block.slices.size(); ++j) {
+      bytes += writePacked(block.slices[j].offset, out);
+      bytes += writePacked(block.slices[j].size, out);
+    }
+  }
+  for(int i = 5; i >= 0; --i) out->writeByte(0xFF & (position >> i*8));
+  for(int i = 0; i < 4; ++i) out->writeByte(kMagic[i]);
+  return bytes + 6 + 4;
+}
+
+bool ArchiveIndex::read(InStream* in) {
+  m_blocks.clear();
+  uint64 size = in->size();
+  if(size < 6 + 4 || !in->seek(size - 6 - 4)) return false;
+  uint64 position = in->read48bits();
+  for(int i = 0; i < 4; ++i) {
+    if(in->readByte() != kMagic[i]) return false;
+  }
+  if(position >= size - 6 - 4 || !in->seek(position)) return false;
+
+  uint64 blocks = readPacked(in);
+  m_blocks.resize(blocks);
+  for(size_t i = 0; i < blocks; ++i) {
+    Block& block = m_blocks[i];
+    block.offset = readPacked(in);
+    block.originalSize = readPacked(in);
+    block.unchanged = readPacked(in) != 0;
+    block.slices.resize(readPacked(in));
+    for(size_t j = 0; j < block.slices.size(); ++j) {
+      block.slices[j].offset = readPacked(in);
+      block.slices[j].size = readPacked(in);
+    }
+  }
+  return true;
+}
+
+} //namespace bwtc
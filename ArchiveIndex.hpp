@@ -0,0 +1,93 @@
+/**
+ * @file ArchiveIndex.hpp
+ * @author Pekka Mikkola <pmikkol@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This file is part of bwtc.
+ *
+ * bwtc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * bwtc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with bwtc.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Header for ArchiveIndex. Index tells where each precompression block and
+ * BWT-block starts in the compressed file and which part of the original
+ * data it holds, so that a range of the original data can be decompressed
+ * without decompressing everything before it.
+ *
+ * Index is written after the empty header which ends the compressed
+ * blocks, so decompressors not knowing about it never read it. Format:
+ *
+ *   number of precompression blocks (packed integer)
+ *   for each precompression block:
+ *     offset of the block header, original size, 1 if the block is
+ *     not changed by precompression (0 otherwise), number of BWT-blocks
+ *     (packed integers)
+ *     for each BWT-block: offset of the BWT-block header, size of the
+ *     BWT-block (packed integers)
+ *   offset of the index (48 bits)
+ *   kMagic (4 bytes)
+ *
+ * Offsets are counted from the beginning of the compressed file.
+ */
+
+#ifndef BWTC_ARCHIVE_INDEX_HPP_
+#define BWTC_ARCHIVE_INDEX_HPP_
+
+#include <vector>
+
+#include "globaldefs.hpp"
+#include "Streams.hpp"
+
+namespace bwtc {
+
+class ArchiveIndex {
+ public:
+  struct Slice {
+    uint64 offset;
+    uint64 size;
+  };
+
+  struct Block {
+    uint64 offset;
+    uint64 originalSize;
+    /* If precompression didn't change the block, the slices hold the
+     * original data and they can be decompressed alone. */
+    bool unchanged;
+    std::vector<Slice> slices;
+  };
+
+  void addBlock(uint64 offset, uint64 originalSize, bool unchanged);
+  /** Adds a slice for the last block added. */
+  void addSlice(uint64 offset, uint64 size);
+
+  /** Writes the index to the position given, which has to be the current
+   * position of out. Returns the number of bytes written. */
+  size_t write(OutStream* out, uint64 position) const;
+
+  /** Reads the index from the end of a seekable stream.
+   * @return false if the stream has no index or can't be seeked. */
+  bool read(InStream* in);
+
+  const std::vector<Block>& blocks() const { return m_blocks; }
+
+ private:
+  static const byte kMagic[4];
+
+  std::vector<Block> m_blocks;
+};
+
+} //namespace bwtc
+
+#endif
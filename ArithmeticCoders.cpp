@@ -51,7 +51,7 @@ namespace bwtc {
         
     size_t ArithmeticEncoder::
         transformAndEncode(BWTBlock& block, BWTManager& bwtm, OutStream* out) {
-            std::cout<<block.size()<<"\n";
+            if(verbosity > 2) std::clog<<block.size()<<"\n";
             bool rle=true;
             bwtm.doTransform(block);
             PROFILE("ArithmeticEncoder::encodeData");
@@ -83,7 +83,7 @@ namespace bwtc {
             bits_used+=8;
         }
         //std::cout<<"bytes used for counts: "<<1.0*(pp-a)/(bytes_used-a)<<"\n";
-        std::cout<<"bytes used for counts: "<<(pp-a)<<"\n";
+        if(verbosity > 2) std::clog<<"bytes used for counts: "<<(pp-a)<<"\n";
         
         out->write48bits(bits_used/8,bits_pos);
         return bytes_used;
@@ -166,13 +166,14 @@ namespace bwtc {
         while(bitpos!=0) {
             output_bit(0);
         }
+        writer.commit();
         out->flush();
     }
     void ArithmeticUtilEncoder::output_bit(unsigned int bit) {
         bits_used++;
          current = (current << 1) | (bit>0);
          if(++bitpos == 8) {
-             out->writeByte(current);
+             writer.writeByte(current);
              bytes_used++;
              bitpos=0;
              current=0;
@@ -40,7 +40,7 @@ namespace bwtc {
     class ArithmeticUtilEncoder {
 
         public:
-            ArithmeticUtilEncoder(OutStream* _out) : out(_out),low(0),high(0xffffffff),underflow_bits(0),current(0),bitpos(0),bytes_used(0) {};
+            ArithmeticUtilEncoder(OutStream* _out) : out(_out),writer(_out),low(0),high(0xffffffff),underflow_bits(0),current(0),bitpos(0),bytes_used(0) {};
             size_t encode(byte* start, uint64 size);
             void output_bit(unsigned int bit);
             void flush();
@@ -51,6 +51,8 @@ namespace bwtc {
             size_t bytes_used;
             size_t bits_used;
             OutStream* out;
+            /* Bytes are written straight into out and committed by flush(). */
+            SpanWriter writer;
             long underflow_bits;
             unsigned int code;
             unsigned int low;
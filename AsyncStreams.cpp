@@ -0,0 +1,250 @@
+/**
+ * @file AsyncStreams.cpp
+ * @author Pekka Mikkola <pmikkol@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This file is part of bwtc.
+ *
+ * bwtc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * bwtc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with bwtc.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Implementation of ReadAheadInStream and WriteBehindOutStream.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <boost/bind/bind.hpp>
+
+#include "AsyncStreams.hpp"
+#include "globaldefs.hpp"
+
+namespace bwtc {
+
+namespace {
+
+FILE* openFile(const std::string& name, const char* mode, FILE* standard) {
+  if (name == "") return standard;
+  FILE *f = fopen(name.c_str(), mode);
+  if (!f) {
+    perror(name.c_str());
+    exit(1);
+  }
+  return f;
+}
+
+} //anonymous namespace
+
+ReadAheadInStream::ReadAheadInStream(const std::string& file_name)
+    : m_name(file_name), m_fileptr(openFile(file_name, "r", stdin)),
+      m_buffers(kBuffers), m_filled(kBuffers), m_free(kBuffers + 1),
+      m_current(0), m_next(0), m_position(0), m_left(0), m_ended(false),
+      m_buffer(0), m_bitsInBuffer(0)
+{
+  pos = 0;
+  for (size_t i = 0; i < kBuffers; ++i) {
+    m_buffers[i] = new IOBuffer(kBufferSize);
+    m_free.push(m_buffers[i]);
+  }
+  m_reader = boost::thread(boost::bind(&ReadAheadInStream::readAhead, this));
+}
+
+ReadAheadInStream::~ReadAheadInStream() {
+  m_free.push(0);
+  m_reader.join();
+  if (m_fileptr != stdin) fclose(m_fileptr);
+  for (size_t i = 0; i < kBuffers; ++i) delete m_buffers[i];
+}
+
+void ReadAheadInStream::readAhead() {
+  while (true) {
+    IOBuffer *buffer = m_free.pop();
+    if (!buffer) return;
+    buffer->length = fread(&buffer->data[0], 1, kBufferSize, m_fileptr);
+    m_filled.push(buffer);
+    if (buffer->length == 0) return;
+  }
+}
+
+bool ReadAheadInStream::nextBuffer() {
+  if (m_ended) return false;
+  if (m_current) m_free.push(m_current);
+  m_current = m_next ? m_next : m_filled.pop();
+  m_next = 0;
+  m_position = &m_current->data[0];
+  m_left = m_current->length;
+  if (m_left == 0) m_ended = true;
+  return !m_ended;
+}
+
+IOBuffer* ReadAheadInStream::peekNext() {
+  assert(!m_ended);
+  if (!m_next) m_next = m_filled.pop();
+  return m_next;
+}
+
+size_t ReadAheadInStream::readBlock(byte* to, size_t max_block_size) {
+  assert(m_bitsInBuffer == 0);
+  size_t have_read = 0;
+  while (have_read < max_block_size) {
+    if (m_left == 0 && !nextBuffer()) break;
+    size_t length = std::min(max_block_size - have_read, m_left);
+    std::copy(m_position, m_position + length, to + have_read);
+    m_position += length;
+    m_left -= length;
+    have_read += length;
+  }
+  pos += have_read;
+  return have_read;
+}
+
+uint64 ReadAheadInStream::read48bits() {
+  uint64 result = 0;
+  for (int i = 0; i < 6; ++i) {
+    result <<= 8;
+    result |= static_cast<byte>(fetchByte());
+  }
+  return result;
+}
+
+bool ReadAheadInStream::compressedDataEnding() {
+  if (m_left == 0 && !nextBuffer()) return true;
+  if (m_left > 1) return false;
+  return peekNext()->length == 0;
+}
+
+WriteBehindOutStream::WriteBehindOutStream(const std::string& file_name)
+    : m_name(file_name), m_fileptr(openFile(file_name, "w", stdout)),
+      m_buffers(kBuffers), m_filled(kBuffers + 1), m_free(kBuffers),
+      m_current(0), m_handedOver(0), m_reservedOutside(false), m_inFlight(0)
+{
+  for (size_t i = 1; i < kBuffers; ++i) {
+    m_buffers[i] = new IOBuffer(kBufferSize);
+    m_free.push(m_buffers[i]);
+  }
+  m_buffers[0] = m_current = new IOBuffer(kBufferSize);
+  m_writer = boost::thread(boost::bind(&WriteBehindOutStream::writeBehind,
+                                       this));
+}
+
+WriteBehindOutStream::~WriteBehindOutStream() {
+  flush();
+  m_filled.push(0);
+  m_writer.join();
+  if (m_fileptr != stdout) fclose(m_fileptr);
+  for (size_t i = 0; i < kBuffers; ++i) delete m_buffers[i];
+}
+
+void WriteBehindOutStream::writeBehind() {
+  while (true) {
+    IOBuffer *buffer = m_filled.pop();
+    if (!buffer) return;
+    if (fwrite(&buffer->data[0], 1, buffer->length, m_fileptr) !=
+        buffer->length) {
+      perror(m_name == "" ? "stdout" : m_name.c_str());
+      exit(1);
+    }
+    buffer->length = 0;
+    m_free.push(buffer);
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      --m_inFlight;
+    }
+    m_written.notify_all();
+  }
+}
+
+void WriteBehindOutStream::handOver() {
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+    ++m_inFlight;
+  }
+  m_handedOver += m_current->length;
+  m_filled.push(m_current);
+  m_current = m_free.pop();
+}
+
+void WriteBehindOutStream::drain() {
+  if (m_current->length > 0) handOver();
+  boost::mutex::scoped_lock lock(m_mutex);
+  while (m_inFlight > 0) m_written.wait(lock);
+}
+
+void WriteBehindOutStream::writeBlock(const byte *begin, const byte *end) {
+  while (begin < end) {
+    size_t length = std::min(static_cast<size_t>(end - begin),
+                             kBufferSize - m_current->length);
+    std::copy(begin, begin + length, &m_current->data[m_current->length]);
+    m_current->length += length;
+    begin += length;
+    if (m_current->length == kBufferSize) handOver();
+  }
+}
+
+void WriteBehindOutStream::flush() {
+  drain();
+  fflush(m_fileptr);
+}
+
+byte* WriteBehindOutStream::reserve(size_t n) {
+  if (n > kBufferSize) {
+    m_reservedOutside = true;
+    return OutStream::reserve(n);
+  }
+  if (m_current->length + n > kBufferSize) handOver();
+  return &m_current->data[m_current->length];
+}
+
+void WriteBehindOutStream::commit(size_t used) {
+  if (m_reservedOutside) {
+    m_reservedOutside = false;
+    OutStream::commit(used);
+    return;
+  }
+  assert(m_current->length + used <= kBufferSize);
+  m_current->length += used;
+  if (m_current->length == kBufferSize) handOver();
+}
+
+void WriteBehindOutStream::write48bits(uint64 to_written, long int position) {
+  assert((to_written & (((uint64)0xFFFF) << 48)) == 0);
+  assert(position >= 0 && position + 6 <= getPos());
+  uint64 start = static_cast<uint64>(position);
+  if (start >= m_handedOver) {
+    size_t i = start - m_handedOver;
+    for (int j = 5; j >= 0; --j) {
+      m_current->data[i++] = 0xFF & (to_written >> j*8);
+    }
+    return;
+  }
+  flush();
+  long int current = ftell(m_fileptr);
+  if (current < 0 || fseek(m_fileptr, position, SEEK_SET) != 0) {
+    /* Writing into a pipe has to be done sequentially. */
+    fprintf(stderr, "Cannot seek in the output stream!\n");
+    exit(1);
+  }
+  for (int i = 5; i >= 0; --i) {
+    fputc(0xFF & (to_written >> i*8), m_fileptr);
+  }
+  fseek(m_fileptr, current, SEEK_SET);
+}
+
+} //namespace bwtc
@@ -0,0 +1,199 @@
+/**
+ * @file AsyncStreams.hpp
+ * @author Pekka Mikkola <pmikkol@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This file is part of bwtc.
+ *
+ * bwtc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * bwtc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with bwtc.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Header for ReadAheadInStream and WriteBehindOutStream. These streams do
+ * the actual reading and writing in an I/O thread of their own, so that the
+ * thread compressing or decompressing the data doesn't wait for the disk
+ * (or network) except when the I/O thread falls behind.
+ *
+ * Both streams pass a fixed set of buffers between the two threads: while
+ * one buffer is in use by the stream, the others are being filled or
+ * drained by the I/O thread.
+ */
+
+#ifndef BWTC_ASYNC_STREAMS_HPP_
+#define BWTC_ASYNC_STREAMS_HPP_
+
+#include <cstdio>
+#include <cassert>
+#include <string>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "globaldefs.hpp"
+#include "Streams.hpp"
+#include "ThreadPool.hpp"
+
+namespace bwtc {
+
+/** Buffer passed between a stream and its I/O thread. */
+struct IOBuffer {
+  explicit IOBuffer(size_t size) : data(size), length(0) {}
+  std::vector<byte> data;
+  size_t length;
+};
+
+/**
+ * ReadAheadInStream reads a file or std::cin (empty name) like RawInStream,
+ * but the I/O thread reads the following buffers ahead while the current
+ * one is being consumed.
+ *
+ * Used for inputs which can't be mapped into memory with MmapInStream.
+ */
+class ReadAheadInStream : public InStream {
+ public:
+  explicit ReadAheadInStream(const std::string& file_name);
+  virtual ~ReadAheadInStream();
+
+  virtual size_t readBlock(byte *to, size_t max_block_size);
+
+  virtual inline bool readBit() {
+    if (m_bitsInBuffer == 0) {
+      m_buffer = static_cast<byte>(fetchByte());
+      m_bitsInBuffer = 8;
+    }
+    return (m_buffer >> --m_bitsInBuffer) & 1;
+  }
+
+  virtual inline byte readByte() {
+    assert(m_bitsInBuffer < 8);
+    byte nextByte = static_cast<byte>(fetchByte());
+    m_buffer = (m_buffer << 8) | nextByte;
+    return (m_buffer >> m_bitsInBuffer) & 0xff;
+  }
+
+  virtual inline void flushBuffer() {
+    m_bitsInBuffer = 0;
+  }
+
+  virtual uint64 read48bits();
+
+  /* Like in MemoryInStream, the last byte of the input is not counted. */
+  virtual bool compressedDataEnding();
+
+ private:
+  static const size_t kBufferSize = 1 << 20; // 1MB
+  static const size_t kBuffers = 3;
+
+  /** Body of the I/O thread. Buffer of zero length marks the end of input
+   * and null buffer tells the thread to stop. */
+  void readAhead();
+  /** Gives the current buffer back to the I/O thread and takes the next
+   * one. Returns false at the end of input. */
+  bool nextBuffer();
+  /** Waits for the buffer following the current one, without taking it. */
+  IOBuffer* peekNext();
+
+  int fetchByte() {
+    if (m_left == 0 && !nextBuffer()) return EOF;
+    --m_left;
+    ++pos;
+    return *m_position++;
+  }
+
+  std::string m_name;
+  FILE *m_fileptr;
+  std::vector<IOBuffer*> m_buffers;
+  BoundedQueue<IOBuffer*> m_filled;
+  BoundedQueue<IOBuffer*> m_free;
+  IOBuffer *m_current;
+  IOBuffer *m_next;
+  const byte *m_position;
+  size_t m_left;
+  bool m_ended;
+  uint16 m_buffer;
+  byte m_bitsInBuffer;
+  boost::thread m_reader;
+
+  ReadAheadInStream& operator=(const ReadAheadInStream& os);
+  ReadAheadInStream(const ReadAheadInStream& os);
+};
+
+/**
+ * WriteBehindOutStream writes into a file or std::cout (empty name) like
+ * RawOutStream, but full buffers are written by the I/O thread while the
+ * next one is being filled.
+ */
+class WriteBehindOutStream : public OutStream {
+ public:
+  explicit WriteBehindOutStream(const std::string& file_name);
+  virtual ~WriteBehindOutStream();
+
+  virtual inline void writeByte(byte b) {
+    m_current->data[m_current->length++] = b;
+    if (m_current->length == kBufferSize) handOver();
+  }
+
+  virtual void writeBlock(const byte *begin, const byte *end);
+
+  /** Doesn't wait for the I/O thread. */
+  virtual long int getPos() {
+    return static_cast<long int>(m_handedOver + m_current->length);
+  }
+
+  /** Patches the current buffer in place if possible, otherwise waits for
+   * the I/O thread and seeks like RawOutStream. */
+  virtual void write48bits(uint64 to_written, long int position);
+
+  /** Waits until all of the data has been written. */
+  virtual void flush();
+
+  /** Gives room from the current buffer, unless n is larger than a
+   * buffer. */
+  virtual byte* reserve(size_t n);
+  virtual void commit(size_t used);
+
+ private:
+  static const size_t kBufferSize = 1 << 20; // 1MB
+  static const size_t kBuffers = 3;
+
+  /** Body of the I/O thread. Null buffer tells the thread to stop. */
+  void writeBehind();
+  /** Gives the current buffer to the I/O thread and takes a free one. */
+  void handOver();
+  /** Blocks until the I/O thread has written all of the buffers. */
+  void drain();
+
+  std::string m_name;
+  FILE *m_fileptr;
+  std::vector<IOBuffer*> m_buffers;
+  BoundedQueue<IOBuffer*> m_filled;
+  BoundedQueue<IOBuffer*> m_free;
+  IOBuffer *m_current;
+  uint64 m_handedOver;
+  bool m_reservedOutside;
+  size_t m_inFlight;
+  boost::mutex m_mutex;
+  boost::condition_variable m_written;
+  boost::thread m_writer;
+
+  WriteBehindOutStream& operator=(const WriteBehindOutStream& os);
+  WriteBehindOutStream(const WriteBehindOutStream& os);
+};
+
+} //namespace bwtc
+
+#endif
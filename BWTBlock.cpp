@@ -24,28 +24,59 @@
  * Implementation of BWT-block.
  */
 
+#include "BitStreams.hpp"
 #include "BWTBlock.hpp"
 #include "globaldefs.hpp"
 #include "Streams.hpp"
 
+#include <algorithm>
 #include <vector>
 
 namespace bwtc {
 
+void BWTStatistics::clear() {
+  std::fill(frequencies, frequencies + 256, 0);
+  std::fill(runs, runs + 256, 0);
+}
+
+void BWTStatistics::add(const BWTStatistics& other) {
+  for(size_t i = 0; i < 256; ++i) {
+    frequencies[i] += other.frequencies[i];
+    runs[i] += other.runs[i];
+  }
+}
+
+uint64 BWTStatistics::totalRuns() const {
+  uint64 total = 0;
+  for(size_t i = 0; i < 256; ++i) total += runs[i];
+  return total;
+}
+
+void BWTStatistics::contextLengths(std::vector<uint32>& lengths) const {
+  lengths.assign(frequencies, frequencies + 256);
+  int last = 255;
+  while(last >= 0 && lengths[last] == 0) --last;
+  if(last < 0) return;
+  ++lengths[0];
+  --lengths[last];
+}
+
 BWTBlock::BWTBlock()
     : m_begin(0), m_length(0), m_isTransformed(true) {}
 
-BWTBlock::BWTBlock(byte *data, uint32 length, bool isTransformed)
+BWTBlock::BWTBlock(byte *data, uint64 length, bool isTransformed)
     : m_begin(data), m_length(length), m_isTransformed(isTransformed) {}
 
 BWTBlock::BWTBlock(const BWTBlock& b)
     : m_begin(b.m_begin), m_length(b.m_length),
-      m_LFpowers(b.m_LFpowers), m_isTransformed(b.m_isTransformed) {}
+      m_LFpowers(b.m_LFpowers), m_statistics(b.m_statistics),
+      m_isTransformed(b.m_isTransformed) {}
 
 BWTBlock& BWTBlock::operator=(const BWTBlock& b) {
   m_begin = b.m_begin;
   m_length = b.m_length;
   m_LFpowers = b.m_LFpowers;
+  m_statistics = b.m_statistics;
   m_isTransformed = b.m_isTransformed;
   return *this;
 }
@@ -54,7 +85,7 @@ void BWTBlock::setBegin(byte* begin) {
   m_begin = begin;
 }
 
-void BWTBlock::setSize(uint32 length) {
+void BWTBlock::setSize(uint64 length) {
   m_length = length;
 }
 
@@ -63,42 +94,36 @@ size_t BWTBlock::writeHeader(OutStream* out) const {
     std::clog << "Writing " << m_LFpowers.size() << " starting points."
               << std::endl;
   }
-  size_t bytes = 1;
-  byte s = (byte)(m_LFpowers.size()-1);
-  out->writeByte(s);
-  int bitsLeft = 8;
-  for(size_t i = 0; i < m_LFpowers.size(); ++i) {
-    for(int j = 30; j >= 0; --j) {
-      s = (s << 1) | ((m_LFpowers[i] >> j) & 0x1);
-      --bitsLeft;
-      if(bitsLeft == 0) {
-        out->writeByte(s);
-        bitsLeft = 8;
-        ++bytes;
-      }
-    }
-  }
-  if(bitsLeft < 8) {
-    out->writeByte(s << bitsLeft);
-    ++bytes;
+  BitWriter writer(out);
+  writer.writeBits(m_LFpowers.size()-1, 8);
+  uint32 bits = 31;
+  if(m_length >= kWideStartingPoints) {
+    writer.writeBits(kWideStartingPoints, 31);
+    bits = 48;
   }
-  return bytes;
+  for(size_t i = 0; i < m_LFpowers.size(); ++i)
+    writer.writeBits(m_LFpowers[i], bits);
+  return writer.flush();
 }
 
 void BWTBlock::readHeader(InStream* in) {
-  uint32 LFpows = in->readByte()+1;
+  BitReader reader(in);
+  uint32 LFpows = reader.readBits(8)+1;
   if(verbosity > 2) {
     std::clog << "Reading " << LFpows << " starting points."
               << std::endl;
   }
   m_LFpowers.resize(LFpows);
-  for(uint32 i = 0; i < LFpows; ++i) {
-    uint32 pos = 0;
-    for(uint32 j = 0; j < 31; ++j)
-      pos = (pos << 1) | (in->readBit() ? 1 : 0);
-    m_LFpowers[i] = pos;
+  uint64 first = reader.readBits(31);
+  uint32 bits = 31;
+  if(first == kWideStartingPoints) {
+    first = reader.readBits(48);
+    bits = 48;
   }
-  in->flushBuffer();
+  m_LFpowers[0] = first;
+  for(uint32 i = 1; i < LFpows; ++i)
+    m_LFpowers[i] = reader.readBits(bits);
+  reader.flushBuffer();
 }
 
 void BWTBlock::prepareLFpowers(uint32 startingPoints) {
@@ -36,10 +36,34 @@
 
 namespace bwtc {
 
+/**
+ * Statistics of a block gathered while its BWT is written, so that the
+ * entropy coders don't have to scan the transformed block for them.
+ */
+struct BWTStatistics {
+  BWTStatistics() { clear(); }
+
+  void clear();
+  /**Adds the statistics of another block. */
+  void add(const BWTStatistics& other);
+  uint64 totalRuns() const;
+  /**Lengths of the first-column contexts of the transformed block, ie. the
+   * numbers of rows whose suffix starts with each symbol. They differ from
+   * the frequencies by the row of the sentinel, which is the first row of
+   * the context of 0, and by the last row, which takes the place of the
+   * primary row. */
+  void contextLengths(std::vector<uint32>& lengths) const;
+
+  /**Occurrences of each symbol in the block. */
+  uint32 frequencies[256];
+  /**Runs of each symbol in the transformed block. */
+  uint32 runs[256];
+};
+
 class BWTBlock {
  public:
   BWTBlock();
-  BWTBlock(byte *data, uint32 length, bool isTransformed);
+  BWTBlock(byte *data, uint64 length, bool isTransformed);
   BWTBlock(const BWTBlock& b);
   BWTBlock& operator=(const BWTBlock& b);
 
@@ -55,19 +79,28 @@ class BWTBlock {
   const byte* begin() const { return m_begin; }
   byte* end() { return m_begin + m_length; }
   const byte* end() const { return m_begin + m_length; }
-  std::vector<uint32>& LFpowers() { return m_LFpowers; }
+  std::vector<uint64>& LFpowers() { return m_LFpowers; }
+  /**Statistics of a block transformed ahead of encoding, see
+   * BWTManager::doTransform. */
+  BWTStatistics& statistics() { return m_statistics; }
 
   void setBegin(byte* begin);
-  void setSize(uint32 length);
+  void setSize(uint64 length);
 
   void prepareLFpowers(uint32 startingPoints);
+  /**Starting points are written with 31 bits, unless the block is larger
+   * than 2^31 - 2 bytes. Then the first 31-bit field is kWideStartingPoints
+   * and the starting points follow with 48 bits each. */
   size_t writeHeader(OutStream *out) const;
   void readHeader(InStream *in);
   
  private:
+  static const uint64 kWideStartingPoints = 0x7fffffff;
+
   byte *m_begin;
-  uint32 m_length;
-  std::vector<uint32> m_LFpowers;
+  uint64 m_length;
+  std::vector<uint64> m_LFpowers;
+  BWTStatistics m_statistics;
   bool m_isTransformed;
 };
 
@@ -106,6 +106,7 @@ void BitEncoder::finish() {
   emitByte(255);
   emitByte(255);
   emitByte(255);
+  m_writer.commit();
   m_output->flush();
   /* Prepare to encode another sequence. */
   m_low = 0;
@@ -63,7 +63,10 @@ class BitEncoder {
   BitEncoder();
   ~BitEncoder();
 
-  void connect(bwtc::OutStream* out) { m_output = out; }
+  void connect(bwtc::OutStream* out) {
+    m_output = out;
+    m_writer.connect(out);
+  }
   //TODO: Figure out what Disconnect should do if needed
   //bwtc::OutStream* Disconnect() { return output_.Disconnect(); }
 
@@ -87,9 +90,11 @@ class BitEncoder {
   uint32 m_high;
   uint64 m_counter;
   bwtc::OutStream* m_output;
+  /* Output is written straight into the stream and committed by finish(). */
+  bwtc::SpanWriter m_writer;
 
   inline void emitByte(unsigned char byte) {
-    m_output->writeByte(byte);
+    m_writer.writeByte(byte);
     ++m_counter;
   }
   BitEncoder(const BitEncoder&);
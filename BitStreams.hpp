@@ -0,0 +1,197 @@
+/**
+ * @file BitStreams.hpp
+ * @author Pekka Mikkola <pmikkol@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This file is part of bwtc.
+ *
+ * bwtc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * bwtc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with bwtc.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Header for BitReader and BitWriter. They read and write bit fields of
+ * up to 64 bits through a 64-bit buffer, so the bit-level codes used in the
+ * headers of the blocks don't need a virtual call of InStream or OutStream
+ * for each bit. Bits are in the same order as with InStream::readBit, so
+ * BitReader can read anything written bit by bit and vice versa.
+ */
+
+#ifndef BWTC_BIT_STREAMS_HPP_
+#define BWTC_BIT_STREAMS_HPP_
+
+#include <cassert>
+
+#include "globaldefs.hpp"
+#include "Streams.hpp"
+
+namespace bwtc {
+
+/** Mask for the n lowest bits, 0 <= n <= 64. */
+inline uint64 lowBits(uint32 n) {
+  return n >= 64 ? ~static_cast<uint64>(0) : (static_cast<uint64>(1) << n) - 1;
+}
+
+/** Number of leading zero bits in a non-zero word. */
+inline uint32 leadingZeros(uint64 word) {
+  assert(word != 0);
+#ifdef __GNUC__
+  return __builtin_clzll(word);
+#else
+  uint32 zeros = 0;
+  while(!(word >> 63)) {
+    word <<= 1;
+    ++zeros;
+  }
+  return zeros;
+#endif
+}
+
+/**
+ * Reads bits from InStream. Bytes are taken from the stream only when their
+ * bits are needed, so that the reader never takes bytes beyond the byte
+ * holding the last bit read. The stream has to be at a byte boundary when
+ * the reader is created, and flushBuffer() skips to the next byte boundary
+ * of both the reader and the stream.
+ */
+class BitReader {
+ public:
+  explicit BitReader(InStream* in) : m_in(in), m_buffer(0), m_bits(0) {}
+
+  bool readBit() {
+    if(m_bits == 0) fetchByte();
+    --m_bits;
+    return (m_buffer >> m_bits) & 1;
+  }
+
+  byte readByte() { return static_cast<byte>(readBits(8)); }
+
+  /** Reads an n-bit integer, the most significant bit first. */
+  uint64 readBits(uint32 n) {
+    assert(n <= 64);
+    if(n > 56) {
+      uint64 high = readBits(n - 32);
+      return (high << 32) | readBits(32);
+    }
+    while(m_bits < n) fetchByte();
+    m_bits -= n;
+    return (m_buffer >> m_bits) & lowBits(n);
+  }
+
+  /** Reads unary code of utils::unaryCode: n-1 zero bits and a one bit.
+   * @return n */
+  size_t readUnary() {
+    size_t n = 1;
+    while(true) {
+      uint64 bits = m_buffer & lowBits(m_bits);
+      if(bits) {
+        uint32 zeros = leadingZeros(bits) - (64 - m_bits);
+        m_bits -= zeros + 1;
+        return n + zeros;
+      }
+      n += m_bits;
+      m_bits = 0;
+      fetchByte();
+    }
+  }
+
+  /** Reads Elias gamma code of a positive integer. */
+  uint64 readGamma() {
+    uint32 zeros = readUnary() - 1;
+    return (static_cast<uint64>(1) << zeros) | readBits(zeros);
+  }
+
+  /** Drops the rest of the current byte. */
+  void flushBuffer() {
+    m_bits = 0;
+    m_in->flushBuffer();
+  }
+
+ private:
+  void fetchByte() {
+    m_buffer = (m_buffer << 8) | m_in->readByte();
+    m_bits += 8;
+  }
+
+  InStream *m_in;
+  uint64 m_buffer;
+  uint32 m_bits;
+};
+
+/**
+ * Writes bits into OutStream. Bytes are written straight into the room
+ * reserved from the stream (see SpanWriter), so nothing else may be written
+ * to the stream before flush(), which pads the last byte with zero bits.
+ */
+class BitWriter {
+ public:
+  explicit BitWriter(OutStream* out)
+      : m_writer(out), m_buffer(0), m_bits(0), m_bytes(0) {}
+  ~BitWriter() { assert(m_bits == 0); }
+
+  /** Writes the n lowest bits of value, the most significant bit first. */
+  void writeBits(uint64 value, uint32 n) {
+    assert(n <= 64);
+    if(n > 56) {
+      writeBits(value >> 32, n - 32);
+      writeBits(value, 32);
+      return;
+    }
+    m_buffer = (m_buffer << n) | (value & lowBits(n));
+    m_bits += n;
+    while(m_bits >= 8) {
+      m_bits -= 8;
+      m_writer.writeByte(static_cast<byte>(m_buffer >> m_bits));
+      ++m_bytes;
+    }
+  }
+
+  /** For using the writer as a bit vector of the codes in Utils.hpp. */
+  void push_back(bool bit) { writeBits(bit ? 1 : 0, 1); }
+
+  /** Writes n-1 zero bits and a one bit (see utils::unaryCode). */
+  void writeUnary(size_t n) {
+    assert(n > 0);
+    for(--n; n > 32; n -= 32) writeBits(0, 32);
+    writeBits(1, n + 1);
+  }
+
+  /** Writes Elias gamma code of a positive integer. */
+  void writeGamma(uint64 value) {
+    assert(value > 0);
+    uint32 bits = 64 - leadingZeros(value);
+    writeBits(0, bits - 1);
+    writeBits(value, bits);
+  }
+
+  /** Pads the last byte with zero bits and commits the bytes to the stream.
+   * @return Number of bytes written since the creation of the writer. */
+  size_t flush() {
+    if(m_bits > 0) writeBits(0, 8 - m_bits);
+    m_writer.commit();
+    return m_bytes;
+  }
+
+  size_t bytes() const { return m_bytes; }
+
+ private:
+  SpanWriter m_writer;
+  uint64 m_buffer;
+  uint32 m_bits;
+  size_t m_bytes;
+};
+
+} //namespace bwtc
+
+#endif
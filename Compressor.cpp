@@ -24,95 +24,339 @@
  * Implementation of Compressor.
  */
 
+#include "ArchiveIndex.hpp"
 #include "Compressor.hpp"
 #include "PrecompressorBlock.hpp"
 #include "Streams.hpp"
 #include "Profiling.hpp"
+#include "ThreadPool.hpp"
+#include "Utils.hpp"
 
+#include <algorithm>
 #include <string>
+#include <vector>
+
+#include <boost/bind/bind.hpp>
+#include <boost/thread/thread.hpp>
 
 namespace bwtc {
 
 Compressor::
 Compressor(const std::string& in, const std::string& out,
            const std::string& preprocessing, size_t memLimit, char entropyCoder)
-    : m_in(new RawInStream(in)), m_out(new RawOutStream(out)),
-      m_coder(giveEntropyEncoder(entropyCoder)), m_precompressor(preprocessing),
-      m_options(memLimit, entropyCoder) {}
+    : m_in(giveInStream(in)), m_out(giveOutStream(out)),
+      m_precompressor(preprocessing), m_options(memLimit, entropyCoder) {}
 
 Compressor::
 Compressor(InStream* in, OutStream* out,
            const std::string& preprocessing, size_t memLimit, char entropyCoder)
-    : m_in(in), m_out(out), m_coder(giveEntropyEncoder(entropyCoder)),
-      m_precompressor(preprocessing), m_options(memLimit, entropyCoder) {}
+    : m_in(in), m_out(out), m_precompressor(preprocessing),
+      m_options(memLimit, entropyCoder) {}
 
 Compressor::~Compressor() {
   delete m_in;
   delete m_out;
-  delete m_coder;
 }
 
 size_t Compressor::writeGlobalHeader() {
+  m_out->writeByte(s_formatVersion);
   m_out->writeByte(static_cast<byte>(m_options.entropyCoder));
-  return 1;
+  return 2;
 }
 
 void Compressor::initializeBwtAlgorithm(char choice, uint32 startingPoints) {
   m_bwtmanager.initialize(choice);
   m_bwtmanager.setStartingPoints(startingPoints);
+  m_bwtmanager.setMemoryBudget(sliceMemory(precompressorBlockSize()));
 }
 
-size_t Compressor::compress(size_t threads) {
-  PROFILE("Compressor::compress");
-  if(threads != 1) {
-    std::cerr << "Supporting only single thread!" << std::endl;
-    return 0;
+namespace {
+
+/* Blocks aren't made smaller than this even if the memory limit doesn't
+ * cover the memory the transforms need regardless of the block size. */
+const size_t kMinBlockSize = 1 << 12;
+/* Transforms handle blocks beyond 2^32 bytes, but the entropy coders count
+ * the symbols of a slice in 32 bits. */
+const uint64 kMaxSliceSize = 0xffffffff - 1;
+
+/**
+ * BWT-stage of the compression pipeline. Transforms a single slice of
+ * PrecompressorBlock in place, stores the statistics of the transform into the
+ * slice and then passes the slice to the encoding stage.
+ */
+class SliceTransformTask : public Task {
+ public:
+  SliceTransformTask(BWTBlock& slice, bool isLast, BWTManager& bwtm,
+                     ThreadPool& pool, Task* next)
+      : m_slice(slice), m_isLast(isLast), m_bwtm(bwtm), m_pool(pool),
+        m_next(next) {}
+
+  void run() {
+    BWTStatistics& stats = m_slice.statistics();
+    stats.clear();
+    if(m_isLast) {
+      m_bwtm.doTransform(m_slice, stats);
+    } else {
+      /* Transform in place uses the byte following the slice as a
+       * sentinel, but here that byte belongs to the next slice which may be
+       * under transform at the same time. */
+      std::vector<byte> output(m_slice.size() + 1);
+      m_bwtm.doTransform(m_slice, &output[0], stats);
+      std::copy(output.begin(), output.begin() + m_slice.size(),
+                m_slice.begin());
+      m_slice.setTransformed(true);
+    }
+    m_pool.submit(m_next);
   }
 
-  size_t compressedSize = writeGlobalHeader();
+ private:
+  BWTBlock& m_slice;
+  bool m_isLast;
+  BWTManager& m_bwtm;
+  ThreadPool& m_pool;
+  Task *m_next;
+};
 
-  /* Precompressor uses (1/3)n bytes of additional memory for the block
-   * of size n so we can handle 0.75*memLim sized block at once (0.74 should be
-   * enough to be on the safe side). */
-  size_t pbBlockSize = static_cast<size_t>(m_options.memLimit*0.74);
-  size_t bwtBlockSize = std::min(static_cast<size_t>(m_options.memLimit*0.185),
-                                 static_cast<size_t>(0x7fffffff - 1));
+/**
+ * Entropy coding stage of the compression pipeline. Encodes a transformed
+ * slice into memory so that it can be written to the output in order. The
+ * memory reserved for the transform is released after encoding, as the
+ * entropy coders may need as much memory as the transform.
+ */
+class SliceEncodingTask : public Task {
+ public:
+  SliceEncodingTask(BWTBlock& slice, char entropyCoder, BWTManager& bwtm,
+                    MemoryBudget& budget, size_t reserved)
+      : m_slice(slice), m_entropyCoder(entropyCoder), m_bwtm(bwtm),
+        m_budget(budget), m_reserved(reserved), m_bytes(0) {}
+
+  void run() {
+    EntropyEncoder *coder = giveEntropyEncoder(m_entropyCoder);
+    /* The slice is already transformed, so BWTManager only hands out the
+     * statistics gathered during the transform. */
+    m_bytes = coder->transformAndEncode(m_slice, m_bwtm, &m_result);
+    delete coder;
+    m_budget.release(m_reserved);
+  }
 
-  if(m_precompressor.options().size() == 0) pbBlockSize = bwtBlockSize;
-  
+  size_t bytes() const { return m_bytes; }
+  const std::vector<byte>& result() const { return m_result.data(); }
 
-  size_t preBlocks = 0, bwtBlocks = 0;
-  while(true) {
-    PrecompressorBlock *pb = m_precompressor.readBlock(pbBlockSize, m_in);
-    if(pb->originalSize() == 0) {
-      delete pb;
-      break;
+ private:
+  BWTBlock& m_slice;
+  char m_entropyCoder;
+  BWTManager& m_bwtm;
+  MemoryBudget& m_budget;
+  size_t m_reserved;
+  size_t m_bytes;
+  MemoryOutStream m_result;
+};
+
+/** Writes the fixed size field for the length of encoded BWT-block. */
+void write48bits(uint64 value, OutStream* out) {
+  for(int i = 5; i >= 0; --i) out->writeByte(0xFF & (value >> i*8));
+}
+
+/** Writes the size of the slice before it is transformed and encoded. */
+size_t writeSliceSize(const BWTBlock& slice, OutStream* out) {
+  int bytes;
+  uint64 packed = utils::packInteger(slice.size(), &bytes);
+  for(int i = 0; i < bytes; ++i) {
+    out->writeByte(packed & 0xff);
+    packed >>= 8;
+  }
+  return bytes;
+}
+
+/** Tells if precompression left the data of the block as it was read. */
+bool isUnchanged(PrecompressorBlock& pb) {
+  return pb.size() == pb.originalSize() &&
+      pb.grammar().numberOfRules() == 0 &&
+      pb.grammar().numberOfSpecialSymbols() == 0;
+}
+
+/**
+ * Writes the header of BWT-block and the encoded block staged in memory.
+ * As the length is known before the block is written, the output is written
+ * sequentially and it can be a pipe.
+ *
+ * @return Number of bytes in the header.
+ */
+size_t writeEncodedSlice(const BWTBlock& slice,
+                         const std::vector<byte>& encoded, OutStream* out) {
+  write48bits(encoded.size(), out);
+  size_t bytes = 6 + writeSliceSize(slice, out);
+  if(encoded.size() > 0) {
+    out->writeBlock(&encoded[0], &encoded[0] + encoded.size());
+  }
+  return bytes;
+}
+
+} //anonymous namespace
+
+/** PrecompressorBlock whose slices are in the pipeline. */
+struct Compressor::PendingBlock {
+  PrecompressorBlock *pb;
+  std::vector<SliceTransformTask*> transforms;
+  std::vector<SliceEncodingTask*> encoders;
+  /* Reserved for the data of the block, released after it is written. */
+  size_t reserved;
+};
+
+size_t Compressor::readingMemory(size_t blockSize) const {
+  /* Precompressor uses (1/3)n bytes of additional memory for the block of
+   * size n. */
+  size_t result = blockSize + 1;
+  if(m_precompressor.options().size() > 0) result += blockSize/3;
+  return result;
+}
+
+uint64 Compressor::sliceMemory(size_t blockSize) const {
+  uint64 limit = m_options.memLimit;
+  uint64 used = readingMemory(blockSize);
+  if(m_precompressor.options().size() > 0) used += blockSize + 1;
+  return limit - std::min(limit, used);
+}
+
+size_t Compressor::precompressorBlockSize() const {
+  uint64 limit = m_options.memLimit;
+  uint64 s;
+  if(m_precompressor.options().size() == 0) {
+    /* The block is a single slice, which is transformed in place. Largest
+     * block whose transform fits in the memory left by the next block. */
+    uint64 low = 0, high = std::min<uint64>(limit, kMaxSliceSize);
+    while(low < high) {
+      uint64 middle = low + (high - low + 1)/2;
+      if(m_bwtmanager.suggestedBlockSize(sliceMemory(middle)) >= middle)
+        low = middle;
+      else
+        high = middle - 1;
     }
-    /* BWT uses roughly 4n additional bytes of additional memory but
-     * we have to also account the memory used for the rest of the data.
-     * Based on the experiments the limits used here are somewhat conservative.
-     */
-    if(pbBlockSize != bwtBlockSize) {
-      size_t s = (m_options.memLimit - pb->size())/4.5;
-      bwtBlockSize = std::min(s,static_cast<size_t>(0x7fffffff - 1));
+    s = low;
+  } else {
+    /* Reading the next block takes at most half of the limit. The other
+     * half holds the block under transform, which has to leave room for
+     * transforming slices of at least kMinBlockSize bytes even if
+     * precompression doesn't shrink it. */
+    uint64 half = limit/2;
+    s = 3*(std::max<uint64>(half, 1) - 1)/4;
+    uint64 slice = m_bwtmanager.maxSizeInBytes(kMinBlockSize) + 2;
+    s = std::min(s, 3*(limit - std::min(limit, slice))/7);
+  }
+  return std::max(static_cast<size_t>(s), kMinBlockSize);
+}
+
+size_t Compressor::bwtBlockSize(const PrecompressorBlock* pb) const {
+  /* Slice may be transformed in a copy (see SliceTransformTask) while the
+   * whole precompressed block is held in memory, and the next block is
+   * read at the same time. */
+  uint64 budget = m_options.memLimit;
+  uint64 used = readingMemory(precompressorBlockSize());
+  if(m_precompressor.options().size() > 0) used += pb->size() + 1;
+  budget -= std::min(budget, used);
+  uint64 s = std::min(m_bwtmanager.suggestedBlockSize(budget), kMaxSliceSize);
+  return std::max(static_cast<size_t>(s), kMinBlockSize);
+}
+
+/* Reader thread of the pipeline: reads blocks, has them precompressed in the
+ * thread pool and hands their slices to the pool. Block of zero pointer ends
+ * the input. The memory for each slice is reserved before the slice is
+ * given to the pool, so the tasks never wait for memory. */
+void Compressor::readBlocks(ThreadPool* pool, MemoryBudget* budget,
+                            BoundedQueue<PendingBlock>* queue)
+{
+  size_t pbBlockSize = precompressorBlockSize();
+  size_t readingMemory = this->readingMemory(pbBlockSize);
+
+  while(true) {
+    budget->acquire(readingMemory);
+    PendingBlock block = PendingBlock();
+    block.pb = m_precompressor.readBlock(pbBlockSize, m_in);
+    if(block.pb->originalSize() == 0) {
+      delete block.pb;
+      budget->release(readingMemory);
+      block.pb = 0;
+      queue->push(block);
+      return;
     }
-    
-    pb->sliceIntoBlocks(bwtBlockSize);
-    ++preBlocks;
-    bwtBlocks += pb->slices();
+    PrecompressorBlock *pb = block.pb;
+    pb->sliceIntoBlocks(bwtBlockSize(pb));
 
-    compressedSize += pb->writeBlockHeader(m_out);
+    /* Exchange the reservation for reading to the memory taken by the
+     * block. */
+    block.reserved = pb->size() + 1;
+    if(block.reserved > readingMemory) {
+      budget->acquire(block.reserved - readingMemory, readingMemory);
+    } else {
+      budget->release(readingMemory - block.reserved);
+    }
 
     for(size_t i = 0; i < pb->slices(); ++i) {
-      compressedSize += m_coder->
-          transformAndEncode(pb->getSlice(i), m_bwtmanager, m_out);
-      //TODO: if optimizing overall memory usage now would be time to
-      //delete space allocated for i:th slice. However the worst case
-      //stays the same
+      /* Slice is transformed in a copy unless it is the only one. A slice
+       * too large for the budget is transformed when this block is the only
+       * one left in memory. */
+      size_t sliceSize = pb->getSlice(i).size();
+      size_t perSlice = m_bwtmanager.maxSizeInBytes(sliceSize);
+      if(pb->slices() == 1) perSlice -= sliceSize + 1;
+      budget->acquire(perSlice, block.reserved);
+      SliceEncodingTask *encoder = new SliceEncodingTask(
+          pb->getSlice(i), m_options.entropyCoder, m_bwtmanager, *budget,
+          perSlice);
+      SliceTransformTask *transform = new SliceTransformTask(
+          pb->getSlice(i), i + 1 == pb->slices(), m_bwtmanager, *pool,
+          encoder);
+      block.encoders.push_back(encoder);
+      block.transforms.push_back(transform);
+      pool->submit(transform);
+    }
+    queue->push(block);
+  }
+}
+
+size_t Compressor::compress(size_t threads) {
+  PROFILE("Compressor::compress");
+  size_t compressedSize = writeGlobalHeader();
+
+  /* The memory limit is shared by all of the threads. Block sizes leave
+   * room for reading the next block while one slice is transformed, and
+   * more slices are transformed at the same time if the limit allows.
+   * Block sizes do not depend on the number of threads, hence the output
+   * doesn't either. The reader thread only reads; precompression is a task
+   * in the pool like the rest of the work. */
+  threads = std::max<size_t>(threads, 1);
+  ThreadPool pool(threads);
+  m_bwtmanager.setThreadPool(&pool);
+  m_precompressor.setThreadPool(&pool);
+  MemoryBudget budget(m_options.memLimit);
+  BoundedQueue<PendingBlock> queue(threads);
+  boost::thread reader(boost::bind(&Compressor::readBlocks, this, &pool,
+                                   &budget, &queue));
+
+  ArchiveIndex index;
+  while(true) {
+    PendingBlock block = queue.pop();
+    if(!block.pb) break;
+    index.addBlock(m_out->getPos(), block.pb->originalSize(),
+                   isUnchanged(*block.pb));
+    compressedSize += block.pb->writeBlockHeader(m_out);
+    for(size_t i = 0; i < block.encoders.size(); ++i) {
+      SliceEncodingTask *task = block.encoders[i];
+      pool.wait(block.transforms[i]);
+      pool.wait(task);
+      index.addSlice(m_out->getPos(), block.pb->getSlice(i).size());
+      compressedSize += task->bytes() +
+          writeEncodedSlice(block.pb->getSlice(i), task->result(), m_out);
+      delete block.transforms[i];
+      delete task;
     }
-    delete pb;
+    delete block.pb;
+    budget.release(block.reserved);
   }
+  reader.join();
+  m_bwtmanager.setThreadPool(0);
+  m_precompressor.setThreadPool(0);
   compressedSize += PrecompressorBlock::writeEmptyHeader(m_out);
+  compressedSize += index.write(m_out, m_out->getPos());
 
   return compressedSize;
 }
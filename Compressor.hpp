@@ -46,6 +46,23 @@
  * Encoded BWTBlocks are written into the compressed file in the order
  * specified by ?TODO?
  *
+ * Threads:
+ * The phases are overlapped. A reader thread reads blocks ahead while
+ * precompression, BWT and entropy coding are run as separate tasks in a
+ * thread pool, which has a single thread by default. All of the parallel
+ * work (including the parallel suffix sorting) is done in the slots of
+ * this one pool, so the number of threads working never exceeds the number
+ * given. Encoded blocks are collected into memory and written in the order
+ * of the input, so the compressed file doesn't depend on the number of
+ * threads.
+ *
+ * The memory limit is the total for the whole pipeline, regardless of the
+ * number of threads. Block sizes leave room for reading the next block
+ * while a slice of the previous one is transformed; the memory of the
+ * block is reserved before it is read, and the memory of each slice before
+ * it is transformed, until the slice has been encoded. More slices are
+ * transformed at the same time only if the limit has room for them.
+ *
  *
  * COMPRESSED FILE FORMAT:
  *
@@ -53,8 +70,9 @@
  * precompression blocks.
  *
  * File header:
- * File header contains global information about the compressed file such as
- * used entropy coder etc.
+ * File header contains global information about the compressed file: the
+ * version of the file format (one byte, s_formatVersion) followed by the used
+ * entropy coder.
  *
  * Precompression block:
  * Precompression blocks are independent of each other. Each precompression
@@ -66,12 +84,20 @@
  * BWT-block:
  * BWT-block contains header, trailer and entropy encoded data, which is
  * transformed. Header of BWT-block contains the size of the compressed BWT-
- * block and the size of uncompressed BWT-block (before precompression). In
- * addition header contains the data necessary to uncompress the block
- * (written by entropy encoder).
+ * block (48 bits, not including the header itself) and the size of the
+ * BWT-block (packed integer), so that the blocks can be located and placed
+ * without decoding them. The rest of the data necessary to uncompress the
+ * block is written by entropy encoder. Encoded block is staged in memory
+ * before its header is written, so the compressed file is written strictly
+ * sequentially and it can be written into a pipe.
  * Trailer of BWT-block contains the number of starting points used in inverse
  * and their positions.
  *
+ * Index:
+ * After the blocks the compressed file ends with an index of the blocks,
+ * which is used for decompressing ranges of the original data.
+ * @see ArchiveIndex.hpp
+ *
  */
 
 #ifndef BWTC_COMPRESSOR_HPP_
@@ -81,6 +107,7 @@
 #include "preprocessors/Precompressor.hpp"
 #include "EntropyCoders.hpp"
 #include "Streams.hpp"
+#include "ThreadPool.hpp"
 
 #include <string>
 
@@ -109,9 +136,20 @@ class Compressor {
   void initializeBwtAlgorithm(char choice, uint32 startingPoints);
 
  private:
+  struct PendingBlock;
+
+  /** Memory reserved for reading and precompressing a block. */
+  size_t readingMemory(size_t blockSize) const;
+  /** Memory left for transforming slices while the next block is read,
+   * when the blocks are of the given size. */
+  uint64 sliceMemory(size_t blockSize) const;
+  size_t precompressorBlockSize() const;
+  size_t bwtBlockSize(const PrecompressorBlock* pb) const;
+  void readBlocks(ThreadPool* pool, MemoryBudget* budget,
+                  BoundedQueue<PendingBlock>* queue);
+
   InStream *m_in;
   OutStream *m_out;
-  EntropyEncoder *m_coder;
   Precompressor m_precompressor;
   BWTManager m_bwtmanager;
   Options m_options;
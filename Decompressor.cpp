@@ -24,23 +24,42 @@
  * Implementation of Decompressor-class.
  */
 
+#include "ArchiveIndex.hpp"
 #include "Decompressor.hpp"
 #include "Streams.hpp"
 #include "preprocessors/Postprocessor.hpp"
 #include "Profiling.hpp"
 #include "bwtransforms/InverseBWT.hpp"
 
+#include "ThreadPool.hpp"
+#include "Utils.hpp"
+
+#include <algorithm>
 #include <cassert>
+#include <cctype>
+#include <deque>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <vector>
+
+#include <boost/bind/bind.hpp>
 
 namespace bwtc {
 
-Decompressor::Decompressor(const std::string& in, const std::string& out)
-    : m_in(new RawInStream(in)), m_out(new RawOutStream(out)),
-      m_decoder(0) {}
+Decompressor::Decompressor(const std::string& in, const std::string& out,
+                           uint64 memLimit)
+    : m_in(giveInStream(in)),
+      m_positional(PositionalOutStream::canWrite(out) ?
+                   new PositionalOutStream(out) : 0),
+      m_out(m_positional ? m_positional : giveOutStream(out)),
+      m_decoder(0), m_decoderChoice(0), m_formatVersion(s_formatVersion),
+      m_memLimit(memLimit) {}
 
-Decompressor::Decompressor(InStream* in, OutStream* out)
-    : m_in(in), m_out(out), m_decoder(0) {}
+Decompressor::Decompressor(InStream* in, OutStream* out, uint64 memLimit)
+    : m_in(in), m_positional(0), m_out(out), m_decoder(0),
+      m_decoderChoice(0), m_formatVersion(s_formatVersion),
+      m_memLimit(memLimit) {}
 
 Decompressor::~Decompressor() {
   delete m_in;
@@ -49,21 +68,205 @@ Decompressor::~Decompressor() {
 }
 
 size_t Decompressor::readGlobalHeader() {
-  char entropyDecoder = static_cast<char>(m_in->readByte());
+  byte version = m_in->readByte();
+  size_t bytes = 1;
+  if(std::isalpha(version)) {
+    /* Files without the version begin with the entropy coder. */
+    m_formatVersion = 1;
+    m_decoderChoice = static_cast<char>(version);
+  } else if(version == s_formatVersion) {
+    m_formatVersion = version;
+    m_decoderChoice = static_cast<char>(m_in->readByte());
+    ++bytes;
+  } else {
+    std::ostringstream message;
+    message << "unsupported compressed file format version "
+            << static_cast<int>(version) << " (expected at most "
+            << static_cast<int>(s_formatVersion) << ")";
+    throw std::runtime_error(message.str());
+  }
   delete m_decoder;
-  m_decoder = giveEntropyDecoder(entropyDecoder);
-  return 1;
+  m_decoder = giveEntropyDecoder(m_decoderChoice);
+  return bytes;
 }
 
-size_t Decompressor::decompress(size_t threads) {
-  PROFILE("Decompressor::decompress");
-  if(threads != 1) {
-    std::cerr << "Supporting only single thread!" << std::endl;
-    return 0;
+namespace {
+
+/** Reads the header which Compressor writes before each BWT-block. */
+size_t readSliceHeader(InStream* in, uint64& compressedLength) {
+  compressedLength = in->read48bits();
+  size_t bytes;
+  return utils::readPackedInteger(*in, bytes);
+}
+
+/**
+ * Decodes and inverts a single BWT-block into its place in the
+ * PrecompressorBlock. The memory reserved for the task is released from the
+ * budget when the task is done.
+ */
+class SliceDecodingTask : public Task {
+ public:
+  /** Takes the ownership of compressed and ibwt. */
+  SliceDecodingTask(BWTBlock& slice, bool isLast, char decoder,
+                    InStream* compressed, InverseBWTransform* ibwt,
+                    MemoryBudget& budget, size_t reserved)
+      : m_slice(slice), m_isLast(isLast), m_decoder(decoder),
+        m_compressed(compressed), m_ibwt(ibwt), m_budget(budget),
+        m_reserved(reserved) {}
+
+  ~SliceDecodingTask() {
+    delete m_compressed;
+    delete m_ibwt;
   }
-  InverseBWTransform *ibwt = giveInverseTransformer();
 
-  readGlobalHeader();
+  void run() {
+    EntropyDecoder *decoder = giveEntropyDecoder(m_decoder);
+    InverseBWTransform *ibwt = m_ibwt;
+    size_t size = m_slice.size();
+    uint64 frequencies[256];
+    if(m_isLast) {
+      bool known = decoder->decodeBlock(m_slice, m_compressed, frequencies);
+      ibwt->doTransform(m_slice, known ? frequencies : 0);
+    } else {
+      /* Inverse transform uses the byte following the block, but here that
+       * byte belongs to the next slice which may be under work at the same
+       * time. */
+      std::vector<byte> copy(size + 1);
+      BWTBlock slice(&copy[0], size, true);
+      bool known = decoder->decodeBlock(slice, m_compressed, frequencies);
+      ibwt->doTransform(slice, known ? frequencies : 0);
+      assert(slice.size() == size);
+      std::copy(slice.begin(), slice.end(), m_slice.begin());
+    }
+    assert(m_slice.size() == size);
+    delete decoder;
+    delete m_compressed;
+    m_compressed = 0;
+    delete m_ibwt;
+    m_ibwt = 0;
+    m_budget.release(m_reserved);
+  }
+
+ private:
+  BWTBlock& m_slice;
+  bool m_isLast;
+  char m_decoder;
+  InStream *m_compressed;
+  InverseBWTransform *m_ibwt;
+  MemoryBudget& m_budget;
+  size_t m_reserved;
+};
+
+/**
+ * Passes on only the bytes in the range [from, to) of the data written,
+ * when the first byte written is at the given position of the data.
+ */
+class RangeOutStream : public OutStream {
+ public:
+  RangeOutStream(OutStream* out, uint64 position, uint64 from, uint64 to)
+      : m_out(out), m_position(position), m_from(from), m_to(to),
+        m_written(0) {}
+
+  void writeByte(byte b) {
+    if(m_position >= m_from && m_position < m_to) {
+      m_out->writeByte(b);
+      ++m_written;
+    }
+    ++m_position;
+  }
+
+  void writeBlock(const byte *begin, const byte *end) {
+    uint64 first = std::max(m_position, m_from);
+    uint64 last = std::min(m_position + (end - begin), m_to);
+    if(first < last) {
+      m_out->writeBlock(begin + (first - m_position),
+                        begin + (last - m_position));
+      m_written += last - first;
+    }
+    m_position += end - begin;
+  }
+
+  long int getPos() { return m_position; }
+
+  void write48bits(uint64 to_written, long int position) {
+    (void) to_written;
+    (void) position;
+    assert(!"RangeOutStream can only be written sequentially");
+  }
+
+  void flush() { m_out->flush(); }
+
+  uint64 written() const { return m_written; }
+
+ private:
+  OutStream *m_out;
+  uint64 m_position;
+  uint64 m_from;
+  uint64 m_to;
+  uint64 m_written;
+};
+
+/**
+ * Undoes the precompression of a block and writes the result. If the task
+ * owns the block and the output stream, they are deleted (and so the data
+ * written) at the end of the task, and the memory reserved for the block is
+ * released from the budget.
+ */
+class PostprocessingTask : public Task {
+ public:
+  PostprocessingTask(PrecompressorBlock* pb, OutStream* out)
+      : m_pb(pb), m_out(out), m_budget(0), m_reserved(0), m_size(0) {}
+  PostprocessingTask(PrecompressorBlock* pb, OutStream* out,
+                     MemoryBudget& budget, size_t reserved)
+      : m_pb(pb), m_out(out), m_budget(&budget), m_reserved(reserved),
+        m_size(0) {}
+
+  void run() {
+    Postprocessor postprocessor(verbosity > 1, m_pb->grammar());
+    m_size = postprocessor.uncompress(m_pb->begin(), m_pb->size(), m_out);
+    if(m_budget) {
+      assert(m_size == m_pb->originalSize());
+      delete m_out;
+      m_out = 0;
+      delete m_pb;
+      m_pb = 0;
+      m_budget->release(m_reserved);
+    }
+  }
+
+  size_t size() const { return m_size; }
+
+ private:
+  PrecompressorBlock *m_pb;
+  OutStream *m_out;
+  MemoryBudget *m_budget;
+  size_t m_reserved;
+  size_t m_size;
+};
+
+} //anonymous namespace
+
+/** PrecompressorBlock whose slices have been given to the thread pool. */
+struct Decompressor::PendingBlock {
+  PrecompressorBlock *pb;
+  /* Memory of pb reserved from the budget. */
+  size_t reserved;
+  std::vector<Task*> tasks;
+};
+
+uint64 Decompressor::inverseBudget(uint64 reserved) const {
+  if(m_memLimit == 0) return 0;
+  /* Zero would mean no limit. */
+  return std::max<uint64>(m_memLimit - std::min(m_memLimit, reserved), 1);
+}
+
+size_t Decompressor::decompress(size_t threads) {
+  PROFILE("Decompressor::decompress");
+  size_t headerSize = readGlobalHeader();
+  /* Without the headers of the BWT-blocks they can't be located without
+   * decoding them, so the files of version 1 are decompressed serially. */
+  if(threads > 1 && m_formatVersion > 1)
+    return decompressInParallel(threads, headerSize);
 
   size_t preBlocks = 0, bwtBlocks = 0, decompressedSize = 0;
   while(true) {
@@ -74,22 +277,264 @@ size_t Decompressor::decompress(size_t threads) {
     }
     ++preBlocks;
     bwtBlocks += pb->slices();
-
-    for(size_t i = 0; i < pb->slices(); ++i) {
-      pb->getSlice(i).setBegin(pb->end());
-      m_decoder->decodeBlock(pb->getSlice(i), m_in);
-      pb->usedAtEnd(pb->getSlice(i).size());
-      ibwt->doTransform(pb->getSlice(i));
-    }
-    // Postprocess pb
-    Postprocessor postprocessor(verbosity > 1, pb->grammar());
-    size_t postSize = postprocessor.uncompress(pb->begin(), pb->size(), m_out);
+    InverseBWTransform *ibwt =
+        giveInverseTransformer(0, inverseBudget(pb->originalSize() + 1));
+    size_t postSize = decodeSlices(pb, ibwt, m_out);
     decompressedSize += postSize;
-    //m_out->writeBlock(pb->begin(), pb->end());
     assert(postSize == pb->originalSize());
+    delete ibwt;
     delete pb;
   }
-  delete ibwt;
+  return decompressedSize;
+}
+
+size_t Decompressor::decodeSlices(PrecompressorBlock* pb,
+                                  InverseBWTransform* ibwt, OutStream* out) {
+  Postprocessor postprocessor(verbosity > 1, pb->grammar());
+  size_t written = 0;
+  uint64 frequencies[256];
+  for(size_t i = 0; i < pb->slices(); ++i) {
+    uint64 compressedLength;
+    if(m_formatVersion > 1) readSliceHeader(m_in, compressedLength);
+    /* Slice is postprocessed right after its inverse transform, so all of
+     * the slices can use the same memory at the beginning of pb. */
+    BWTBlock& slice = pb->getSlice(i);
+    slice.setBegin(pb->begin());
+    bool known = m_decoder->decodeBlock(slice, m_in, frequencies);
+    ibwt->doTransform(slice, known ? frequencies : 0);
+    written += postprocessor.uncompressPart(slice.begin(), slice.size(), out);
+  }
+  assert(postprocessor.isComplete());
+  return written;
+}
+
+uint64 Decompressor::decompressRange(uint64 offset, uint64 length) {
+  PROFILE("Decompressor::decompressRange");
+  uint64 to = offset + length;
+  ArchiveIndex index;
+  if(!index.read(m_in)) {
+    /* Without index (or seekable input) everything is decompressed, but
+     * only the range is written. */
+    m_in->seek(0);
+    OutStream *out = m_out;
+    RangeOutStream range(out, 0, offset, to);
+    m_out = &range;
+    try {
+      decompress(1);
+    } catch(...) {
+      m_out = out;
+      throw;
+    }
+    m_out = out;
+    return range.written();
+  }
+
+  m_in->seek(0);
+  readGlobalHeader();
+  uint64 written = 0, blockBegin = 0;
+  for(size_t i = 0; i < index.blocks().size() && blockBegin < to; ++i) {
+    const ArchiveIndex::Block& block = index.blocks()[i];
+    uint64 blockEnd = blockBegin + block.originalSize;
+    if(blockEnd <= offset) {
+      blockBegin = blockEnd;
+      continue;
+    }
+    if(!block.unchanged) {
+      /* Precompressed data doesn't map directly to the original data, so
+       * the whole block is needed. */
+      m_in->seek(block.offset);
+      PrecompressorBlock *pb = PrecompressorBlock::readBlockHeader(m_in);
+      InverseBWTransform *ibwt =
+          giveInverseTransformer(0, inverseBudget(pb->originalSize() + 1));
+      RangeOutStream range(m_out, blockBegin, offset, to);
+      decodeSlices(pb, ibwt, &range);
+      written += range.written();
+      delete ibwt;
+      delete pb;
+    } else {
+      /* Slices hold the original data, so only the slices overlapping the
+       * range are decoded, and only the segments of them overlapping the
+       * range are inverted. */
+      uint64 sliceBegin = blockBegin;
+      for(size_t j = 0; j < block.slices.size() && sliceBegin < to; ++j) {
+        uint64 sliceEnd = sliceBegin + block.slices[j].size;
+        if(sliceEnd > offset) {
+          m_in->seek(block.slices[j].offset);
+          uint64 compressedLength;
+          size_t size = readSliceHeader(m_in, compressedLength);
+          assert(size == block.slices[j].size);
+          std::vector<byte> data(size + 1);
+          BWTBlock slice(&data[0], size, true);
+          uint64 frequencies[256];
+          bool known = m_decoder->decodeBlock(slice, m_in, frequencies);
+          uint64 from = std::max(offset, sliceBegin) - sliceBegin;
+          uint64 until = std::min(to, sliceEnd) - sliceBegin;
+          InverseBWTransform *ibwt =
+              giveInverseTransformer(0, inverseBudget(size + 1));
+          ibwt->doTransformRange(slice, from, until,
+                                known ? frequencies : 0);
+          delete ibwt;
+          m_out->writeBlock(&data[from], &data[until]);
+          written += until - from;
+        }
+        sliceBegin = sliceEnd;
+      }
+    }
+    blockBegin = blockEnd;
+  }
+  m_out->flush();
+  return written;
+}
+
+void Decompressor::readBlocks(ThreadPool* pool,
+                              BoundedQueue<PendingBlock>* queue,
+                              MemoryBudget* budget) {
+  while(true) {
+    PendingBlock block;
+    block.pb = PrecompressorBlock::readBlockHeader(m_in);
+    if(block.pb->originalSize() == 0) {
+      delete block.pb;
+      block.pb = 0;
+      queue->push(block);
+      return;
+    }
+    /* Memory of the block is only written to by the tasks, so it is enough
+     * to reserve it here. */
+    block.reserved = block.pb->originalSize() + 1;
+    budget->acquire(block.reserved);
+    for(size_t i = 0; i < block.pb->slices(); ++i) {
+      uint64 compressedLength;
+      size_t size = readSliceHeader(m_in, compressedLength);
+      bool isLast = i + 1 == block.pb->slices();
+      /* Mapped input is decoded in place, otherwise the block is read into
+       * memory of its own. All but the last slice are inverted in a copy.
+       * Entropy decoders need roughly a byte per symbol at most. */
+      const byte *data = m_in->readInPlace(compressedLength);
+      size_t reserved = (data ? 0 : compressedLength) + (isLast ? 0 : size+1)
+          + size;
+      InverseBWTransform *ibwt = giveInverseTransformer(
+          pool, inverseBudget(block.reserved + reserved));
+      reserved += ibwt->maxSizeInBytes(size);
+      budget->acquire(reserved, block.reserved);
+      InStream *compressed;
+      if(data) {
+        compressed = new MemoryInStream(data, data + compressedLength);
+      } else {
+        std::vector<byte> buffer(compressedLength);
+        if(compressedLength > 0) {
+          size_t read = m_in->readBlock(&buffer[0], compressedLength);
+          assert(read == compressedLength);
+          (void) read;
+        }
+        compressed = new MemoryInStream(buffer);
+      }
+      BWTBlock& slice = block.pb->getSlice(i);
+      slice.setBegin(block.pb->end());
+      slice.setSize(size);
+      block.pb->usedAtEnd(size);
+
+      SliceDecodingTask *task = new SliceDecodingTask(
+          slice, isLast, m_decoderChoice, compressed, ibwt, *budget,
+          reserved);
+      block.tasks.push_back(task);
+      pool->submit(task);
+    }
+    queue->push(block);
+  }
+}
+
+size_t Decompressor::decompressInParallel(size_t threads, size_t headerSize) {
+  if(m_positional) {
+    /* Size of the output is known beforehand only from the index. Input
+     * which can't seek is left where it was. */
+    ArchiveIndex index;
+    if(index.read(m_in)) {
+      uint64 size = 0;
+      for(size_t i = 0; i < index.blocks().size(); ++i)
+        size += index.blocks()[i].originalSize;
+      m_positional->preallocate(size);
+    }
+    m_in->seek(headerSize);
+  }
+
+  /* Reader thread locates the BWT-blocks and gives them to the thread pool.
+   * As in compression, the memory limit is the total of all of the threads:
+   * the reader waits for the budget before a block or a BWT-block is taken
+   * under work. */
+  ThreadPool pool(threads);
+  MemoryBudget budget(m_memLimit);
+  BoundedQueue<PendingBlock> queue(threads);
+  boost::thread reader(boost::bind(&Decompressor::readBlocks, this,
+                                   &pool, &queue, &budget));
+  if(m_positional) {
+    size_t decompressedSize = writeInParallel(pool, queue, budget);
+    reader.join();
+    return decompressedSize;
+  }
+
+  /* Blocks are postprocessed and written in the original order. */
+  size_t decompressedSize = 0;
+  while(true) {
+    PendingBlock block = queue.pop();
+    if(!block.pb) break;
+    for(size_t i = 0; i < block.tasks.size(); ++i) {
+      pool.wait(block.tasks[i]);
+      delete block.tasks[i];
+    }
+    /* Only this thread writes to the output, so postprocessing can be run
+     * in the pool while waiting. */
+    PostprocessingTask postprocessing(block.pb, m_out);
+    pool.submit(&postprocessing);
+    pool.wait(&postprocessing);
+    decompressedSize += postprocessing.size();
+    assert(postprocessing.size() == block.pb->originalSize());
+    delete block.pb;
+    budget.release(block.reserved);
+  }
+  reader.join();
+  return decompressedSize;
+}
+
+namespace {
+
+size_t finish(ThreadPool& pool, PostprocessingTask* task) {
+  pool.wait(task);
+  size_t size = task->size();
+  delete task;
+  return size;
+}
+
+} //anonymous namespace
+
+size_t Decompressor::writeInParallel(ThreadPool& pool,
+                                     BoundedQueue<PendingBlock>& queue,
+                                     MemoryBudget& budget) {
+  /* This thread doesn't wait for the postprocessing of a block before
+   * starting the next one, but at most as many blocks as there are threads
+   * are kept waiting for postprocessing. Postprocessing task releases the
+   * memory of its block. */
+  std::deque<PostprocessingTask*> running;
+  uint64 position = 0;
+  size_t decompressedSize = 0;
+  while(true) {
+    PendingBlock block = queue.pop();
+    if(!block.pb) break;
+    for(size_t i = 0; i < block.tasks.size(); ++i) {
+      pool.wait(block.tasks[i]);
+      delete block.tasks[i];
+    }
+    PostprocessingTask *post = new PostprocessingTask(
+        block.pb, m_positional->writerAt(position), budget, block.reserved);
+    position += block.pb->originalSize();
+    pool.submit(post);
+    running.push_back(post);
+    if(running.size() > pool.threads()) {
+      decompressedSize += finish(pool, running.front());
+      running.pop_front();
+    }
+  }
+  for(; !running.empty(); running.pop_front())
+    decompressedSize += finish(pool, running.front());
   return decompressedSize;
 }
 
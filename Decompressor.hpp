@@ -28,7 +28,34 @@
  *  input -->  ENTROPY DECODING -> INVERSE BWT -> POSTPROCESSING --> ouput
  *
  * The postprocessing phase decompresses the precompressed data.
- * Memory needed for the decompression is determined by the compressor options.
+ * Memory needed for the decompression is determined by the compressor options,
+ * except that with a memory limit the blocks too large for the default
+ * inverse transform are inverted with the slower SampledInverseBWTransform.
+ * The limit is the total for all of the threads.
+ *
+ * With a single thread each BWT-block is postprocessed and written as soon
+ * as it is inverted, so the output starts before the whole precompressed
+ * block is inverted, and all BWT-blocks of it use the same memory.
+ *
+ * With multiple threads a reader thread locates the BWT-blocks, which are
+ * then entropy decoded and inverted in a thread pool. Inverse transform of
+ * a large block is split further into tasks of the same pool. Blocks are
+ * postprocessed in the pool as well, so only the given number of threads is
+ * working at any time. The reader reserves the memory of each block and of
+ * the decoding of each BWT-block from a MemoryBudget before they are
+ * allocated, so the memory used doesn't grow with the number of threads.
+ * Without a memory limit the budget holds only one block at a time, as in
+ * the single-threaded decompression. When the output is a regular file, it is allocated
+ * beforehand and each block is postprocessed and written to its own
+ * position as soon as it is ready; otherwise blocks are postprocessed one
+ * at a time in the original order.
+ *
+ * A range of the original data can be decompressed alone with the index
+ * written at the end of the compressed file (see ArchiveIndex.hpp).
+ *
+ * Files of format version 1 (see s_formatVersion) have neither the headers
+ * of the BWT-blocks nor the index, so they are always decompressed with a
+ * single thread, and only the given range of the output is written.
  *
  * For the description of compressed file format @see Compressor.hpp.
  *
@@ -39,6 +66,8 @@
 #include "Compressor.hpp"
 #include "EntropyCoders.hpp"
 #include "Streams.hpp"
+#include "bwtransforms/InverseBWT.hpp"
+#include "ThreadPool.hpp"
 #include "preprocessors/Postprocessor.hpp"
 
 #include <string>
@@ -47,17 +76,68 @@ namespace bwtc {
 
 class Decompressor {
  public:
-  Decompressor(const std::string& in, const std::string& out);
-  Decompressor(InStream* in, OutStream* out);
+  /**
+   * Memory limit (in bytes) is the total memory of decompression shared by
+   * the threads. Inverse transform of a block gets what is left of the limit
+   * after the block, see giveInverseTransformer(). Zero means no limit.
+   */
+  Decompressor(const std::string& in, const std::string& out,
+               uint64 memLimit = 0);
+  Decompressor(InStream* in, OutStream* out, uint64 memLimit = 0);
   ~Decompressor();
 
   size_t decompress(size_t threads);
+  /**
+   * Reads the format version and the entropy coder of the file. Files
+   * without the version (from before it was added) are of version 1.
+   *
+   * @return Size of the header in bytes.
+   * @throws std::runtime_error if the version is newer than s_formatVersion.
+   */
   size_t readGlobalHeader();
 
+  /**
+   * Decompresses only the bytes [offset, offset + length) of the original
+   * data. With a seekable input the index at the end of the compressed file
+   * is used for decoding only the blocks needed.
+   *
+   * @return Number of bytes written.
+   */
+  uint64 decompressRange(uint64 offset, uint64 length);
+
  private:
+  struct PendingBlock;
+
+  /**
+   * Decodes and inverts the BWT-blocks following the header of pb, and
+   * postprocesses each of them into out as soon as it is inverted.
+   *
+   * @return Number of bytes written.
+   */
+  size_t decodeSlices(PrecompressorBlock* pb, InverseBWTransform* ibwt,
+                      OutStream* out);
+
+  /** The global header (of headerSize bytes) has been read. */
+  size_t decompressInParallel(size_t threads, size_t headerSize);
+  /** Postprocesses the blocks as they are ready and writes each to its own
+   * position of m_positional. */
+  size_t writeInParallel(ThreadPool& pool, BoundedQueue<PendingBlock>& queue,
+                         MemoryBudget& budget);
+  void readBlocks(ThreadPool* pool, BoundedQueue<PendingBlock>* queue,
+                  MemoryBudget* budget);
+  /** Memory budget of the inverse transform, when reserved bytes of the
+   * memory limit are already in use. */
+  uint64 inverseBudget(uint64 reserved) const;
+
   InStream *m_in;
+  /* Output file written in parallel, if the output is a regular file. Same
+   * object as m_out. */
+  PositionalOutStream *m_positional;
   OutStream *m_out;
   EntropyDecoder *m_decoder;
+  char m_decoderChoice;
+  byte m_formatVersion;
+  uint64 m_memLimit;
 };
 
 } //namespace bwtc
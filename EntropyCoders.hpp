@@ -71,6 +71,21 @@ class EntropyDecoder {
  public:
   virtual ~EntropyDecoder() {}
   virtual void decodeBlock(BWTBlock& block, InStream* in) = 0;
+
+  /**Decodes the block and gives the number of occurrences of each symbol in
+   * it, if the decoder knows them without an extra pass over the decoded
+   * block (f.ex. from the runs it decodes). The inverse transform can then
+   * skip counting them, see InverseBWTransform::doTransform.
+   *
+   * @param frequencies Array of 256 entries for the frequencies.
+   * @return true if the frequencies were given
+   */
+  virtual bool decodeBlock(BWTBlock& block, InStream* in,
+                           uint64 *frequencies) {
+    (void) frequencies;
+    decodeBlock(block, in);
+    return false;
+  }
 };
 
 EntropyEncoder* giveEntropyEncoder(char encoder);
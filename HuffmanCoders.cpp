@@ -36,6 +36,7 @@
 #include <vector>
 #include <map> // for entropy profiling
 #include<cmath>
+#include "BitStreams.hpp"
 #include "HuffmanCoders.hpp"
 #include "globaldefs.hpp"
 #include "Utils.hpp"
@@ -50,11 +51,9 @@ HuffmanEncoder::~HuffmanEncoder() {}
 
 size_t HuffmanEncoder::
 transformAndEncode(BWTBlock& block, BWTManager& bwtm, OutStream* out) {
-  std::vector<uint32> characterFrequencies(256, 0);
-  //TODO: Also gather information about the runs  during BWT
-  bwtm.doTransform(block, &characterFrequencies[0]); 
-    
-    //new
+  BWTStatistics bwtStats;
+  bwtm.doTransform(block, bwtStats);
+
     uint64 size=block.size();
     std::vector<uint32> context_lengths(256, 0);
     int a = 256;
@@ -63,9 +62,8 @@ transformAndEncode(BWTBlock& block, BWTManager& bwtm, OutStream* out) {
     }
     for(int i=0;i<a;i++) context_lengths[i]=size/a;
     context_lengths[0] += size % a;
-    characterFrequencies=context_lengths;
-    writeBlockHeader(block, characterFrequencies, out);
-    encodeData(block.begin(), characterFrequencies, block.size(), out);
+    writeBlockHeader(block, context_lengths, out);
+    encodeData(block.begin(), context_lengths, bwtStats, block.size(), out);
     finishBlock(out);
     return m_compressedBlockLength + 6;
 }
@@ -96,8 +94,9 @@ void HuffmanEncoder::serializeShape(uint32 *clen, std::vector<bool> &vec) {
 }
 
 size_t HuffmanDecoder::deserializeShape(InStream &input, uint32 *clen) {
-    size_t maxSym = input.readByte();
-    size_t symbols = input.readByte();
+    BitReader reader(&input);
+    size_t maxSym = reader.readByte();
+    size_t symbols = reader.readByte();
     if(symbols == 0) symbols = 256;
 
     size_t bitsRead = 16;
@@ -105,46 +104,49 @@ size_t HuffmanDecoder::deserializeShape(InStream &input, uint32 *clen) {
     size_t read = 0xff;
     size_t j = 0;
     while(read & 0x80) {
-        read = input.readByte();
+        read = reader.readByte();
         maxLen |= ((read & 0x7f) << j);
         j += 7;
         bitsRead += 8;
     }
 
     std::vector<byte> alphabet;
-    bitsRead += utils::binaryInterpolativeDecode(alphabet, input,
+    bitsRead += utils::binaryInterpolativeDecode(alphabet, reader,
             maxSym, symbols);
 
     for(size_t i = 0; i < symbols; ++i) {
-        size_t n = utils::unaryDecode(input);
+        size_t n = utils::unaryDecode(reader);
         bitsRead += n;
         size_t len = maxLen - n + 1;
         clen[alphabet[i]] = len;
     }
 
-    input.flushBuffer();
+    reader.flushBuffer();
     return (bitsRead + 7) / 8;
 }
 
 void HuffmanEncoder::
 encodeData(const byte* block, const std::vector<uint32>& stats,
-        uint32 blockSize, OutStream* out) {
+        const BWTStatistics& bwtStats, uint32 blockSize, OutStream* out) {
     PROFILE("HuffmanEncoder::encodeData");
     size_t beg = 0;
 
-
-    double entropy=0;
-    std::vector<int> ts(256,0);
-    for(int i=0;i<blockSize;i++) ts[*(block+i)]++;
-    for(int i=0;i<256;i++) {
-        if(ts[i]==0) continue;
-        entropy -= (ts[i]*1.0/blockSize) * log(ts[i]*1.0/blockSize);
+    if(verbosity > 2) {
+        double entropy=0;
+        for(int i=0;i<256;i++) {
+            uint32 f = bwtStats.frequencies[i];
+            if(f==0) continue;
+            entropy -= (f*1.0/blockSize) * log(f*1.0/blockSize);
+        }
+        std::clog<<"Entropy: "<<entropy<<"\n";
     }
-    std::cout<<"Entropy: "<<entropy<<"\n";
 
-    // For storing runs data.
-    byte *runseq = new byte[blockSize];
-    uint32 *runlen = new uint32[blockSize];
+    // For storing runs data. A piece has at most one run more than it
+    // has runs of the whole block, counted during the BWT.
+    assert(blockSize == 0 || bwtStats.totalRuns() > 0);
+    uint64 maxRuns = bwtStats.totalRuns() + 1;
+    byte *runseq = new byte[maxRuns];
+    uint32 *runlen = new uint32[maxRuns];
     if (!runseq || !runlen) {
         fprintf(stderr,"Allocation error.\n");
         exit(1);
@@ -218,6 +220,7 @@ encodeData(const byte* block, const std::vector<uint32>& stats,
         utils::computeHuffmanCodes(clen, code);
 
         // Encode the data using Huffman code.
+        SpanWriter writer(out);
         // Assumption: max_code_len <= 47 (roughly).
         uint64 buffer = 0;
         int32 bitsInBuffer = 0;
@@ -225,7 +228,7 @@ encodeData(const byte* block, const std::vector<uint32>& stats,
             byte c = runseq[k];
             while (bitsInBuffer + clen[c] > 64) {
                 bitsInBuffer -= 8;
-                out->writeByte((buffer >> bitsInBuffer) & 0xff);
+                writer.writeByte((buffer >> bitsInBuffer) & 0xff);
                 ++m_compressedBlockLength;
             }
             buffer <<= clen[c];
@@ -236,14 +239,14 @@ encodeData(const byte* block, const std::vector<uint32>& stats,
         // Flush the remaining bytes.    
         while (bitsInBuffer >= 8) {
             bitsInBuffer -= 8;
-            out->writeByte((buffer >> bitsInBuffer) & 0xff);
+            writer.writeByte((buffer >> bitsInBuffer) & 0xff);
             ++m_compressedBlockLength;
         }
 
         // Flush the remaining bits.
         if (bitsInBuffer > 0) {
             buffer <<= (8 - bitsInBuffer);
-            out->writeByte(buffer & 0xff);
+            writer.writeByte(buffer & 0xff);
             ++m_compressedBlockLength;
         }
 
@@ -254,7 +257,7 @@ encodeData(const byte* block, const std::vector<uint32>& stats,
             int gammaCodeLen = utils::logFloor(runlen[k]) * 2 + 1;
             while (bitsInBuffer + gammaCodeLen > 64) {
                 bitsInBuffer -= 8;
-                out->writeByte((buffer >> bitsInBuffer) & 0xff);
+                writer.writeByte((buffer >> bitsInBuffer) & 0xff);
                 ++m_compressedBlockLength;
             }
             buffer <<= gammaCodeLen;
@@ -263,14 +266,15 @@ encodeData(const byte* block, const std::vector<uint32>& stats,
         }
         while (bitsInBuffer >= 8) {
             bitsInBuffer -= 8;
-            out->writeByte((buffer >> bitsInBuffer) & 0xff);
+            writer.writeByte((buffer >> bitsInBuffer) & 0xff);
             ++m_compressedBlockLength;
         }
         if (bitsInBuffer > 0) {
             buffer <<= (8 - bitsInBuffer);
-            out->writeByte(buffer & 0xff);
+            writer.writeByte(buffer & 0xff);
             ++m_compressedBlockLength;
         }
+        writer.commit();
 
         beg += current_cblock_size;
     }
@@ -358,14 +362,22 @@ readBlockHeader(BWTBlock& block, std::vector<uint64>* stats, InStream* in) {
 }
 
 void HuffmanDecoder::decodeBlock(BWTBlock& block, InStream* in) {
+    decodeBlock(block, in, 0);
+}
+
+bool HuffmanDecoder::
+decodeBlock(BWTBlock& block, InStream* in, uint64 *frequencies) {
     PROFILE("HuffmanDecoder::decodeBlock");
-    if(in->compressedDataEnding()) return;
+    if(in->compressedDataEnding()) return false;
+    if(frequencies) std::fill(frequencies, frequencies + 256, 0);
 
     std::vector<uint64> context_lengths;
     uint64 compr_len = readBlockHeader(block, &context_lengths, in);
-    std::cout<<"contexts: ";
-    for(int i=0;i<context_lengths.size();i++) std::cout<<context_lengths[i]<<" ";
-    std::cout<<"\n";
+    if(verbosity > 2) {
+        std::clog<<"contexts: ";
+        for(int i=0;i<context_lengths.size();i++) std::clog<<context_lengths[i]<<" ";
+        std::clog<<"\n";
+    }
 
     if (verbosity > 2) {
         std::clog << "Size of compressed block = " << compr_len << "\n";
@@ -611,25 +623,17 @@ void HuffmanDecoder::decodeBlock(BWTBlock& block, InStream* in) {
         in->flushBuffer();
 
         // Now read gamma codes that store lenghts of runs.
-        for (uint64 k = 0; k < nRuns; ++k) {
-            int zeros = 0;
-            while (!in->readBit())
-                ++zeros;
-            uint64 value = 0;        
-            for (int32 t = 0; t < zeros; ++t) {
-                int32 bit = in->readBit();
-                value = (value << 1) | bit;
-            }
-            value |= (1 << zeros);
-            runlen[k] = value;
-        }
-        in->flushBuffer();
+        BitReader reader(in);
+        for (uint64 k = 0; k < nRuns; ++k)
+            runlen[k] = reader.readGamma();
+        reader.flushBuffer();
 
         // Fill the block with runs data.
         byte *runseq_ptr = &runseq[0];
         for (uint64 k = 0; k < nRuns; ++k) {
             for (uint32 t = 0; t < runlen[k]; ++t)
                 *data_ptr++ = *runseq_ptr;
+            if (frequencies) frequencies[*runseq_ptr] += runlen[k];
             ++runseq_ptr;
         }
     }
@@ -638,6 +642,7 @@ void HuffmanDecoder::decodeBlock(BWTBlock& block, InStream* in) {
 
     delete[] runseq;
     delete[] runlen;
+    return frequencies != 0;
 }
 
 uint64 HuffmanDecoder::readPackedInteger(InStream* in) {
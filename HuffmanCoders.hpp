@@ -50,8 +50,10 @@ class HuffmanEncoder : public EntropyEncoder {
   size_t transformAndEncode(BWTBlock& block, BWTManager& bwtm,
                             OutStream* out);
   
+  /**bwtStats are the statistics gathered during the BWT of the block. */
   void encodeData(const byte* data, const std::vector<uint32>& stats,
-                  uint32 blockSize, OutStream* out);
+                  const BWTStatistics& bwtStats, uint32 blockSize,
+                  OutStream* out);
   void writeBlockHeader(const BWTBlock& b, std::vector<uint32>& stats,
                         OutStream* out);
   void finishBlock(OutStream* out);
@@ -75,6 +77,8 @@ class HuffmanDecoder : public EntropyDecoder {
 
   uint64 readPackedInteger(InStream* in);
   void decodeBlock(BWTBlock& block, InStream* in);
+  /* Frequencies are counted from the decoded runs. */
+  bool decodeBlock(BWTBlock& block, InStream* in, uint64 *frequencies);
   uint64 readBlockHeader(BWTBlock& block, std::vector<uint64>* stats,
                          InStream* in);
 
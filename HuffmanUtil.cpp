@@ -37,6 +37,7 @@
 #include <vector>
 #include <map> // for entropy profiling
 #include<cmath>
+#include "BitStreams.hpp"
 #include "HuffmanUtil.hpp"
 #include "globaldefs.hpp"
 #include "Utils.hpp"
@@ -95,8 +96,9 @@ namespace bwtc {
     }
 
     size_t HuffmanUtilDecoder::deserializeShape(InStream &input, uint32 *clen) {
-        size_t maxSym = input.readByte();
-        size_t symbols = input.readByte();
+        BitReader reader(&input);
+        size_t maxSym = reader.readByte();
+        size_t symbols = reader.readByte();
         if(symbols == 0) symbols = 256;
 
         size_t bitsRead = 16;
@@ -104,24 +106,24 @@ namespace bwtc {
         size_t read = 0xff;
         size_t j = 0;
         while(read & 0x80) {
-            read = input.readByte();
+            read = reader.readByte();
             maxLen |= ((read & 0x7f) << j);
             j += 7;
             bitsRead += 8;
         }
 
         std::vector<byte> alphabet;
-        bitsRead += utils::binaryInterpolativeDecode(alphabet, input,
+        bitsRead += utils::binaryInterpolativeDecode(alphabet, reader,
                 maxSym, symbols);
 
         for(size_t i = 0; i < symbols; ++i) {
-            size_t n = utils::unaryDecode(input);
+            size_t n = utils::unaryDecode(reader);
             bitsRead += n;
             size_t len = maxLen - n + 1;
             clen[alphabet[i]] = len;
         }
 
-        input.flushBuffer();
+        reader.flushBuffer();
         return (bitsRead + 7) / 8;
     }
 
@@ -163,6 +165,7 @@ namespace bwtc {
             utils::computeHuffmanCodes(clen, code);
             
             // Encode the data using HuffmanUtil code.
+            SpanWriter writer(out);
             // Assumption: max_code_len <= 47 (roughly).
             uint64 buffer = 0;
             int32 bitsInBuffer = 0;
@@ -170,7 +173,7 @@ namespace bwtc {
                 byte c = *(block_ptr+k);
                 while (bitsInBuffer + clen[c] > 64) {
                     bitsInBuffer -= 8;
-                    out->writeByte((buffer >> bitsInBuffer) & 0xff);
+                    writer.writeByte((buffer >> bitsInBuffer) & 0xff);
                     ++m_compressedBlockLength;
                 }
                 buffer <<= clen[c];
@@ -181,16 +184,17 @@ namespace bwtc {
             // Flush the remaining bytes.    
             while (bitsInBuffer >= 8) {
                 bitsInBuffer -= 8;
-                out->writeByte((buffer >> bitsInBuffer) & 0xff);
+                writer.writeByte((buffer >> bitsInBuffer) & 0xff);
                 ++m_compressedBlockLength;
             }
 
             // Flush the remaining bits.
             if (bitsInBuffer > 0) {
                 buffer <<= (8 - bitsInBuffer);
-                out->writeByte(buffer & 0xff);
+                writer.writeByte(buffer & 0xff);
                 ++m_compressedBlockLength;
             }
+            writer.commit();
             block_ptr+=context_lengths[i];
         }
     }
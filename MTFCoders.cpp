@@ -108,9 +108,6 @@ namespace bwtc {
 
         PROFILE("MTFEncoder::encodeData");
         size_t bytes_used=block.writeHeader(out)+6;
-        for(int i=0;i<block.size();i++) {
-            std::cout<<block.begin()[i];
-        }
 
 
         Node* start=new Node(0);
@@ -163,9 +160,14 @@ namespace bwtc {
     }
 
     void MTFDecoder::decodeBlock(BWTBlock& block, InStream* in) {
+        decodeBlock(block, in, 0);
+    }
+
+    bool MTFDecoder::decodeBlock(BWTBlock& block, InStream* in,
+                                 uint64 *frequencies) {
 
         PROFILE("MTFDecoder::decodeBlock");
-        if(in->compressedDataEnding()) return;
+        if(in->compressedDataEnding()) return false;
 
 
         bool rle=true;
@@ -206,10 +208,12 @@ namespace bwtc {
         int run_iter=0;
 
         int wrote=0;
+        uint64 counts[256] = {0};
         for(int i=0;i<data.size();i++) {
             byte rank = data[i];
             byte temp = m_rankList[rank];
             wrote++;
+            ++counts[temp];
             *(block_ptr++) = temp;
             if(rle) {
                 if(temp==prev && i!=0) cur_run++;
@@ -219,6 +223,7 @@ namespace bwtc {
                 }
                 if(cur_run>=minrun && temp<=maxval) {
                     int length=runs[run_iter++];
+                    counts[temp] += length-1;
                     for(int j=0;j<length-1;j++) {
                         *(block_ptr++)=temp;
                         wrote++;
@@ -232,6 +237,8 @@ namespace bwtc {
 
             m_rankList[0]=temp;
         }
+        if(frequencies) std::copy(counts, counts + 256, frequencies);
+        return frequencies != 0;
     }
 
     MTFDecoder::MTFDecoder(char decoder) : m_decoder(decoder) {}
@@ -73,6 +73,9 @@ namespace bwtc {
             ~MTFDecoder();
 
             void decodeBlock(BWTBlock& block, InStream* in);
+            /* Frequencies are counted while the ranks are decoded. */
+            bool decodeBlock(BWTBlock& block, InStream* in,
+                             uint64 *frequencies);
             std::vector<uint64> readRLE(InStream* in, int& extra, char decoder);
 
         private:
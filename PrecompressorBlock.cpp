@@ -124,11 +124,11 @@ readBlockHeader(InStream* in, MetaData metadata) {
 void PrecompressorBlock::sliceIntoBlocks(size_t blockSize) {
   //Have at least one additional byte for the sentinel of BWT
   assert(m_used < m_reserved);
-  assert(blockSize < (0x80000000 - 2));
+  assert(blockSize > 0);
   m_bwtBlocks.clear();
   size_t begin = 0;
   while(begin < m_used) {
-    uint32 bSize = std::min(blockSize, m_used - begin);
+    size_t bSize = std::min(blockSize, m_used - begin);
     m_bwtBlocks.push_back(BWTBlock(&m_data[begin], bSize, false));
     begin += bSize;
   }
@@ -32,9 +32,17 @@
 #include <iterator>
 #include <string>
 #include <algorithm>
+#include <cerrno>
+#include <limits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "globaldefs.hpp"
 #include "Streams.hpp"
+#include "AsyncStreams.hpp"
 
 #include "Profiling.hpp"
 
@@ -57,6 +65,7 @@ RawOutStream::RawOutStream(const std::string& file_name)
     m_fileptr = stdout;
   }
   m_filled = 0;
+  m_reservedOutside = false;
   assert(m_fileptr);
 }
 
@@ -103,12 +112,42 @@ void RawOutStream::writeBlock(const byte *begin, const byte *end) {
   }
 }
 
+byte* RawOutStream::reserve(size_t n) {
+  if (n > kBufferSize) {
+    m_reservedOutside = true;
+    return OutStream::reserve(n);
+  }
+  if (m_filled + n > kBufferSize) {
+    fwrite(m_buffer, 1, m_filled, m_fileptr);
+    m_filled = 0;
+  }
+  return m_buffer + m_filled;
+}
+
+void RawOutStream::commit(size_t used) {
+  if (m_reservedOutside) {
+    m_reservedOutside = false;
+    OutStream::commit(used);
+    return;
+  }
+  assert(m_filled + used <= kBufferSize);
+  m_filled += used;
+  if (m_filled == kBufferSize) {
+    fwrite(m_buffer, 1, m_filled, m_fileptr);
+    m_filled = 0;
+  }
+}
+
 void RawOutStream::write48bits(uint64 to_written, long int position) {
   assert((to_written & (((uint64)0xFFFF) << 48)) == 0);
   flush();
   long int current = ftell(m_fileptr);
   // fseeking with negative offset from SEEK_CUR might be faster.
-  fseek(m_fileptr, position, SEEK_SET);
+  if (current < 0 || fseek(m_fileptr, position, SEEK_SET) != 0) {
+    /* Writing into a pipe has to be done sequentially. */
+    fprintf(stderr, "Cannot seek in the output stream!\n");
+    exit(1);
+  }
   for(int i = 5; i >= 0; --i) {
     byte b = 0xFF & (to_written >> i*8);
     fputc(b, m_fileptr);
@@ -116,6 +155,14 @@ void RawOutStream::write48bits(uint64 to_written, long int position) {
   fseek(m_fileptr, current, SEEK_SET);
 }
 
+void MemoryOutStream::write48bits(uint64 to_written, long int position) {
+  assert((to_written & (((uint64)0xFFFF) << 48)) == 0);
+  assert(position >= 0 && position + 6 <= getPos());
+  for(int i = 5; i >= 0; --i) {
+    m_data[position++] = 0xFF & (to_written >> i*8);
+  }
+}
+
 uint64 RawInStream::read48bits() {
   uint64 result = 0;
   for(int i = 0; i < 6; ++i) {
@@ -157,11 +204,19 @@ RawInStream::~RawInStream() {
 
 size_t RawInStream::readBlock(byte* to, size_t max_block_size) {
   assert(m_bitsInBuffer == 0);
-  uint64 have_read = 0;
-  int32 c;
-  while (have_read < max_block_size && (c = fetchByte()) != EOF) {
-    to[have_read++] = static_cast<byte>(c);
+  size_t have_read = 0;
+  if (m_bigbuf_left > 0) {
+    have_read = std::min(max_block_size, static_cast<size_t>(m_bigbuf_left));
+    std::copy(m_bigbuf + m_bigbuf_pos, m_bigbuf + m_bigbuf_pos + have_read, to);
+    m_bigbuf_pos += have_read;
+    m_bigbuf_left -= have_read;
+  }
+  /* The rest is read straight into its place, not through the buffer. */
+  if (have_read < max_block_size) {
+    have_read += fread(to + have_read, 1, max_block_size - have_read,
+                       m_fileptr);
   }
+  pos += have_read;
   return have_read;
 }
 
@@ -185,5 +240,239 @@ int32 RawInStream::peekByte() {
   return m_bigbuf[m_bigbuf_pos];
 }
 
-} //namespace bwtc
+MemoryInStream::MemoryInStream(std::vector<byte>& data)
+    : m_begin(0), m_position(0), m_end(0), m_buffer(0), m_bitsInBuffer(0)
+{
+  m_data.swap(data);
+  if (!m_data.empty()) setRange(&m_data[0], &m_data[0] + m_data.size());
+  pos = 0;
+}
+
+MemoryInStream::MemoryInStream(const byte* begin, const byte* end)
+    : m_begin(begin), m_position(begin), m_end(end), m_buffer(0),
+      m_bitsInBuffer(0)
+{
+  pos = 0;
+}
+
+MemoryInStream::MemoryInStream()
+    : m_begin(0), m_position(0), m_end(0), m_buffer(0), m_bitsInBuffer(0)
+{
+  pos = 0;
+}
+
+void MemoryInStream::setRange(const byte* begin, const byte* end) {
+  m_begin = m_position = begin;
+  m_end = end;
+}
 
+bool MemoryInStream::seek(uint64 position) {
+  assert(position <= size());
+  m_position = m_begin + position;
+  m_bitsInBuffer = 0;
+  pos = position;
+  return true;
+}
+
+size_t MemoryInStream::readBlock(byte* to, size_t max_block_size) {
+  assert(m_bitsInBuffer == 0);
+  size_t length = std::min(max_block_size,
+                           static_cast<size_t>(m_end - m_position));
+  if (length > 0) {
+    std::copy(m_position, m_position + length, to);
+  }
+  m_position += length;
+  pos += length;
+  return length;
+}
+
+const byte* MemoryInStream::readInPlace(size_t length) {
+  assert(m_bitsInBuffer == 0);
+  if (static_cast<size_t>(m_end - m_position) < length) return 0;
+  const byte *result = m_position;
+  m_position += length;
+  pos += length;
+  return result;
+}
+
+uint64 MemoryInStream::read48bits() {
+  uint64 result = 0;
+  for(int i = 0; i < 6; ++i) {
+    result <<= 8;
+    result |= fetchByte();
+  }
+  return result;
+}
+
+MmapInStream::MmapInStream(const std::string& file_name)
+    : m_name(file_name), m_mapping(0), m_size(0), m_released(0)
+{
+  int fd = open(m_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    perror(m_name.c_str());
+    exit(1);
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    perror(m_name.c_str());
+    exit(1);
+  }
+  m_size = static_cast<size_t>(info.st_size);
+  /* Empty file can't be mapped, but then there is nothing to read either. */
+  if (m_size > 0) {
+    m_mapping = mmap(0, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (m_mapping == MAP_FAILED) {
+      perror(m_name.c_str());
+      exit(1);
+    }
+    madvise(m_mapping, m_size, MADV_SEQUENTIAL);
+    const byte *begin = static_cast<const byte*>(m_mapping);
+    setRange(begin, begin + m_size);
+  }
+  /* Mapping stays valid after the file is closed. */
+  close(fd);
+}
+
+MmapInStream::~MmapInStream() {
+  if (m_mapping) munmap(m_mapping, m_size);
+}
+
+size_t MmapInStream::readBlock(byte* to, size_t max_block_size) {
+  size_t result = MemoryInStream::readBlock(to, max_block_size);
+  releaseConsumed();
+  return result;
+}
+
+const byte* MmapInStream::readInPlace(size_t length) {
+  releaseConsumed();
+  return MemoryInStream::readInPlace(length);
+}
+
+void MmapInStream::releaseConsumed() {
+  size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t end = offset() / page * page;
+  if (end < m_released + kReleaseInterval) return;
+  madvise(static_cast<byte*>(m_mapping) + m_released, end - m_released,
+          MADV_DONTNEED);
+  m_released = end;
+}
+
+bool MmapInStream::canMap(const std::string& file_name) {
+  if (file_name == "") return false;
+  struct stat info;
+  if (stat(file_name.c_str(), &info) != 0) return false;
+  if (!S_ISREG(info.st_mode) || info.st_size == 0) return false;
+  /* 32-bit address space is too small for big files. */
+  return static_cast<uint64>(info.st_size) <=
+      static_cast<uint64>(std::numeric_limits<size_t>::max() / 2);
+}
+
+PwriteOutStream::PwriteOutStream(int fd, const std::string& file_name,
+                                 uint64 position)
+    : m_fd(fd), m_name(file_name), m_buffer(kBufferSize), m_filled(0),
+      m_position(position) {}
+
+PwriteOutStream::~PwriteOutStream() {
+  writeBuffer();
+}
+
+void PwriteOutStream::writeAt(uint64 position, const byte *begin,
+                              const byte *end) {
+  while (begin < end) {
+    ssize_t written = pwrite(m_fd, begin, end - begin, position);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      perror(m_name.c_str());
+      exit(1);
+    }
+    begin += written;
+    position += written;
+  }
+}
+
+void PwriteOutStream::writeBuffer() {
+  if (m_filled == 0) return;
+  writeAt(m_position, &m_buffer[0], &m_buffer[0] + m_filled);
+  m_position += m_filled;
+  m_filled = 0;
+}
+
+void PwriteOutStream::writeBlock(const byte *begin, const byte *end) {
+  size_t size = end - begin;
+  if (m_filled + size <= kBufferSize) {
+    std::copy(begin, end, &m_buffer[m_filled]);
+    m_filled += size;
+    if (m_filled == kBufferSize) writeBuffer();
+  } else {
+    writeBuffer();
+    writeAt(m_position, begin, end);
+    m_position += size;
+  }
+}
+
+void PwriteOutStream::write48bits(uint64 to_written, long int position) {
+  assert((to_written & (((uint64)0xFFFF) << 48)) == 0);
+  assert(position >= 0 && position + 6 <= getPos());
+  byte bytes[6];
+  for (int i = 5, j = 0; i >= 0; --i, ++j) bytes[j] = 0xFF & (to_written >> i*8);
+  /* Part of the field may already be in the file and the rest in the
+   * buffer. */
+  uint64 start = static_cast<uint64>(position);
+  size_t inFile = 0;
+  if (start < m_position) {
+    inFile = std::min(static_cast<uint64>(6), m_position - start);
+    writeAt(start, bytes, bytes + inFile);
+  }
+  for (size_t i = inFile; i < 6; ++i) {
+    m_buffer[start + i - m_position] = bytes[i];
+  }
+}
+
+namespace {
+
+int openForWriting(const std::string& file_name) {
+  int fd = open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) {
+    perror(file_name.c_str());
+    exit(1);
+  }
+  return fd;
+}
+
+} //anonymous namespace
+
+PositionalOutStream::PositionalOutStream(const std::string& file_name)
+    : PwriteOutStream(openForWriting(file_name), file_name, 0) {}
+
+PositionalOutStream::~PositionalOutStream() {
+  flush();
+  close(m_fd);
+}
+
+bool PositionalOutStream::canWrite(const std::string& file_name) {
+  if (file_name == "") return false;
+  struct stat info;
+  if (stat(file_name.c_str(), &info) != 0) return errno == ENOENT;
+  return S_ISREG(info.st_mode);
+}
+
+void PositionalOutStream::preallocate(uint64 size) {
+  /* Not all file systems support allocation; then the file just gets its
+   * size and the blocks are allocated on writing. */
+  if (size == 0 || posix_fallocate(m_fd, 0, size) == 0) return;
+  if (ftruncate(m_fd, size) != 0) {
+    perror(m_name.c_str());
+    exit(1);
+  }
+}
+
+InStream* giveInStream(const std::string& file_name) {
+  if (MmapInStream::canMap(file_name)) return new MmapInStream(file_name);
+  return new ReadAheadInStream(file_name);
+}
+
+OutStream* giveOutStream(const std::string& file_name) {
+  return new WriteBehindOutStream(file_name);
+}
+
+} //namespace bwtc
@@ -47,6 +47,77 @@ class OutStream {
   virtual long int getPos() = 0;
   virtual void write48bits(uint64 to_written, long int position) = 0;
   virtual void flush() = 0;
+
+  /**
+   * Gives room for n bytes so that they can be written without a call per
+   * byte. Nothing else may be done with the stream before the bytes are
+   * added to it with commit().
+   *
+   * Streams with a buffer of their own return a pointer into it. The
+   * default implementation collects the bytes into a separate buffer and
+   * passes them to writeBlock.
+   */
+  virtual byte* reserve(size_t n) {
+    assert(n > 0);
+    m_reserved.resize(n);
+    return &m_reserved[0];
+  }
+
+  /** Adds the first used bytes of the room given by reserve() to the end of
+   * the stream. */
+  virtual void commit(size_t used) {
+    assert(used <= m_reserved.size());
+    writeBlock(&m_reserved[0], &m_reserved[0] + used);
+  }
+
+ private:
+  std::vector<byte> m_reserved;
+};
+
+/**
+ * SpanWriter writes bytes straight into the room reserved from OutStream,
+ * reserving it kChunkSize bytes at a time. The bytes are in the stream only
+ * after commit(), which also has to be called before using the stream
+ * otherwise.
+ */
+class SpanWriter {
+ public:
+  explicit SpanWriter(OutStream* out = 0)
+      : m_out(out), m_begin(0), m_next(0), m_end(0) {}
+  ~SpanWriter() { commit(); }
+
+  void connect(OutStream* out) {
+    commit();
+    m_out = out;
+  }
+
+  void writeByte(byte b) {
+    if (m_next == m_end) refill();
+    *m_next++ = b;
+  }
+
+  void commit() {
+    if (!m_begin) return;
+    m_out->commit(m_next - m_begin);
+    m_begin = m_next = m_end = 0;
+  }
+
+ private:
+  static const size_t kChunkSize = 1 << 12;
+
+  void refill() {
+    commit();
+    m_begin = m_next = m_out->reserve(kChunkSize);
+    m_end = m_begin + kChunkSize;
+  }
+
+  OutStream *m_out;
+  byte *m_begin;
+  byte *m_next;
+  byte *m_end;
+
+  SpanWriter& operator=(const SpanWriter&);
+  SpanWriter(const SpanWriter&);
 };
 
 class InStream {
@@ -58,6 +129,33 @@ class InStream {
   virtual void flushBuffer() = 0;
   virtual uint64 read48bits() = 0;
   virtual bool compressedDataEnding() = 0;
+
+  /**
+   * Gives the next length bytes of the stream without copying them, if the
+   * stream has them in memory. The bytes stay valid as long as the stream
+   * is alive.
+   *
+   * @return Pointer to the bytes, which are then skipped, or 0 if they are
+   *         not available in place; in that case nothing is read and the
+   *         caller has to use readBlock.
+   */
+  virtual const byte* readInPlace(size_t length) {
+    (void) length;
+    return 0;
+  }
+
+  /**
+   * Moves to the given position counted from the beginning of the stream.
+   *
+   * @return false if the stream doesn't support seeking.
+   */
+  virtual bool seek(uint64 position) {
+    (void) position;
+    return false;
+  }
+
+  /** Size of the whole stream, if known (seekable streams), otherwise 0. */
+  virtual uint64 size() const { return 0; }
   int pos;
 };
 
@@ -96,6 +194,10 @@ class RawOutStream : public OutStream {
   virtual void write48bits(uint64 to_written, long int position);
   virtual void flush();
 
+  /** Gives room from the buffer, unless n is larger than the buffer. */
+  virtual byte* reserve(size_t n);
+  virtual void commit(size_t used);
+
  private:
   static const uint32 kBufferSize = 1 << 16; // 64KB
 
@@ -103,12 +205,55 @@ class RawOutStream : public OutStream {
   FILE *m_fileptr;
   uint32 m_filled;
   byte *m_buffer;
+  bool m_reservedOutside;
 
   RawOutStream& operator=(const RawOutStream& os);
   RawOutStream(const RawOutStream& os);
 };
 
 
+/**
+ * MemoryOutStream collects the written data into memory.
+ *
+ * Entropy encoders running in worker threads write their output into
+ * MemoryOutStream, after which the compressor copies the result into the
+ * actual output stream in the right order.
+ */
+class MemoryOutStream : public OutStream {
+ public:
+  MemoryOutStream() : m_reservedAt(0) {}
+  virtual ~MemoryOutStream() {}
+
+  virtual void writeByte(byte b) { m_data.push_back(b); }
+  virtual void writeBlock(const byte *begin, const byte *end) {
+    m_data.insert(m_data.end(), begin, end);
+  }
+  virtual long int getPos() { return m_data.size(); }
+  virtual void write48bits(uint64 to_written, long int position);
+  virtual void flush() {}
+
+  virtual byte* reserve(size_t n) {
+    assert(n > 0);
+    m_reservedAt = m_data.size();
+    m_data.resize(m_reservedAt + n);
+    return &m_data[m_reservedAt];
+  }
+  virtual void commit(size_t used) {
+    assert(m_reservedAt + used <= m_data.size());
+    m_data.resize(m_reservedAt + used);
+  }
+
+  const std::vector<byte>& data() const { return m_data; }
+  void clear() { std::vector<byte>().swap(m_data); }
+
+ private:
+  std::vector<byte> m_data;
+  size_t m_reservedAt;
+
+  MemoryOutStream& operator=(const MemoryOutStream& os);
+  MemoryOutStream(const MemoryOutStream& os);
+};
+
 class RawInStream : public InStream {
  public:
   explicit RawInStream(const std::string &file_name);
@@ -170,6 +315,213 @@ class RawInStream : public InStream {
   RawInStream(const RawInStream& os);
 };
 
+/**
+ * MemoryInStream reads data from memory. Bit-level reading works exactly
+ * like in RawInStream.
+ *
+ * Decompressor reads each encoded BWT-block into MemoryInStream so that
+ * the blocks can be decoded in separate threads.
+ */
+class MemoryInStream : public InStream {
+ public:
+  /** Takes the contents of data, leaving data empty. */
+  explicit MemoryInStream(std::vector<byte>& data);
+  /** Reads the range [begin, end) which has to stay valid while the stream
+   * is used. */
+  MemoryInStream(const byte* begin, const byte* end);
+  virtual ~MemoryInStream() {}
+
+  virtual size_t readBlock(byte *to, size_t max_block_size);
+  virtual const byte* readInPlace(size_t length);
+  virtual bool seek(uint64 position);
+  virtual uint64 size() const { return m_end - m_begin; }
+
+  virtual inline bool readBit() {
+    if (m_bitsInBuffer == 0) {
+      m_buffer = fetchByte();
+      m_bitsInBuffer = 8;
+    }
+    return (m_buffer >> --m_bitsInBuffer) & 1;
+  }
+
+  virtual inline byte readByte() {
+    assert(m_bitsInBuffer < 8);
+    byte nextByte = fetchByte();
+    m_buffer = (m_buffer << 8) | nextByte;
+    return (m_buffer >> m_bitsInBuffer) & 0xff;
+  }
+
+  virtual inline void flushBuffer() {
+    m_bitsInBuffer = 0;
+  }
+
+  virtual uint64 read48bits();
+
+  /* Behaves like RawInStream::compressedDataEnding, which doesn't count the
+   * last byte of the input. */
+  virtual bool compressedDataEnding() {
+    return m_end - m_position <= 1;
+  }
+
+ protected:
+  /** For subclasses which give the range after construction. */
+  MemoryInStream();
+  void setRange(const byte* begin, const byte* end);
+  /** Number of bytes from the beginning to the reading position. */
+  size_t offset() const { return m_position - m_begin; }
+
+ private:
+  std::vector<byte> m_data;
+  const byte *m_begin;
+  const byte *m_position;
+  const byte *m_end;
+  uint16 m_buffer;
+  byte m_bitsInBuffer;
+
+  /* Reading past the end gives the same as RawInStream does at EOF. */
+  byte fetchByte() {
+    if (m_position >= m_end) return static_cast<byte>(EOF);
+    ++pos;
+    return *m_position++;
+  }
+  MemoryInStream& operator=(const MemoryInStream& os);
+  MemoryInStream(const MemoryInStream& os);
+};
+
+/**
+ * MmapInStream reads a regular file through a read-only memory mapping.
+ *
+ * Blocks are copied straight from the mapping with a single memcpy, and
+ * Decompressor decodes the encoded BWT-blocks from the mapping without
+ * copying them at all (see readInPlace). The kernel is told that the file
+ * is read sequentially, so it reads ahead aggressively. The pages behind
+ * the reading position are dropped from the mapping every kReleaseInterval
+ * bytes, right after a block is copied, so the memory used doesn't grow with
+ * the size of the file. Blocks decoded in place may still be in use then,
+ * but the mapping is read-only, so their pages are just read again from the
+ * file (or its page cache).
+ * On 64-bit systems files of any size can be mapped.
+ *
+ * @see giveInStream
+ */
+class MmapInStream : public MemoryInStream {
+ public:
+  /** Maps the file, or exits if it can't be mapped. */
+  explicit MmapInStream(const std::string& file_name);
+  virtual ~MmapInStream();
+
+  virtual size_t readBlock(byte *to, size_t max_block_size);
+  virtual const byte* readInPlace(size_t length);
+
+  /** Tells if the file is a (non-empty) regular file which can be mapped. */
+  static bool canMap(const std::string& file_name);
+
+  static const size_t kReleaseInterval = 1 << 20;
+
+ private:
+  /** Drops the pages before the reading position, once there are at least
+   * kReleaseInterval bytes of them. */
+  void releaseConsumed();
+
+  std::string m_name;
+  void *m_mapping;
+  size_t m_size;
+  /* Pages before this offset have been dropped. */
+  size_t m_released;
+
+  MmapInStream& operator=(const MmapInStream& os);
+  MmapInStream(const MmapInStream& os);
+};
+
+/**
+ * PwriteOutStream writes into a file descriptor with pwrite, starting from
+ * the given position. It doesn't share anything with other streams writing
+ * the same file, so several of them can write different parts of the file
+ * at the same time.
+ */
+class PwriteOutStream : public OutStream {
+ public:
+  /** Doesn't take the ownership of fd. */
+  PwriteOutStream(int fd, const std::string& file_name, uint64 position);
+  /** Writes the buffered data. */
+  virtual ~PwriteOutStream();
+
+  virtual inline void writeByte(byte b) {
+    m_buffer[m_filled++] = b;
+    if (m_filled == kBufferSize) writeBuffer();
+  }
+
+  virtual void writeBlock(const byte *begin, const byte *end);
+
+  virtual long int getPos() {
+    return static_cast<long int>(m_position + m_filled);
+  }
+
+  virtual void write48bits(uint64 to_written, long int position);
+  virtual void flush() { writeBuffer(); }
+
+ protected:
+  int m_fd;
+  std::string m_name;
+
+ private:
+  static const size_t kBufferSize = 1 << 20; // 1MB
+
+  void writeBuffer();
+  /** Writes the bytes at the position of the file, or exits on error. */
+  void writeAt(uint64 position, const byte *begin, const byte *end);
+
+  std::vector<byte> m_buffer;
+  size_t m_filled;
+  /* Position of the first byte in the buffer. */
+  uint64 m_position;
+
+  PwriteOutStream& operator=(const PwriteOutStream& os);
+  PwriteOutStream(const PwriteOutStream& os);
+};
+
+/**
+ * PositionalOutStream writes a regular file. It can be written sequentially
+ * like the other streams, but Decompressor writes each decompressed block
+ * straight to its final position, through a stream of its own given by
+ * writerAt(), as soon as the block is ready.
+ */
+class PositionalOutStream : public PwriteOutStream {
+ public:
+  /** Creates or truncates the file, or exits if that fails. */
+  explicit PositionalOutStream(const std::string& file_name);
+  virtual ~PositionalOutStream();
+
+  /** Tells if the name is a regular file or doesn't exist yet. */
+  static bool canWrite(const std::string& file_name);
+
+  /** Allocates the space for the file of the given size. */
+  void preallocate(uint64 size);
+
+  /** Gives a stream for writing the file from the given position on. The
+   * caller owns the stream, and it may be used in any thread. */
+  OutStream* writerAt(uint64 position) {
+    return new PwriteOutStream(m_fd, m_name, position);
+  }
+
+ private:
+  PositionalOutStream& operator=(const PositionalOutStream& os);
+  PositionalOutStream(const PositionalOutStream& os);
+};
+
+/**
+ * Opens a stream for reading the given file: regular files are mapped into
+ * memory with MmapInStream, and the rest (pipes, std::cin given as an empty
+ * name etc.) are read ahead in the background with ReadAheadInStream.
+ */
+InStream* giveInStream(const std::string& file_name);
+
+/**
+ * Opens a stream for writing the given file (std::cout for an empty name).
+ * The data is written in the background with WriteBehindOutStream.
+ */
+OutStream* giveOutStream(const std::string& file_name);
+
 } //namespace bwtc
 
 
@@ -0,0 +1,174 @@
+/**
+ * @file ThreadPool.cpp
+ * @author Pekka Mikkola <pmikkol@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This file is part of bwtc.
+ *
+ * bwtc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * bwtc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with bwtc.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Implementation of ThreadPool and MemoryBudget.
+ */
+
+#include <algorithm>
+#include <cassert>
+
+#include <boost/bind/bind.hpp>
+
+#include "ThreadPool.hpp"
+
+namespace bwtc {
+
+ThreadPool::ThreadPool(size_t threads)
+    : m_threads(threads), m_busySlots(0), m_stopping(false), m_local(threads)
+{
+  assert(threads > 0);
+  for(size_t i = 0; i < threads; ++i) {
+    m_workers.create_thread(boost::bind(&ThreadPool::workerLoop, this, i));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+    m_stopping = true;
+  }
+  m_changed.notify_all();
+  m_workers.join_all();
+}
+
+void ThreadPool::submit(Task* task) {
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+    assert(!m_stopping);
+    task->m_done = false;
+    if(isWorker()) m_local[*m_workerId].push_back(task);
+    else m_shared.push_back(task);
+  }
+  m_changed.notify_all();
+}
+
+void ThreadPool::wait(Task* task) {
+  boost::mutex::scoped_lock lock(m_mutex);
+  if(!isWorker()) {
+    while(!task->m_done) m_changed.wait(lock);
+    return;
+  }
+  /* The slot of this worker is used for running the other tasks. */
+  while(!task->m_done) {
+    Task *other = take(*m_workerId);
+    if(other) runTask(other, lock);
+    else m_changed.wait(lock);
+  }
+}
+
+size_t ThreadPool::tryBorrowSlots(size_t slots) {
+  boost::mutex::scoped_lock lock(m_mutex);
+  slots = std::min(slots, m_threads - m_busySlots);
+  m_busySlots += slots;
+  return slots;
+}
+
+void ThreadPool::borrowSlot() {
+  boost::mutex::scoped_lock lock(m_mutex);
+  while(m_busySlots >= m_threads) m_changed.wait(lock);
+  ++m_busySlots;
+}
+
+void ThreadPool::returnSlots(size_t slots) {
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+    assert(slots <= m_busySlots);
+    m_busySlots -= slots;
+  }
+  m_changed.notify_all();
+}
+
+Task* ThreadPool::take(size_t worker) {
+  Task *task = 0;
+  if(!m_local[worker].empty()) {
+    task = m_local[worker].back();
+    m_local[worker].pop_back();
+  } else if(!m_shared.empty()) {
+    task = m_shared.front();
+    m_shared.pop_front();
+  } else {
+    for(size_t i = 1; i < m_threads; ++i) {
+      std::deque<Task*>& victim = m_local[(worker + i) % m_threads];
+      if(!victim.empty()) {
+        task = victim.front();
+        victim.pop_front();
+        break;
+      }
+    }
+  }
+  return task;
+}
+
+bool ThreadPool::hasQueuedTasks() const {
+  if(!m_shared.empty()) return true;
+  for(size_t i = 0; i < m_threads; ++i) {
+    if(!m_local[i].empty()) return true;
+  }
+  return false;
+}
+
+void ThreadPool::runTask(Task* task, boost::mutex::scoped_lock& lock) {
+  lock.unlock();
+  task->run();
+  lock.lock();
+  task->m_done = true;
+  m_changed.notify_all();
+}
+
+void ThreadPool::workerLoop(size_t id) {
+  m_workerId.reset(new size_t(id));
+  boost::mutex::scoped_lock lock(m_mutex);
+  while(true) {
+    Task *task = (m_busySlots < m_threads) ? take(id) : 0;
+    if(task) {
+      ++m_busySlots;
+      runTask(task, lock);
+      --m_busySlots;
+      m_changed.notify_all();
+    } else if(m_stopping && !hasQueuedTasks()) {
+      return;
+    } else {
+      m_changed.wait(lock);
+    }
+  }
+}
+
+MemoryBudget::MemoryBudget(size_t bytes) : m_total(bytes), m_used(0) {}
+
+void MemoryBudget::acquire(size_t bytes, size_t held) {
+  boost::mutex::scoped_lock lock(m_mutex);
+  assert(held <= m_used);
+  while(m_used + bytes > m_total && m_used != held) m_released.wait(lock);
+  m_used += bytes;
+}
+
+void MemoryBudget::release(size_t bytes) {
+  {
+    boost::mutex::scoped_lock lock(m_mutex);
+    assert(bytes <= m_used);
+    m_used -= bytes;
+  }
+  m_released.notify_all();
+}
+
+} //namespace bwtc
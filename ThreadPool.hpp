@@ -0,0 +1,236 @@
+/**
+ * @file ThreadPool.hpp
+ * @author Pekka Mikkola <pmikkol@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This file is part of bwtc.
+ *
+ * bwtc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * bwtc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with bwtc.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Header for ThreadPool and Task. Thread pool is shared by all the parallel
+ * parts of compression and decompression, so that the number of threads
+ * running at the same time never exceeds the number given by the user.
+ * BoundedQueue passes items between threads and MemoryBudget keeps the
+ * memory reserved by threads within a given limit.
+ */
+
+#ifndef BWTC_THREAD_POOL_HPP_
+#define BWTC_THREAD_POOL_HPP_
+
+#include <cassert>
+#include <deque>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/tss.hpp>
+
+#include "globaldefs.hpp"
+
+namespace bwtc {
+
+/**
+ * Unit of work for ThreadPool. The task object is owned by the caller and
+ * it has to stay alive until ThreadPool::wait has returned for it.
+ */
+class Task {
+ public:
+  Task() : m_done(false) {}
+  virtual ~Task() {}
+  virtual void run() = 0;
+
+ private:
+  friend class ThreadPool;
+  bool m_done;
+
+  Task(const Task&);
+  Task& operator=(const Task&);
+};
+
+/** Task calling a member function of an object with the given argument. */
+template <typename Object, typename Argument>
+class MemberTask : public Task {
+ public:
+  MemberTask(Object* object, void (Object::*function)(Argument),
+             Argument argument)
+      : m_object(object), m_function(function), m_argument(argument) {}
+
+  void run() { (m_object->*m_function)(m_argument); }
+
+ private:
+  Object *m_object;
+  void (Object::*m_function)(Argument);
+  Argument m_argument;
+};
+
+/**
+ * Work-stealing thread pool. Each worker has a deque of its own: tasks
+ * submitted by a task go to the back of the deque of its worker and are run
+ * from there in LIFO order, while idle workers steal from the front of the
+ * other deques. Tasks submitted from the outside are shared in FIFO order.
+ *
+ * Worker waiting for a task runs other tasks meanwhile, so tasks can split
+ * their work into subtasks and wait for them. The number of threads running
+ * is limited by slots: running a task takes a slot from a worker, and
+ * threads outside the pool (for example OpenMP threads) can borrow slots
+ * for their work.
+ */
+class ThreadPool {
+ public:
+  explicit ThreadPool(size_t threads);
+  /** Waits until all of the submitted tasks have been run. */
+  ~ThreadPool();
+
+  size_t threads() const { return m_threads; }
+
+  void submit(Task* task);
+
+  /** Blocks until the given (submitted) task has been run. When called by
+   * a worker, runs other tasks while waiting. */
+  void wait(Task* task);
+
+  /** Borrows at most the given number of idle slots without blocking.
+   * @return Number of slots borrowed.
+   */
+  size_t tryBorrowSlots(size_t slots);
+
+  /** Blocks until a slot is free and borrows it. Tasks of the pool already
+   * have a slot of their own. */
+  void borrowSlot();
+
+  void returnSlots(size_t slots);
+
+  /** Tells if the calling thread is a worker of this pool. */
+  bool isWorker() const { return m_workerId.get() != 0; }
+
+ private:
+  void workerLoop(size_t id);
+  /** Takes a task from the deque of worker, or from the shared queue, or
+   * steals from the other workers. Mutex has to be locked. */
+  Task* take(size_t worker);
+  bool hasQueuedTasks() const;
+  void runTask(Task* task, boost::mutex::scoped_lock& lock);
+
+  size_t m_threads;
+  size_t m_busySlots;
+  bool m_stopping;
+  std::deque<Task*> m_shared;
+  std::vector<std::deque<Task*> > m_local;
+  boost::thread_specific_ptr<size_t> m_workerId;
+  boost::mutex m_mutex;
+  boost::condition_variable m_changed;
+  boost::thread_group m_workers;
+
+  ThreadPool(const ThreadPool&);
+  ThreadPool& operator=(const ThreadPool&);
+};
+
+/**
+ * Calls function of the object for parts 0, 1, ..., parts-1 as tasks in the
+ * pool and waits for them. If the caller is a task of the pool, it runs the
+ * first part itself. Without pool the parts are run in order.
+ */
+template <typename Object>
+void runInParts(ThreadPool* pool, Object* object,
+                void (Object::*function)(uint32), uint32 parts) {
+  if(!pool) {
+    for(uint32 i = 0; i < parts; ++i) (object->*function)(i);
+    return;
+  }
+  std::vector<MemberTask<Object, uint32>*> tasks;
+  uint32 first = pool->isWorker() ? 1 : 0;
+  for(uint32 i = first; i < parts; ++i) {
+    tasks.push_back(new MemberTask<Object, uint32>(object, function, i));
+    pool->submit(tasks.back());
+  }
+  if(first > 0) (object->*function)(0);
+  for(size_t i = 0; i < tasks.size(); ++i) {
+    pool->wait(tasks[i]);
+    delete tasks[i];
+  }
+}
+
+/**
+ * Queue for passing items from one thread to another. Pushing to a full
+ * queue blocks until the consumer has made room, which limits the amount
+ * of work (and memory) in flight.
+ */
+template <typename T>
+class BoundedQueue {
+ public:
+  explicit BoundedQueue(size_t capacity) : m_capacity(capacity) {
+    assert(capacity > 0);
+  }
+
+  void push(const T& item) {
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      while(m_items.size() >= m_capacity) m_notFull.wait(lock);
+      m_items.push_back(item);
+    }
+    m_notEmpty.notify_one();
+  }
+
+  T pop() {
+    boost::mutex::scoped_lock lock(m_mutex);
+    while(m_items.empty()) m_notEmpty.wait(lock);
+    T item = m_items.front();
+    m_items.pop_front();
+    lock.unlock();
+    m_notFull.notify_one();
+    return item;
+  }
+
+ private:
+  size_t m_capacity;
+  std::deque<T> m_items;
+  boost::mutex m_mutex;
+  boost::condition_variable m_notEmpty;
+  boost::condition_variable m_notFull;
+
+  BoundedQueue(const BoundedQueue&);
+  BoundedQueue& operator=(const BoundedQueue&);
+};
+
+/**
+ * Amount of memory shared by threads. Reservations block until there is
+ * enough memory left in the budget.
+ */
+class MemoryBudget {
+ public:
+  explicit MemoryBudget(size_t bytes);
+
+  /** Reserves bytes from the budget. Caller may already hold some of the
+   * budget; a reservation which doesn't fit into the budget at all is granted
+   * when the caller is the only holder, so that the work can proceed. */
+  void acquire(size_t bytes, size_t held = 0);
+  void release(size_t bytes);
+
+ private:
+  size_t m_total;
+  size_t m_used;
+  boost::mutex m_mutex;
+  boost::condition_variable m_released;
+
+  MemoryBudget(const MemoryBudget&);
+  MemoryBudget& operator=(const MemoryBudget&);
+};
+
+} //namespace bwtc
+
+#endif
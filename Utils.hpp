@@ -35,6 +35,7 @@
 #include <stack>
 #include <utility>
 #include <vector>
+#include "BitStreams.hpp"
 #include "Streams.hpp"
 
 using bwtc::uint64;
@@ -340,6 +341,28 @@ size_t binaryDecode(Input& input, size_t lo, size_t hi, size_t *bitsRead) {
   else return result + lo + shortCodewords;
 }
 
+/* BitReader takes all but the last bit of the codeword in one go. */
+inline size_t binaryDecode(bwtc::BitReader& input, size_t lo, size_t hi,
+                           size_t *bitsRead) {
+  size_t rangeLen = hi - lo + 1;
+  if(rangeLen == 1) return lo;
+  byte codeLength = logCeiling(rangeLen);
+  size_t shortCodewords = (1 << codeLength) - rangeLen;
+  size_t longCodewords2 = (rangeLen - shortCodewords)/2;
+  size_t result = input.readBits(codeLength - 1);
+  *bitsRead += codeLength - 1;
+  if(result >= longCodewords2) return result + lo;
+  result = (result << 1) | (input.readBit() ? 1 : 0);
+  ++*bitsRead;
+  if (result < longCodewords2) return result + lo;
+  else return result + lo + shortCodewords;
+}
+
+inline size_t binaryDecode(bwtc::BitReader& input, size_t lo, size_t hi) {
+  size_t bitsRead = 0;
+  return binaryDecode(input, lo, hi, &bitsRead);
+}
+
 template <typename Integer, typename Input>
 size_t binaryInterpolativeDecode(std::vector<Integer>& list, Input& input,
                                  size_t lo, size_t hi, size_t elements)
@@ -415,6 +438,10 @@ inline size_t unaryDecode(Input& in) {
   return n;
 }
 
+inline size_t unaryDecode(bwtc::BitReader& in) {
+  return in.readUnary();
+}
+
 template <typename Integer>
 void printBitRepresentation(Integer word) {
   std::stack<Integer> bits;
@@ -436,124 +463,58 @@ void printBitRepresentation(Integer word) {
   std::cout << "\n";
 } 
 
+/**Writes Elias gamma codes of (ints[k] + offset) and pads the last byte
+ * with zeros.
+ *
+ * @return Bytes written.
+ */
 template<typename Integer>
 inline size_t gammaEncode(std::vector<Integer>& ints, bwtc::OutStream* out,int offset=0) {
-    size_t bytes_used=0;
     out->flush();
-
-    bwtc::uint64 buffer = 0;
-    bwtc::int32 bitsInBuffer = 0;
-    for (bwtc::uint64 k = 0; k < ints.size(); ++k) {
-        bwtc::uint64 num=ints[k]+offset;
-        int gammaCodeLen = utils::logFloor(num) * 2 + 1;
-        while (bitsInBuffer + gammaCodeLen > 64) {
-            bitsInBuffer -= 8;
-            out->writeByte((buffer >> bitsInBuffer) & 0xff);
-            bytes_used++;
-        }
-        buffer <<= gammaCodeLen;
-        buffer |= num;
-        bitsInBuffer += gammaCodeLen;
-    }
-    while (bitsInBuffer >= 8) {
-        bitsInBuffer -= 8;
-        out->writeByte((buffer >> bitsInBuffer) & 0xff);
-        ++bytes_used;
-    }
-    if (bitsInBuffer > 0) {
-        buffer <<= (8 - bitsInBuffer);
-        out->writeByte(buffer & 0xff);
-        ++bytes_used;
-    }
+    bwtc::BitWriter writer(out);
+    for (bwtc::uint64 k = 0; k < ints.size(); ++k)
+        writer.writeGamma(ints[k]+offset);
+    size_t bytes_used = writer.flush();
     out->flush();
     return bytes_used;
 }
 template<typename Integer>
 inline void gammaDecode(std::vector<Integer>& ints, bwtc::InStream* in, int offset=0) {
-        for (bwtc::uint64 k = 0; k < ints.size(); ++k) {
-
-            int zeros = 0;
-
-            while (!in->readBit())
-                ++zeros;
-            bwtc::uint64 value = 0;        
-            for (bwtc::int32 t = 0; t < zeros; ++t) {
-                bwtc::int32 bit = in->readBit();
-                value = (value << 1) | bit;
-            }
-            value |= (1 << zeros);
-            ints[k] = (Integer)(value-offset);
-        }
-        in->flushBuffer();
+    bwtc::BitReader reader(in);
+    for (bwtc::uint64 k = 0; k < ints.size(); ++k)
+        ints[k] = (Integer)(reader.readGamma()-offset);
+    reader.flushBuffer();
 }
+/**Writes Elias delta codes of (ints[k] + offset): gamma code of the length
+ * of the integer followed by the integer without its highest bit.
+ *
+ * @return Bytes written.
+ */
 template<typename Integer>
 inline size_t deltaEncode(std::vector<Integer>& ints, bwtc::OutStream* out, int offset=0) {
-    size_t bytes_used=0;
     out->flush();
-
-    bwtc::uint64 buffer = 0;
-    bwtc::int32 bitsInBuffer = 0;
+    bwtc::BitWriter writer(out);
     for (bwtc::uint64 k = 0; k < ints.size(); ++k) {
         bwtc::uint64 n=ints[k]+offset;
-        int codelength = logFloor(n)+2*logFloor(logFloor(n)+1UL)+1;
-        uint64 len = logFloor(n)+1;
-        uint64 lenoflen = logFloor(len);
-
-        while (bitsInBuffer + codelength > 64) {
-            bitsInBuffer -= 8;
-
-            out->writeByte((buffer >> bitsInBuffer) & 0xff);
-            bytes_used++;
-        }
-        buffer <<= 2*lenoflen+1;
-        buffer |= len;
-        buffer <<=len-1;
-        buffer |= ((~(1<<(len-1))) & n);
-        bitsInBuffer += codelength;
-
-    }
-    while (bitsInBuffer >= 8) {
-        bitsInBuffer -= 8;
-        out->writeByte((buffer >> bitsInBuffer) & 0xff);
-        ++bytes_used;
-    }
-    if (bitsInBuffer > 0) {
-        buffer <<= (8 - bitsInBuffer);
-        out->writeByte(buffer & 0xff);
-        ++bytes_used;
+        bwtc::uint32 len = logFloor(n)+1;
+        writer.writeGamma(len);
+        writer.writeBits(n, len-1);
     }
+    size_t bytes_used = writer.flush();
     out->flush();
     return bytes_used;
 }
 template<typename Integer>
 inline void deltaDecode(std::vector<Integer>& ints, bwtc::InStream* in, int offset=0) {
-        for (bwtc::uint64 k = 0; k < ints.size(); ++k) {
-
-            int zeros = 0;
-
-            while (!in->readBit())
-                ++zeros;
-            bwtc::uint64 value = 0;        
-            for (bwtc::int32 t = 0; t < zeros; ++t) {
-                bwtc::int32 bit = in->readBit();
-                value = (value << 1) | bit;
-            }
-            value |= (1 << zeros);
-            //gamma code: value
-            
-            // read value-1 bits
-            
-            bwtc::uint64 val2=1;
-            for(bwtc::int32 t=0;t<value-1;t++) {
-                bwtc::int32 bit = in->readBit();
-                val2=(val2<<1)|bit;
-                
-            }
-            ints[k]=(Integer)(val2-offset);
-        }
+    bwtc::BitReader reader(in);
+    for (bwtc::uint64 k = 0; k < ints.size(); ++k) {
+        bwtc::uint32 len = reader.readGamma();
+        bwtc::uint64 value = reader.readBits(len-1) | (bwtc::uint64(1) << (len-1));
+        ints[k]=(Integer)(value-offset);
+    }
+    reader.flushBuffer();
 }
 
-
 } //namespace utils
 
 #endif
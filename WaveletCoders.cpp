@@ -26,12 +26,14 @@
 
 #include <cassert>
 
+#include <algorithm> // for std::fill
 #include <iterator>
 #include <iostream> // For std::streampos
 #include <numeric> // for std::accumulate
 #include <string>
 #include <vector>
 
+#include "BitStreams.hpp"
 #include "WaveletCoders.hpp"
 #include "globaldefs.hpp"
 #include "Utils.hpp"
@@ -76,12 +78,15 @@ void WaveletDecoder::endContextBlock() {
 
 size_t WaveletEncoder::
 transformAndEncode(BWTBlock& block, BWTManager& bwtm, OutStream* out) {
-  std::vector<uint32> characterFrequencies(256, 0);
-  bwtm.doTransform(block, &characterFrequencies[0]);
+  BWTStatistics bwtStats;
+  bwtm.doTransform(block, bwtStats);
+  /* Contexts of the first column of the transformed block. */
+  std::vector<uint32> contextLengths;
+  bwtStats.contextLengths(contextLengths);
 
   m_destination.connect(out);
-  writeBlockHeader(block, characterFrequencies, out);
-  encodeData(block.begin(), characterFrequencies, out);
+  writeBlockHeader(block, contextLengths, out);
+  encodeData(block.begin(), contextLengths, out);
   finishBlock(out);
   return m_compressedBlockLength + 6; //Also bytes for the compressedSize
 }
@@ -244,8 +249,14 @@ WaveletDecoder::readBlockHeader(BWTBlock& block, std::vector<uint64>* stats,
 }
 
 void WaveletDecoder::decodeBlock(BWTBlock& block, InStream* in) {
+  decodeBlock(block, in, 0);
+}
+
+bool WaveletDecoder::
+decodeBlock(BWTBlock& block, InStream* in, uint64 *frequencies) {
   PROFILE("WaveletDecoder::decodeBlock");
-  if(in->compressedDataEnding()) return;
+  if(in->compressedDataEnding()) return false;
+  if(frequencies) std::fill(frequencies, frequencies + 256, 0);
 
   std::vector<uint64> context_lengths;
   uint64 compr_len = readBlockHeader(block, &context_lengths, in);
@@ -268,9 +279,9 @@ void WaveletDecoder::decodeBlock(BWTBlock& block, InStream* in) {
 
     WaveletTree<std::vector<bool> > wavelet;
 
-    size_t bits = wavelet.readShape(*in);
-
-    in->flushBuffer();
+    BitReader reader(in);
+    size_t bits = wavelet.readShape(reader);
+    reader.flushBuffer();
     m_source.start();
     wavelet.decodeTreeBF(rootSize, m_source, *m_probModel, *m_integerProbModel,
                          *m_gapProbModel);
@@ -282,12 +293,13 @@ void WaveletDecoder::decodeBlock(BWTBlock& block, InStream* in) {
                 << " bits in total\n";
     }
 
-    size_t clen = wavelet.message(block.begin() + len);
+    size_t clen = wavelet.message(block.begin() + len, frequencies);
     len += clen;
     endContextBlock();
   }
   block.setSize(len);
   assert(len == blockSize);
+  return frequencies != 0;
 }
 
 uint64 WaveletDecoder::readPackedInteger(InStream* in) {
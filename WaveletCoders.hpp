@@ -81,6 +81,8 @@ class WaveletDecoder : public EntropyDecoder {
   uint64 readPackedInteger(InStream *in);
   /* Reads and decodes block from stream to block given as a parameter. */
   void decodeBlock(BWTBlock& block, InStream* in);
+  /* Frequencies are counted from the runs of the wavelet trees. */
+  bool decodeBlock(BWTBlock& block, InStream* in, uint64 *frequencies);
   /* Returns length of the compressed sequence and stores lengths of the context
    * blocks into stats-array.*/
   uint64 readBlockHeader(BWTBlock& block, std::vector<uint64>* stats, InStream* in);
@@ -136,8 +136,10 @@ class WaveletTree {
   size_t bitsInRoot() const { return m_root->m_bitVector.size(); }
   size_t totalBits() const { return m_root->totalBits(); }
 
+  /**Writes the message of the tree. If frequencies is given, the number of
+   * occurrences of each symbol is added to it. */
   template <typename OutputIterator>
-  size_t message(OutputIterator out) const;
+  size_t message(OutputIterator out, uint64 *frequencies = 0) const;
 
   /** Push the runs of the string into tree */
   void pushMessage(const byte* src, size_t length);
@@ -1275,7 +1277,8 @@ void WaveletTree<BitVector>::pushRun(byte symbol, size_t runLength)
 }
 
 template <typename BitVector> template <typename OutputIterator>
-size_t WaveletTree<BitVector>::message(OutputIterator out) const {
+size_t WaveletTree<BitVector>::
+message(OutputIterator out, uint64 *frequencies) const {
   size_t len = 0;
   size_t msgSize = m_root->m_bitVector.size();
   std::map<TreeNode<BitVector>*, size_t> bitsSeen;
@@ -1372,6 +1375,7 @@ size_t WaveletTree<BitVector>::message(OutputIterator out) const {
     for(size_t k = 0; k < runLength; ++k) {
       *out++ = symbol;
     }
+    if(frequencies) frequencies[symbol] += runLength;
     len += runLength;
   }
   return len;
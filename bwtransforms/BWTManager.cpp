@@ -24,37 +24,272 @@
  * Implementation of BWT-manager.
  */
 
+#include <time.h>
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
 #include "../globaldefs.hpp"
 #include "BWTManager.hpp"
 #include "BWTransform.hpp"
 #include "SA-IS-bwt.hpp"
 #include "Divsufsorter.hpp"
+#include "MergingBWT.hpp"
+#include "ParallelBWT.hpp"
 
 namespace bwtc {
 
-BWTManager::BWTManager() : m_startingPoints(1) {}
+namespace {
+
+/* Blocks shorter than this are always given to divsufsort. */
+const uint32 kMinProfiledLength = 1 << 18;
+/* Length of the repeats looked for and the minimum distance between the
+ * occurrences of a repeat; closer repeats are runs or short periods, which
+ * divsufsort handles well. */
+const uint32 kRepeatLength = 32;
+const uint32 kMinRepeatDistance = 4096;
+/* Approximately one position out of 2^kSamplingShift is sampled, based on
+ * the hash of the text at the position, so that repeated text gets sampled
+ * at the same places in every occurrence. */
+const uint32 kSamplingShift = 10;
+const uint32 kMinSamples = 64;
+/* Running time of the other algorithm is measured after this many blocks
+ * of the class, and it is used if it is clearly faster. */
+const uint64 kProbeAfterBlocks = 3;
+const double kSwitchFactor = 0.9;
+
+double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/** Open addressing hash table from the hashes of the sampled positions to
+ * their latest positions. */
+class SampleTable {
+ public:
+  explicit SampleTable(uint32 capacity) : m_size(0) {
+    uint32 slots = 1024;
+    while(slots < 2*capacity) slots <<= 1;
+    m_hashes.resize(slots, 0);
+    m_positions.resize(slots, 0);
+  }
+
+  /** Stores the position for the hash, and returns the previous position
+   * stored, or length if there was none. */
+  uint32 update(uint64 hash, uint32 position, uint32 length) {
+    if(hash == 0) hash = 1; // 0 marks an empty slot
+    size_t mask = m_hashes.size() - 1;
+    size_t i = (hash ^ (hash >> 29)) & mask;
+    while(m_hashes[i] != 0 && m_hashes[i] != hash) i = (i + 1) & mask;
+    if(m_hashes[i] == hash) {
+      uint32 previous = m_positions[i];
+      m_positions[i] = position;
+      return previous;
+    }
+    /* Full table is left as it is, which only lowers the estimate. */
+    if(2*(m_size + 1) <= m_hashes.size()) {
+      m_hashes[i] = hash;
+      m_positions[i] = position;
+      ++m_size;
+    }
+    return length;
+  }
+
+ private:
+  std::vector<uint64> m_hashes;
+  std::vector<uint32> m_positions;
+  size_t m_size;
+};
+
+} //anonymous namespace
+
+BWTManager::BWTManager()
+    : m_largeTransformer(0), m_startingPoints(1), m_automatic(false),
+      m_memoryBudget(0) {}
 
 BWTManager::BWTManager(uint32 startingPoints)
-    : m_startingPoints(startingPoints) {}
+    : m_largeTransformer(0), m_startingPoints(startingPoints),
+      m_automatic(false), m_memoryBudget(0) {}
 
 BWTManager::~BWTManager() {
   for(size_t i = 0; i < m_transformers.size(); ++i) {
     delete m_transformers[i];
   }
+  delete m_largeTransformer;
 }
 
 void BWTManager::doTransform(BWTBlock& block) {
-  assert(!block.isTransformed());
+  /* Compression pipeline may have transformed the block already. */
+  if(block.isTransformed()) return;
   block.prepareLFpowers(m_startingPoints);
-  //Something more sophisticated here if choosing algorithm automatically:
-  m_transformers[0]->doTransform(block);
+  transform(block, block.begin(), 0);
 }
 
-void BWTManager::doTransform(BWTBlock& block, uint32 *freqs) {
+void BWTManager::doTransform(BWTBlock& block, BWTStatistics& stats) {
+  if(block.isTransformed()) {
+    stats.add(block.statistics());
+    return;
+  }
+  block.prepareLFpowers(m_startingPoints);
+  transform(block, block.begin(), &stats);
+}
+
+void BWTManager::
+doTransform(BWTBlock& block, byte *output, BWTStatistics& stats) {
   assert(!block.isTransformed());
   block.prepareLFpowers(m_startingPoints);
-  //Something more sophisticated here if choosing algorithm automatically:
-  m_transformers[0]->doTransform(block, freqs);
+  transform(block, output, &stats);
+}
+
+void BWTManager::
+transform(BWTBlock& block, byte *output, BWTStatistics *stats) {
+  if(!m_transformers[0]->canTransform(block.size())) {
+    /* Only divsufsort and the parallel transforms have a large transformer,
+     * and the blocks given to the others are limited by the compressor. */
+    if(!canTransform(block.size())) {
+      fprintf(stderr, "Block of %llu bytes is too large for the chosen "
+              "BWT-algorithm.\n",
+              static_cast<unsigned long long>(block.size()));
+      exit(1);
+    }
+    m_largeTransformer->doTransform(block, output, stats);
+    return;
+  }
+  if(!m_automatic || block.size() < kMinProfiledLength) {
+    m_transformers[0]->doTransform(block, output, stats);
+    return;
+  }
+  BlockProfile p = profile(block.begin(), block.size());
+  BlockClass blockClass = (p.repetitiveness >= 0.5 && p.runDensity < 0.5) ?
+      kRepetitive : kTypical;
+  uint32 length = block.size();
+  size_t chosen = chooseTransformer(blockClass);
+  if(!isUsable(chosen, length)) chosen = kDivsufsort;
+
+  double start = now();
+  m_transformers[chosen]->doTransform(block, output, stats);
+  double seconds = now() - start;
+  recordTiming(blockClass, chosen, length, seconds);
+
+  if(verbosity > 1) {
+    std::clog << "Block of " << length << " bytes (alphabet "
+              << p.alphabetSize << ", runs " << p.runDensity << ", repeats "
+              << p.repetitiveness << ") transformed with "
+              << (chosen == kSais ? "sais" : "divsufsort") << " in "
+              << seconds << " s.\n";
+  }
+}
+
+size_t BWTManager::chooseTransformer(BlockClass blockClass) {
+  size_t preferred = (blockClass == kRepetitive) ? kSais : kDivsufsort;
+  size_t other = 1 - preferred;
+  boost::mutex::scoped_lock lock(m_mutex);
+  const Timings& p = m_timings[blockClass][preferred];
+  const Timings& o = m_timings[blockClass][other];
+  if(o.blocks == 0) {
+    /* The other one is tried once to check the choice. */
+    return (p.blocks == kProbeAfterBlocks) ? other : preferred;
+  }
+  if(p.blocks == 0) return preferred;
+  double preferredSpeed = p.seconds / p.bytes;
+  double otherSpeed = o.seconds / o.bytes;
+  return (otherSpeed < kSwitchFactor * preferredSpeed) ? other : preferred;
+}
+
+bool BWTManager::isUsable(size_t transformer, uint64 length) const {
+  if(transformer == 0) return true;
+  if(!m_automatic || length < kMinProfiledLength) return false;
+  return m_memoryBudget == 0 ||
+      m_transformers[transformer]->maxSizeInBytes(length) <= m_memoryBudget;
+}
+
+bool BWTManager::canTransform(uint64 block_size) const {
+  return m_transformers[0]->canTransform(block_size) ||
+      (m_largeTransformer && m_largeTransformer->canTransform(block_size));
+}
+
+void BWTManager::setMemoryBudget(uint64 bytes) {
+  m_memoryBudget = bytes;
+}
+
+uint64 BWTManager::maxSizeInBytes(uint64 block_size) const {
+  if(m_largeTransformer && !m_transformers[0]->canTransform(block_size)) {
+    return m_largeTransformer->maxSizeInBytes(block_size);
+  }
+  uint64 result = 0;
+  for(size_t i = 0; i < m_transformers.size(); ++i) {
+    if(isUsable(i, block_size)) {
+      result = std::max(result, m_transformers[i]->maxSizeInBytes(block_size));
+    }
+  }
+  return result;
+}
+
+uint64 BWTManager::suggestedBlockSize(uint64 memory_budget) const {
+  uint64 result = 0;
+  for(size_t i = 0; i < m_transformers.size(); ++i) {
+    result = std::max(result,
+                      m_transformers[i]->suggestedBlockSize(memory_budget));
+  }
+  /* The large transformer takes only the blocks the others can't. */
+  if(m_largeTransformer) {
+    uint64 large = m_largeTransformer->suggestedBlockSize(memory_budget);
+    if(!m_transformers[0]->canTransform(large))
+      result = std::max(result, large);
+  }
+  return result;
+}
+
+void BWTManager::recordTiming(BlockClass blockClass, size_t transformer,
+                              uint32 length, double seconds) {
+  boost::mutex::scoped_lock lock(m_mutex);
+  Timings& t = m_timings[blockClass][transformer];
+  ++t.blocks;
+  t.bytes += length;
+  t.seconds += seconds;
+}
+
+BlockProfile BWTManager::profile(const byte* data, uint32 length) {
+  BlockProfile result;
+  if(length == 0) return result;
+  uint32 freqs[256] = {0};
+  uint32 runs = 0;
+  ++freqs[data[0]];
+  for(uint32 i = 1; i < length; ++i) {
+    ++freqs[data[i]];
+    if(data[i] == data[i-1]) ++runs;
+  }
+  for(size_t i = 0; i < 256; ++i) {
+    if(freqs[i] > 0) ++result.alphabetSize;
+  }
+  result.runDensity = static_cast<double>(runs) / length;
+  if(length < 2*kRepeatLength) return result;
+
+  /* Polynomial rolling hash of the kRepeatLength bytes ending at i. */
+  const uint64 kBase = 0x100000001b3ULL;
+  uint64 outFactor = 1;
+  for(uint32 i = 0; i < kRepeatLength; ++i) outFactor *= kBase;
+  SampleTable table(length >> kSamplingShift);
+  uint64 hash = 0;
+  uint32 samples = 0, repeats = 0;
+  for(uint32 i = 0; i < length; ++i) {
+    hash = hash * kBase + data[i] + 1;
+    if(i < kRepeatLength) continue;
+    hash -= outFactor * (data[i - kRepeatLength] + 1);
+    if((hash >> (64 - kSamplingShift)) != 0) continue;
+    ++samples;
+    uint32 previous = table.update(hash, i, length);
+    if(previous < length && i - previous >= kMinRepeatDistance) ++repeats;
+  }
+  if(samples >= kMinSamples)
+    result.repetitiveness = static_cast<double>(repeats) / samples;
+  return result;
 }
 
 void BWTManager::setStartingPoints(uint32 startingPoints) {
@@ -67,15 +302,30 @@ uint32 BWTManager::getStartingPoints() const {
   return m_startingPoints;
 }
 
+void BWTManager::setThreadPool(ThreadPool* pool) {
+  for(size_t i = 0; i < m_transformers.size(); ++i) {
+    m_transformers[i]->setThreadPool(pool);
+  }
+  if(m_largeTransformer) m_largeTransformer->setThreadPool(pool);
+}
+
 bool BWTManager::isValidChoice(char c) {
-  return c == 'd' || c == 's' || c == 'a';
+  return c == 'd' || c == 's' || c == 'p' || c == 'm' ||
+      c == 'a';
 }
 
 void BWTManager::initialize(char choice) {
+  m_automatic = (choice == 'a');
   if(choice == 's') {
     m_transformers.push_back(new SAISBWTransform());
   } else {
-    m_transformers.push_back(new Divsufsorter());
+    /* With the automatic choice kDivsufsort is followed by kSais. */
+    if(choice == 'p') m_transformers.push_back(new ParallelBWTransform());
+    else if(choice == 'm') m_transformers.push_back(new MergingBWTransform());
+    else m_transformers.push_back(new Divsufsorter());
+    if(m_automatic) m_transformers.push_back(new SAISBWTransform());
+    /* Blocks too large for 32-bit suffix arrays are given to SA-IS. */
+    m_largeTransformer = new SAISBWTransform();
   }
 }
 
@@ -22,9 +22,25 @@
  * @section DESCRIPTION
  *
  * Header for BWT-manager. The choice of BWT-algorithm is done in this
- * class. In future, if needed, the choice of the algorithm can be done in
- * fly based on the running times.
+ * class.
  *
+ * With the automatic choice ('a') the algorithm is chosen separately for
+ * each block. A quick pass over the block (see BWTManager::profile) tells
+ * whether most of the block consists of long repeats of text seen far
+ * before. Such blocks are the bad cases of divsufsort, and they are given
+ * to SA-IS, which takes linear time regardless of the input; other blocks
+ * are given to divsufsort, which is faster on typical data. Running times
+ * of the blocks are recorded, and if the other algorithm turns out to be
+ * faster for one class of blocks, it is used for that class instead.
+ * SA-IS may need more memory than divsufsort in the worst case, so it is
+ * used only for blocks for which that fits in the memory budget.
+ *
+ * Blocks larger than 2^31 - 2 bytes don't fit in the 32-bit suffix arrays
+ * of divsufsort, so they are always transformed with SA-IS using 64-bit
+ * suffix array.
+ *
+ * The parallel transforms ('p' and 'm') aren't chosen automatically, since
+ * they pay off only when there are more threads than blocks to transform.
  */
 
 #ifndef BWTC_BWTMANAGER_HPP_
@@ -36,25 +52,95 @@
 
 #include <vector>
 
+#include <boost/thread/mutex.hpp>
+
 namespace bwtc {
 
+/** Features of a block used for choosing the BWT-algorithm. */
+struct BlockProfile {
+  BlockProfile() : alphabetSize(0), runDensity(0.0), repetitiveness(0.0) {}
+
+  uint32 alphabetSize;
+  /** Fraction of the symbols equal to the preceding symbol. */
+  double runDensity;
+  /** Estimated fraction of the block covered by long repeats of text seen
+   * far before (excluding runs and other short periods). */
+  double repetitiveness;
+};
+
 class BWTManager {
  public:
   BWTManager();
   BWTManager(uint32 startingPoints);
   ~BWTManager();
 
+  /**Blocks which are already transformed are left as they are. For such
+   * blocks the statistics gathered during the transform are added to stats.
+   */
   void doTransform(BWTBlock& block);
-  void doTransform(BWTBlock& block, uint32 *freqs);
+  void doTransform(BWTBlock& block, BWTStatistics& stats);
+  /**Writes the transformed block to output, which has room for
+   * block.size() + 1 bytes, and leaves the block as it is. The block gets
+   * the starting points, but it is not marked as transformed. */
+  void doTransform(BWTBlock& block, byte *output, BWTStatistics& stats);
   void initialize(char choice);
+  /**Pool is used for sorting suffixes, if the chosen algorithm can. */
+  void setThreadPool(ThreadPool* pool);
   void setStartingPoints(uint32 startingPoints);
   uint32 getStartingPoints() const;
 
   static bool isValidChoice(char c);
-  
+
+  /**Tells whether a block of block_size bytes can be transformed with the
+   * chosen algorithm. Transforming a larger block is a fatal error. */
+  bool canTransform(uint64 block_size) const;
+
+  /**Memory available for transforming one block, the block included. With
+   * the automatic choice an algorithm is used for a block only if its worst
+   * case fits in the budget. Zero means that there is no limit. */
+  void setMemoryBudget(uint64 bytes);
+  /**Worst case memory of transforming a block of block_size bytes with any
+   * of the algorithms that may be chosen for it. */
+  uint64 maxSizeInBytes(uint64 block_size) const;
+  /**Largest of the block sizes suggested by the algorithms. */
+  uint64 suggestedBlockSize(uint64 memory_budget) const;
+
+  /** Computes the profile of a block in a single pass over it. */
+  static BlockProfile profile(const byte* data, uint32 length);
+
  private:
+  /** Blocks are classified for the automatic choice. */
+  enum BlockClass { kTypical = 0, kRepetitive = 1, kClasses = 2 };
+  /** Indices of m_transformers with the automatic choice. */
+  enum { kDivsufsort = 0, kSais = 1 };
+
+  struct Timings {
+    Timings() : blocks(0), bytes(0), seconds(0.0) {}
+    uint64 blocks;
+    uint64 bytes;
+    double seconds;
+  };
+
+  void transform(BWTBlock& block, byte *output, BWTStatistics *stats);
+  /** Chooses the transformer for a block of the given class. */
+  size_t chooseTransformer(BlockClass blockClass);
+  /** Tells whether the transformer may be chosen for a block of length. */
+  bool isUsable(size_t transformer, uint64 length) const;
+  void recordTiming(BlockClass blockClass, size_t transformer, uint32 length,
+                    double seconds);
+
   std::vector<BWTransform*> m_transformers;
+  /* Transformer for the blocks m_transformers[0] can't handle. */
+  BWTransform *m_largeTransformer;
   uint32 m_startingPoints;
+  bool m_automatic;
+  uint64 m_memoryBudget;
+  /* Blocks are transformed concurrently, so the timings are guarded. */
+  Timings m_timings[kClasses][2];
+  boost::mutex m_mutex;
+
+  BWTManager(const BWTManager&);
+  BWTManager& operator=(const BWTManager&);
 };
 
 }  //namespace bwtc
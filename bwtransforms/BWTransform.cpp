@@ -33,38 +33,94 @@
 #include "BWTransform.hpp"
 #include "SA-IS-bwt.hpp"
 #include "Divsufsorter.hpp"
+#include "MergingBWT.hpp"
+#include "ParallelBWT.hpp"
 
 namespace bwtc {
 
-void BWTransform::doTransform(BWTBlock& block) {
-  std::reverse(block.begin(), block.end());
-  byte next = *block.end();
-  *block.end() = 0;
+namespace {
+
+/* Changes in the runs of a sequence when symbol c is inserted between prev
+ * and next, or removed from between them. Missing neighbours are -1. */
+void insertRun(int prev, int c, int next, uint32 *runs) {
+  if(c == prev || c == next) return;
+  ++runs[c];
+  if(prev >= 0 && prev == next) ++runs[prev];
+}
+
+void removeRun(int prev, int c, int next, uint32 *runs) {
+  if(c == prev || c == next) return;
+  --runs[c];
+  if(prev >= 0 && prev == next) --runs[prev];
+}
+
+/* Runs were counted over U[0..length) with the placeholder at the primary
+ * row. The block gets U[length-1] in place of the placeholder instead. */
+void movePrimaryRuns(const byte *U, uint64 length, uint64 primary,
+                     uint32 *runs) {
+  int last = U[length - 1];
+  int beforeLast = (length > 1) ? U[length - 2] : -1;
+  removeRun(beforeLast, last, -1, runs);
+  if(primary == length - 1) return;
+  int prev = (primary > 0) ? U[primary - 1] : -1;
+  int next = (primary + 2 < length) ? U[primary + 1] : -1;
+  removeRun(prev, U[primary], next, runs);
+  insertRun(prev, last, next, runs);
+}
+
+} //anonymous namespace
 
-  doTransform(block.begin(), block.size() + 1, block.LFpowers());
-  block.setTransformed(true);
+const uint64 BWTransform::kMaxBlockSize = 0x7fffffff - 2;
+const uint64 BWTransform::kMaxLargeBlockSize =
+    (static_cast<uint64>(1) << 48) - 2;
 
-  *(block.begin() + block.LFpowers()[0]) = *block.end();
-  
-  *block.end() = next;
+void BWTransform::
+doTransformReversed(const byte *text, uint64 length, byte *output,
+                    std::vector<uint64>& LF, BWTStatistics *stats) const {
+  if(text == output) std::reverse(output, output + length - 1);
+  else std::reverse_copy(text, text + length - 1, output);
+  output[length - 1] = 0;
+  if(stats) doTransform(output, length, LF, stats);
+  else doTransform(output, length, LF);
 }
 
-void BWTransform::doTransform(BWTBlock& block, uint32 freqs[256]) {
-  std::reverse(block.begin(), block.end());
-  byte next = *block.end();
-  *block.end() = 0;
+void BWTransform::doTransform(BWTBlock& block) {
+  doTransform(block, block.begin(), 0);
+}
+
+void BWTransform::doTransform(BWTBlock& block, BWTStatistics& stats) {
+  doTransform(block, block.begin(), &stats);
+}
 
-  doTransform(block.begin(), block.size() + 1, block.LFpowers(), freqs);
-  block.setTransformed(true);
+/* In place the sentinel position after the block belongs to the output, so
+ * the byte there is restored afterwards. */
+void BWTransform::
+doTransform(BWTBlock& block, byte *output, BWTStatistics *stats) {
+  bool inPlace = (output == block.begin());
+  byte next = inPlace ? *block.end() : 0;
+  uint64 length = block.size() + 1;
 
-  *(block.begin() + block.LFpowers()[0]) = *block.end();
+  doTransformReversed(block.begin(), length, output, block.LFpowers(), stats);
 
-  
-  *block.end() = next;
+  uint64 primary = block.LFpowers()[0];
+  if(stats) movePrimaryRuns(output, length, primary, stats->runs);
+  output[primary] = output[length - 1];
+
+  if(inPlace) {
+    *block.end() = next;
+    block.setTransformed(true);
+  }
 }
 
 BWTransform* giveTransformer(char transform) {
-  (void) transform;
+  if(transform == 'p') {
+    if(verbosity > 1) std::clog << "Using parallel prefix doubling for BWT.\n";
+    return new ParallelBWTransform();
+  }
+  if(transform == 'm') {
+    if(verbosity > 1) std::clog << "Using merged sub-blocks for BWT.\n";
+    return new MergingBWTransform();
+  }
   if(transform != 's') {
     if(verbosity > 1) std::clog << "Using divsufsort for calculating BWT.\n";
     return new Divsufsorter();
@@ -34,6 +34,7 @@
 
 #include "../BWTBlock.hpp"
 #include "../globaldefs.hpp"
+#include "../ThreadPool.hpp"
 
 namespace bwtc {
 
@@ -47,23 +48,67 @@ namespace bwtc {
  */
 class BWTransform {
  public:
-  BWTransform() {}
+  BWTransform() : m_pool(0) {}
   virtual ~BWTransform() {}
+
+  /**Transforms able to work in parallel use the slots of the pool. */
+  void setThreadPool(ThreadPool* pool) { m_pool = pool; }
   
   virtual
-  void doTransform(byte *begin, uint32 length, std::vector<uint32>& LF) const = 0;
+  void doTransform(byte *begin, uint64 length, std::vector<uint64>& LF) const = 0;
 
+  /**Adds the frequencies of begin[0..length-1) and the runs of the output
+   * as written, with whatever symbol is in place of the primary row, to
+   * stats. */
   virtual
-  void doTransform(byte *begin, uint32 length, std::vector<uint32>& LF,
-                   uint32 freqs[256]) const = 0;
+  void doTransform(byte *begin, uint64 length, std::vector<uint64>& LF,
+                   BWTStatistics* stats) const = 0;
+
+  /**Tells whether the algorithm can transform a block of block_size bytes.
+   * By default the suffix array has 32-bit indices. */
+  virtual bool canTransform(uint64 block_size) const {
+    return block_size <= kMaxBlockSize;
+  }
+
+  /**Transforms the reverse of text[0..length-1) followed by 0 as the
+   * doTransform above and writes the result to output[0..length). Text
+   * and output may be the same, otherwise the text is left as it is.
+   * By default the reverse is written to the output and transformed
+   * there. */
+  virtual
+  void doTransformReversed(const byte *text, uint64 length, byte *output,
+                           std::vector<uint64>& LF,
+                           BWTStatistics* stats) const;
 
   void doTransform(BWTBlock& block);
-  void doTransform(BWTBlock& block, uint32 freqs[256]);
+  /**Adds the statistics of the transformed block to stats. */
+  void doTransform(BWTBlock& block, BWTStatistics& stats);
+  /**Writes the transformed block to output, which has room for
+   * block.size() + 1 bytes. The block is not modified, but it gets the
+   * starting points. If output is the beginning of the block, the block is
+   * transformed in place. Statistics are added to stats, if given. */
+  void doTransform(BWTBlock& block, byte *output, BWTStatistics* stats);
 
+  /**Peak memory in bytes used for transforming a block of block_size
+   * bytes in the worst case. The block itself and its sentinel byte are
+   * included. */
   virtual uint64 maxSizeInBytes(uint64 block_size) const = 0;
+  /**Largest block which can be transformed within memory_budget bytes, ie.
+   * the inverse of maxSizeInBytes. */
   virtual uint64 maxBlockSize(uint64 memory_budget) const = 0;
+  /**Size of the blocks to use with memory_budget bytes. This is
+   * maxBlockSize limited by the largest block the algorithm can handle. */
   virtual uint64 suggestedBlockSize(uint64 memory_budget) const = 0;
 
+ protected:
+  /**Largest block the transforms with 32-bit suffix arrays can handle. */
+  static const uint64 kMaxBlockSize;
+  /**Largest block with 64-bit suffix arrays. Positions in the headers of
+   * the blocks are limited to 48 bits. */
+  static const uint64 kMaxLargeBlockSize;
+
+  ThreadPool *m_pool;
+
  private:
   BWTransform(const BWTransform&);
   const BWTransform& operator=(const BWTransform& );
@@ -46,29 +46,68 @@ using bwtc::Max;
 
 namespace bwtc {
 
+/**
+ * BWT using libdivsufsort. When the library is built with OpenMP (cmake
+ * -DOPENMP=1) sorting of the type B* substrings is run in the calling thread
+ * and in the threads for which there are idle slots in the thread pool.
+ * The result doesn't depend on the number of threads.
+ */
 class Divsufsorter : public BWTransform {
  public:
   Divsufsorter() {}
   virtual ~Divsufsorter() {}
 
   void
-  doTransform(byte *begin, uint32 length, std::vector<uint32>& LFpowers) const {
-    PROFILE("Divsufsorter::doTransform");
-    divbwt(begin, begin, 0, length, &LFpowers[0], LFpowers.size());
+  doTransform(byte *begin, uint64 length, std::vector<uint64>& LFpowers) const {
+    doTransform(begin, length, LFpowers, 0);
   }
 
   void
-  doTransform(byte *begin, uint32 length, std::vector<uint32>& LFpowers,
-              uint32 *freqs) const {
+  doTransform(byte *begin, uint64 length, std::vector<uint64>& LFpowers,
+              BWTStatistics *stats) const {
     PROFILE("Divsufsorter::doTransform");
-    divbwtf(begin, begin, 0, length, &LFpowers[0], LFpowers.size(), freqs);
+    assert(canTransform(length - 1));
+    uint32 threads = borrowThreads();
+    std::vector<unsigned> LF(LFpowers.size());
+    if(stats) {
+      divbwtf(begin, begin, 0, length, &LF[0], LF.size(), stats->frequencies,
+              stats->runs, threads);
+    } else {
+      divbwt(begin, begin, 0, length, &LF[0], LF.size(), threads);
+    }
+    std::copy(LF.begin(), LF.end(), LFpowers.begin());
+    if(m_pool) m_pool->returnSlots(threads - 1);
+  }
+
+  /* Block with the sentinel, the suffix array which divbwt allocates for
+   * the block and the sentinel plus one entry, and the bucket arrays. The
+   * work stacks of the sorting routines are in the call stack. */
+  virtual uint64 maxSizeInBytes(uint64 block_size) const {
+    return (block_size + 1) + (block_size + 2)*sizeof(saidx_t) + kBucketBytes;
+  }
+
+  virtual uint64 maxBlockSize(uint64 memory_budget) const {
+    const uint64 fixed = 1 + 2*sizeof(saidx_t) + kBucketBytes;
+    if(memory_budget < fixed) return 0;
+    return (memory_budget - fixed)/(1 + sizeof(saidx_t));
+  }
+
+  virtual uint64 suggestedBlockSize(uint64 memory_budget) const {
+    return std::min(maxBlockSize(memory_budget), kMaxBlockSize);
   }
 
-  /* The following values aren't correct */
-  virtual uint64 maxSizeInBytes(uint64) const { return 0; }
-  virtual uint64 maxBlockSize(uint64) const { return 0; }
-  virtual uint64 suggestedBlockSize(uint64) const { return 0; }
-  
+ private:
+  /* Sizes of bucket_A (one bucket per symbol) and bucket_B (one bucket per
+   * pair of symbols) in divsufsort.c. */
+  static const uint64 kBucketBytes = (256 + 256*256)*sizeof(saidx_t);
+
+  /* Returns the number of threads for sorting, including the caller. */
+  uint32 borrowThreads() const {
+#ifdef _OPENMP
+    if(m_pool) return 1 + m_pool->tryBorrowSlots(m_pool->threads() - 1);
+#endif
+    return 1;
+  }
 };
 } // namespace bwtc
 
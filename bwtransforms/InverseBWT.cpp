@@ -28,41 +28,137 @@
 
 #include <cassert>
 
+#include <algorithm> // for upper_bound
 #include <numeric>  // for partial_sum
 #include <vector>
 
 #include "../globaldefs.hpp"
 #include "InverseBWT.hpp"
 #include "MtlSaInverseBWT.hpp"
+#include "SampledInverseBWT.hpp"
 #include "../BWTBlock.hpp"
 #include "../Profiling.hpp"
 
 namespace bwtc {
 
-InverseBWTransform* giveInverseTransformer() {
+namespace {
+
+// Chooses the transform for each block by its size. MTL-SA is used up to its
+// limit of 2^31 bytes: both transforms prefetch the entries of their walks,
+// but MTL-SA restores two characters per access and was faster at every size
+// measured with InverseBwtBenchmark.
+class BudgetedInverseBWTransform : public InverseBWTransform {
+ public:
+  BudgetedInverseBWTransform(ThreadPool* pool, uint64 memoryBudget)
+      : m_fast(pool), m_small(memoryBudget, pool),
+        m_memoryBudget(memoryBudget) {}
+
+  uint64 maxSizeInBytes(uint64 block_size) const {
+    return choose(block_size + 1).maxSizeInBytes(block_size);
+  }
+
+  uint64 maxBlockSize(uint64 memory_budget) const {
+    return std::max(m_fast.maxBlockSize(memory_budget),
+                    m_small.maxBlockSize(memory_budget));
+  }
+
+  void doTransform(byte *bwt, uint64 n, const std::vector<uint64>& LFpow,
+                   const uint64 *frequencies) {
+    choose(n).doTransform(bwt, n, LFpow, frequencies);
+  }
+
+  void doTransformRange(byte *bwt, uint64 n, const std::vector<uint64>& LFpow,
+                        uint64 from, uint64 to, const uint64 *frequencies) {
+    choose(n).doTransformRange(bwt, n, LFpow, from, to, frequencies);
+  }
+
+ private:
+  InverseBWTransform& choose(uint64 n) {
+    if (n - 1 <= m_fast.maxBlockSize(m_memoryBudget)) return m_fast;
+    return m_small;
+  }
+
+  const InverseBWTransform& choose(uint64 n) const {
+    return const_cast<BudgetedInverseBWTransform*>(this)->choose(n);
+  }
+
+  MtlSaInverseBWTransform m_fast;
+  SampledInverseBWTransform m_small;
+  uint64 m_memoryBudget;
+};
+
+} //anonymous namespace
+
+InverseBWTransform* giveInverseTransformer(ThreadPool* pool,
+                                           uint64 memoryBudget) {
   //return new FastInverseBWTransform();
-  return new MtlSaInverseBWTransform();
+  if (memoryBudget == 0) return new MtlSaInverseBWTransform(pool);
+  return new BudgetedInverseBWTransform(pool, memoryBudget);
 }
 
-void InverseBWTransform::doTransform(BWTBlock& block) {
+void InverseBWTransform::
+doTransform(BWTBlock& block, const uint64 *frequencies) {
   byte *data = block.begin();
   *block.end() = data[block.LFpowers()[0]];
-  doTransform(block.begin(), block.size()+1, block.LFpowers());
+  doTransform(block.begin(), block.size()+1, block.LFpowers(), frequencies);
+}
+
+void InverseBWTransform::
+doTransformRange(BWTBlock& block, uint64 from, uint64 to,
+                 const uint64 *frequencies) {
+  assert(from < to && to <= block.size());
+  byte *data = block.begin();
+  *block.end() = data[block.LFpowers()[0]];
+  doTransformRange(block.begin(), block.size()+1, block.LFpowers(), from, to,
+                   frequencies);
+}
+
+namespace {
+
+// Outputs the character at the position and returns the next position of
+// the walk, whose entry is prefetched.
+inline uint64 nextPosition(const std::vector<uint32>& bwt_rank_low24,
+                           const std::vector<uint64>* rank_milestone_buffer,
+                           const std::vector<uint64>& count,
+                           uint64 position, byte& output) {
+  uint32 bwt_and_rank = bwt_rank_low24[position];
+  uint32 ch = bwt_and_rank >> 24;
+  output = ch;
+  uint32 rank_low24 = bwt_and_rank & 0x00FFFFFF;
+  // Milestones up to the position; the last of them is the one of the
+  // current rank.
+  const std::vector<uint64>& milestones = rank_milestone_buffer[ch];
+  uint64 rank_high = std::upper_bound(milestones.begin(), milestones.end(),
+                                      position) - milestones.begin() - 1;
+  uint64 next = count[ch] + (rank_high << 24) + rank_low24;
+  BWTC_PREFETCH(&bwt_rank_low24[next]);
+  return next;
+}
+
+} //anonymous namespace
+
+uint64 FastInverseBWTransform::maxSizeInBytes(uint64 block_size) const {
+  return (block_size + 1) * sizeof(uint32) + kMemoryOverhead;
 }
 
 uint64 FastInverseBWTransform::maxBlockSize(uint64 memory_budget) const {
+  if (memory_budget <= static_cast<uint64>(kMemoryOverhead)) return 0;
   memory_budget -= kMemoryOverhead;
   return memory_budget / sizeof(uint32);
 }
 
 void FastInverseBWTransform::doTransform(
-    byte* bwt, uint32 bwt_size, const std::vector<uint32>& LFpowers)
+    byte* bwt, uint64 bwt_size, const std::vector<uint64>& LFpowers,
+    const uint64 *frequencies)
 {
+  (void) frequencies;
   PROFILE("FastInverseBWTransform::doTransform");
-  uint32 eob_position = LFpowers[0];
+  uint64 eob_position = LFpowers[0];
   // rank[i] will be the number of occurrences of bwt[i] in bwt[0..i-1]
   std::vector<uint32> bwt_rank_low24(bwt_size);
-  std::vector<uint32> rank_milestone_buffer[256];
+  // rank_milestone_buffer[c][h] is the position of the occurrence of c with
+  // rank h * 2^24.
+  std::vector<uint64> rank_milestone_buffer[256];
 
   // count[] serves two purposes:
   // 1. When the scan of the BWT reaches position i,
@@ -70,18 +166,17 @@ void FastInverseBWTransform::doTransform(
   //    (count[0] counts the EOB symbol).
   // 2. During the ouput generation, count[c] is the total number
   //    of characters smaller than c (including the single EOB symbol).
-  std::vector<uint32> count(257, 0);
+  std::vector<uint64> count(257, 0);
 
   // count EOB
   bwt_rank_low24[eob_position] = 0;
   count[0] = 1;
   // count other characters
-  for (uint32 position = 0; position < bwt_size; ++position) {
+  for (uint64 position = 0; position < bwt_size; ++position) {
     if (position != eob_position) {
       uint32 ch = static_cast<byte>(bwt[position]);
-      uint32 rank = count[ch + 1];
+      uint64 rank = count[ch + 1];
       uint32 rank_low24 = rank & 0x00FFFFFF;
-      //uint32 rank_hi8 = rank >> 24;
       bwt_rank_low24[position] = (ch << 24) + rank_low24;
       if (0 == rank_low24) {
         rank_milestone_buffer[ch].push_back(position);
@@ -92,26 +187,44 @@ void FastInverseBWTransform::doTransform(
   std::partial_sum(count.begin(), count.end(), count.begin());
   assert(count[256] == bwt_size);
 
-  for (int ch = 0; ch < 256; ++ch) {
-    rank_milestone_buffer[ch].push_back(bwt_size);
+  // The text is restored in segments starting from the LF powers, as in
+  // MtlSaInverseBWTransform. The walks of the segments are independent, so
+  // they advance in turns and the entry of the next step of each walk is
+  // prefetched while the other walks take their steps.
+  uint64 streams = LFpowers.size();
+  uint64 segment_size = bwt_size / streams;
+  if (segment_size <= 1) {
+    streams = 1;
+    segment_size = bwt_size;
   }
+  uint64 to_restore = bwt_size - 1;
+  // Segment i restores the text from position i * segment_size - 1 onwards,
+  // the first one from 0 (after the EOB), and the last one up to the end.
+  std::vector<uint64> positions(LFpowers.begin(), LFpowers.begin() + streams);
+  std::vector<uint64> indices(streams);
+  positions[0] = 0;
+  for (uint64 i = 1; i < streams; ++i) indices[i] = i * segment_size - 1;
 
-  uint32 index = 0;
-
-  uint32 position = 0;
-  while (position != eob_position) {
-    uint32 bwt_and_rank = bwt_rank_low24[position];
-    uint32 ch = bwt_and_rank >> 24;
-    bwt[index++] = ch;
-    uint32 rank_low24 = bwt_and_rank & 0x00FFFFFF;
-    uint32 rank_hi8 = 0;
-    while (rank_milestone_buffer[ch][rank_hi8 + 1] <= position) ++rank_hi8;
-    position = count[ch] + (rank_hi8 << 24) + rank_low24;
+  for (uint64 step = 0; step + 1 < segment_size; ++step) {
+    for (uint64 i = 0; i < streams; ++i) {
+      positions[i] = nextPosition(bwt_rank_low24, rank_milestone_buffer,
+                                  count, positions[i], bwt[indices[i]++]);
+    }
+  }
+  // Segments other than the first one have one more character, and the
+  // last one the rest of the text.
+  for (uint64 i = 1; i + 1 < streams; ++i) {
+    nextPosition(bwt_rank_low24, rank_milestone_buffer, count,
+                 positions[i], bwt[indices[i]++]);
+  }
+  uint64 last = streams - 1;
+  while (indices[last] < to_restore) {
+    positions[last] = nextPosition(bwt_rank_low24, rank_milestone_buffer,
+                                   count, positions[last],
+                                   bwt[indices[last]++]);
   }
   // If the BWT or the EOB position contain errors (or are garbage),
-  // it is likely that the cycle ends prematurely.
-  // In this case, we return false.
-  //assert(index == bwt_size);
+  // the walks restore garbage.
 }
 
 } //namespace bwtc
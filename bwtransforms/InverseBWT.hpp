@@ -31,6 +31,7 @@
 
 #include "../globaldefs.hpp"
 #include "../BWTBlock.hpp"
+#include "../ThreadPool.hpp"
 
 namespace bwtc {
 /**
@@ -45,12 +46,38 @@ namespace bwtc {
 class InverseBWTransform {
  public:
   virtual ~InverseBWTransform() {}
+  /** Peak memory in bytes used in addition to the block for restoring a
+   * block of block_size bytes. */
+  virtual uint64 maxSizeInBytes(uint64 block_size) const = 0;
+  /** Largest block which can be restored within memory_budget bytes, ie.
+   * the inverse of maxSizeInBytes. */
   virtual uint64 maxBlockSize(uint64 memory_budget) const = 0;
 
-  virtual void doTransform(byte *bwt, uint32 n,
-                           const std::vector<uint32>& LFpow) = 0;
+  /**
+   * If the frequencies (the number of occurrences of each symbol in the
+   * block, see EntropyDecoder::decodeBlock) are given, the transform
+   * doesn't have to count them from the BWT.
+   */
+  virtual void doTransform(byte *bwt, uint64 n,
+                           const std::vector<uint64>& LFpow,
+                           const uint64 *frequencies = 0) = 0;
 
-  void doTransform(BWTBlock& block);
+  /**
+   * Restores only the characters [from, to) of the original text. Rest of
+   * the result is left undefined. By default the whole text is restored.
+   */
+  virtual void doTransformRange(byte *bwt, uint64 n,
+                                const std::vector<uint64>& LFpow,
+                                uint64 from, uint64 to,
+                                const uint64 *frequencies = 0) {
+    (void) from;
+    (void) to;
+    doTransform(bwt, n, LFpow, frequencies);
+  }
+
+  void doTransform(BWTBlock& block, const uint64 *frequencies = 0);
+  void doTransformRange(BWTBlock& block, uint64 from, uint64 to,
+                        const uint64 *frequencies = 0);
 
 };
 
@@ -60,21 +87,36 @@ class InverseBWTransform {
  *
  * For original implementation see 
  * @see http://code.google.com/p/dcs-bwt-compressor/ 
+ *
+ * Positions and counts are 64-bit, so that the transform can handle the
+ * blocks larger than 2^31 bytes. It uses roughly 4n bytes in addition to the
+ * block. The segments of text starting from the LF powers are restored by
+ * walks taking turns, so that the random accesses of the walks overlap.
  */
 class FastInverseBWTransform : public InverseBWTransform {
  public:
   FastInverseBWTransform() {}
   virtual ~FastInverseBWTransform() {}
+  virtual uint64 maxSizeInBytes(uint64 block_size) const;
   virtual uint64 maxBlockSize(uint64 memory_budget) const;
+  /** Frequencies are ignored, as the ranks are counted in the same pass
+   * as the frequencies. */
   virtual void doTransform(byte* source_bwt,
-                           uint32 bwt_size,
-                           const std::vector<uint32>& LFpowers);
+                           uint64 bwt_size,
+                           const std::vector<uint64>& LFpowers,
+                           const uint64 *frequencies);
  private:
   static const int64 kMemoryOverhead = 1 << 20;
 };
 
-/* For example memory budget would be a good parameter.. */
-InverseBWTransform* giveInverseTransformer();
+/**
+ * Gives the inverse transform for the memory budget (in bytes, in addition
+ * to the block), where 0 means no limit. The blocks which don't fit in the
+ * budget of MtlSaInverseBWTransform are restored with
+ * SampledInverseBWTransform.
+ */
+InverseBWTransform* giveInverseTransformer(ThreadPool* pool = 0,
+                                           uint64 memoryBudget = 0);
 
 } //namespace bwtc
 #endif
@@ -0,0 +1,423 @@
+/**
+ * @file MergingBWT.cpp
+ * @author Pekka Mikkola <pmikkol@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This file is part of bwtc.
+ *
+ * bwtc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * bwtc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with bwtc.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Implementation of the Burrows-Wheeler transform which merges the rows
+ * of sub-blocks sorted in parallel.
+ */
+
+#include <cassert>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "BWTransform.hpp"
+#include "MergingBWT.hpp"
+#include "SubBlockSort.hpp"
+#include "../globaldefs.hpp"
+#include "../Profiling.hpp"
+#include "../ThreadPool.hpp"
+
+namespace bwtc {
+
+namespace {
+
+/* The scans proceed in chunks of the text. Smaller chunks let more scans
+ * run at the same time, larger ones have less overhead. */
+const uint64 kMinChunkSize = 1 << 12;
+const uint64 kMaxChunkSize = 1 << 18;
+/* Parts of the output per thread, for balancing the work. */
+const uint32 kPartsPerThread = 4;
+/* Mapped symbols of a sub-block in SA-IS (see SortedSubBlock). */
+const int kAlphabet = 3*256 + 1;
+
+/* Memory model. Besides the block, sorting takes the mapped sub-block
+ * (2n), its suffix array and the recursion of SA-IS (4n each), where n
+ * summed over the sub-blocks being sorted is at most the block size.
+ * Sorted sub-blocks keep the symbols of their rows (n) and their counts
+ * (4n), and the scans add the gap arrays (4n). Bit vectors take the last
+ * byte. Each sub-block has the buckets of SA-IS, the symbol counts and
+ * the buffers of greater-bits for the scans. */
+const uint64 kBytesPerSymbol = 12;
+const uint64 kFixedBytesPerSubBlock = 2*kAlphabet*sizeof(int) +
+    257*sizeof(uint64) + 2*kMinChunkSize/8;
+
+/* Place of the writing of the merged rows in the rows of one sub-block and
+ * of the text following it. */
+struct LevelState {
+  /* Rank of the next suffix of the sub-block. */
+  uint64 next;
+  /* Rows of the following text before that suffix. */
+  uint64 before;
+};
+
+/* Output of one part of the merged rows. The runs are counted as if a run
+ * began at the start of the part. */
+struct PartOutput {
+  byte *begin;
+  byte *next;
+  uint32 *runs;
+};
+
+/**
+ * Builds the BWT of text[0..length) from the rows of its sub-blocks. Level
+ * k of the merge consists of the rows of sub-block k and of the text
+ * following it, which are the rows of level k+1. Gap array of sub-block k
+ * tells for each of its suffixes the number of rows of level k+1 before
+ * it. The last level has only the row of the empty suffix.
+ */
+class MergingBuilder {
+ public:
+  MergingBuilder(byte *text, uint64 length, uint32 subBlocks,
+                 ThreadPool *pool, std::vector<uint64>& LFpowers);
+  ~MergingBuilder();
+
+  /** Writes the BWT over the text in the format of the other transforms.
+   * If runs is given, the runs of the output are added to it. */
+  void build(uint32 *runs);
+
+ private:
+  uint64 size(uint32 k) const { return m_starts[k + 1] - m_starts[k]; }
+
+  void compareToStart(uint32 k);
+  void sortSubBlock(uint32 k);
+  void scanChunk(uint32 task);
+  void writePart(uint32 part);
+  void locate(uint64 row, std::vector<LevelState>& levels) const;
+  void emit(uint32 level, uint64 count, std::vector<LevelState>& levels,
+            PartOutput& out) const;
+  uint64 finalRow(uint32 k, uint64 rank) const;
+
+  byte *m_text;
+  uint64 m_length;
+  ThreadPool *m_pool;
+  std::vector<uint64>& m_LFpowers;
+  uint32 m_subBlocks;
+  std::vector<uint64> m_starts;
+  /* For sub-block k, bit d tells whether the suffix d symbols after its
+   * start is greater than the suffix starting from it (1 <= d <= size). */
+  std::vector<std::vector<bool> > m_selfGreater;
+  std::vector<SortedSubBlock*> m_sorted;
+  /* Offsets of the starting points in the sub-blocks, their ranks and
+   * their indices in m_LFpowers. */
+  std::vector<std::vector<std::pair<uint64, uint64> > > m_points;
+  std::vector<std::vector<size_t> > m_pointIndices;
+
+  /* State of the scans between the chunks. For the scan of sub-block k the
+   * count of its suffixes smaller than the latest suffix, and whether that
+   * suffix is greater than the text following sub-block k. */
+  std::vector<uint64> m_counts;
+  std::vector<byte> m_greaterThanT;
+  std::vector<std::vector<uint32> > m_gaps;
+  /* Greater-bits for the scan of the previous sub-block, in two buffers
+   * alternating between the chunks. */
+  std::vector<std::vector<bool> > m_bits[2];
+  uint64 m_chunk;
+  uint64 m_diagonal;
+  std::vector<uint32> m_tasks;
+  uint32 m_parts;
+  /* Runs of the output counted by each part. */
+  std::vector<uint32> m_partRuns;
+};
+
+MergingBuilder::
+MergingBuilder(byte *text, uint64 length, uint32 subBlocks, ThreadPool *pool,
+               std::vector<uint64>& LFpowers)
+    : m_text(text), m_length(length), m_pool(pool), m_LFpowers(LFpowers)
+{
+  uint32 threads = pool ? pool->threads() : 1;
+  if(subBlocks == 0) subBlocks = threads;
+  subBlocks = std::min<uint64>(std::min(subBlocks,
+                                        MergingBWTransform::kMaxSubBlocks),
+                               length);
+  /* The leftmost sub-block is the shortest. */
+  uint64 size = (length + subBlocks - 1)/subBlocks;
+  m_subBlocks = static_cast<uint32>((length + size - 1)/size);
+  m_starts.resize(m_subBlocks + 1);
+  m_starts[m_subBlocks] = length;
+  for(uint32 k = m_subBlocks; k-- > 1; ) m_starts[k] = m_starts[k + 1] - size;
+  m_starts[0] = 0;
+
+  m_selfGreater.resize(m_subBlocks);
+  m_sorted.resize(m_subBlocks, 0);
+  m_points.resize(m_subBlocks);
+  m_pointIndices.resize(m_subBlocks);
+  uint64 interval = length/LFpowers.size();
+  for(size_t i = 0; i < LFpowers.size(); ++i) {
+    uint64 pos = (i == 0) ? 0 : length - i*interval;
+    uint32 k = std::upper_bound(m_starts.begin(), m_starts.end(), pos) -
+        m_starts.begin() - 1;
+    m_points[k].push_back(std::make_pair(pos - m_starts[k], 0));
+    m_pointIndices[k].push_back(i);
+  }
+  m_chunk = std::min(std::max(length/(4*m_subBlocks), kMinChunkSize),
+                     kMaxChunkSize);
+  m_parts = threads*kPartsPerThread;
+}
+
+MergingBuilder::~MergingBuilder() {
+  for(size_t k = 0; k < m_sorted.size(); ++k) delete m_sorted[k];
+}
+
+/* Comparing the suffixes of sub-block k to its first suffix by the
+ * Z-array of the rest of the text doesn't depend on the other sub-blocks.
+ * The comparison may run to the end of the text on repetitive data. */
+void MergingBuilder::compareToStart(uint32 k) {
+  if(k == 0) return;
+  const byte *S = m_text + m_starts[k];
+  uint64 rest = m_length - m_starts[k];
+  uint64 n = size(k);
+  std::vector<uint32> Z;
+  zArray(S, rest, std::min(n + 1, rest), Z);
+  std::vector<bool>& greater = m_selfGreater[k];
+  greater.assign(n + 1, false);
+  for(uint64 d = 1; d <= n && d < rest; ++d)
+    greater[d] = d + Z[d] < rest && S[d + Z[d]] > S[Z[d]];
+}
+
+void MergingBuilder::sortSubBlock(uint32 k) {
+  const byte *B = m_text + m_starts[k];
+  uint64 n = size(k);
+  std::vector<bool> greater;
+  if(k + 1 < m_subBlocks) {
+    std::vector<uint32> Z;
+    zArray(B + n, m_length - m_starts[k + 1], n, Z);
+    greaterBits(B, n, Z, m_selfGreater[k + 1], greater);
+  }
+  byte before = (k > 0) ? B[-1] : 0;
+  m_sorted[k] = new SortedSubBlock(B, n, greater, before, m_points[k]);
+}
+
+/* Task number of the current diagonal scans one chunk for one sub-block.
+ * Chunk c of sub-block k is scanned on diagonal c + (last - k), after the
+ * same chunk of sub-block k+1 has given the greater-bits for it. The
+ * greater-bit of a position tells whether the suffix starting there is
+ * greater than the text following the sub-block. Within the next
+ * sub-block it is found from the comparisons to the start of that
+ * sub-block, and beyond from the scan of the next sub-block. */
+void MergingBuilder::scanChunk(uint32 task) {
+  const uint32 k = m_tasks[task];
+  const uint64 c = m_diagonal - (m_subBlocks - 2 - k);
+  const uint64 following = m_starts[k + 1], next = m_starts[k + 2];
+  const uint64 high = m_length - c*m_chunk;
+  const uint64 low = std::max(high - std::min(high, m_chunk), following);
+  const SortedSubBlock& sorted = *m_sorted[k];
+  const uint64 firstRank = sorted.firstRank();
+  const std::vector<bool>& selfGreater = m_selfGreater[k + 1];
+  const std::vector<bool>& in = m_bits[c & 1][k + 1];
+  std::vector<bool>& out = m_bits[c & 1][k];
+  std::vector<uint32>& gaps = m_gaps[k];
+
+  uint64 count = m_counts[k];
+  bool greaterThanT = m_greaterThanT[k];
+  for(uint64 pos = high; pos-- > low; ) {
+    count = sorted.lf(m_text[pos], count + (greaterThanT ? 1 : 0));
+    ++gaps[count];
+    if(k > 0) out[high - 1 - pos] = count > firstRank;
+    if(pos >= next) greaterThanT = in[high - 1 - pos];
+    else if(pos > following) greaterThanT = selfGreater[pos - following];
+  }
+  m_counts[k] = count;
+  m_greaterThanT[k] = greaterThanT;
+}
+
+/* Finds the state of every level before the given row of the output. */
+void MergingBuilder::locate(uint64 row, std::vector<LevelState>& levels) const {
+  uint64 x = row;
+  for(uint32 k = 0; k < m_subBlocks; ++k) {
+    const std::vector<uint32>& gaps = m_gaps[k];
+    uint64 low = 0, high = size(k);
+    while(low < high) {
+      uint64 middle = low + (high - low)/2;
+      if(middle + gaps[middle] < x) low = middle + 1;
+      else high = middle;
+    }
+    x -= low;
+    levels[k].next = low;
+    levels[k].before = gaps[low] - x;
+  }
+  assert(x == 1);
+}
+
+void MergingBuilder::emit(uint32 level, uint64 count,
+                          std::vector<LevelState>& levels,
+                          PartOutput& out) const {
+  LevelState& state = levels[level];
+  const std::vector<uint32>& gaps = m_gaps[level];
+  while(count > 0) {
+    if(state.before > 0) {
+      assert(level + 1 < m_subBlocks);
+      uint64 rows = std::min(state.before, count);
+      emit(level + 1, rows, levels, out);
+      state.before -= rows;
+      count -= rows;
+    } else {
+      byte c = m_sorted[level]->symbol(state.next);
+      if(out.runs && (out.next == out.begin || c != out.next[-1]))
+        ++out.runs[c];
+      *out.next++ = c;
+      ++state.next;
+      --count;
+      state.before = gaps[state.next] - gaps[state.next - 1];
+    }
+  }
+}
+
+/* Row of the empty suffix is the first one and is left out. */
+void MergingBuilder::writePart(uint32 part) {
+  uint64 first = 1 + m_length*part/m_parts;
+  uint64 last = 1 + m_length*(part + 1)/m_parts;
+  if(first == last) return;
+  std::vector<LevelState> levels(m_subBlocks);
+  locate(first, levels);
+  PartOutput out;
+  out.begin = out.next = m_text + first - 1;
+  out.runs = m_partRuns.empty() ? 0 : &m_partRuns[part*256];
+  emit(0, last - first, levels, out);
+}
+
+/* Suffix of sub-block j is preceded by the rows of level j+1 given by the
+ * gap array. Row x of level j+1 is preceded by the suffixes of sub-block j
+ * whose gap count is at most x. */
+uint64 MergingBuilder::finalRow(uint32 k, uint64 rank) const {
+  uint64 x = rank + m_gaps[k][rank];
+  for(uint32 j = k; j-- > 0; ) {
+    const std::vector<uint32>& gaps = m_gaps[j];
+    x += std::upper_bound(gaps.begin(), gaps.begin() + size(j), x) -
+        gaps.begin();
+  }
+  return x;
+}
+
+void MergingBuilder::build(uint32 *runs) {
+  {
+    PROFILE("MergingBuilder::sort");
+    runInParts(m_pool, this, &MergingBuilder::compareToStart, m_subBlocks);
+    runInParts(m_pool, this, &MergingBuilder::sortSubBlock, m_subBlocks);
+  }
+  {
+    PROFILE("MergingBuilder::scan");
+    m_counts.assign(m_subBlocks, 0);
+    m_greaterThanT.assign(m_subBlocks, 0);
+    m_gaps.resize(m_subBlocks);
+    m_bits[0].resize(m_subBlocks);
+    m_bits[1].resize(m_subBlocks);
+    for(uint32 k = 0; k < m_subBlocks; ++k) {
+      /* The empty suffix is the first row of every level. */
+      m_gaps[k].assign(size(k) + 1, 0);
+      m_gaps[k][0] = 1;
+      if(k + 1 < m_subBlocks && k > 0) {
+        m_bits[0][k].resize(m_chunk);
+        m_bits[1][k].resize(m_chunk);
+      }
+    }
+    if(m_subBlocks > 1) {
+      const uint64 chunks = (m_length - m_starts[1] + m_chunk - 1)/m_chunk;
+      for(m_diagonal = 0; m_diagonal < chunks + m_subBlocks - 1;
+          ++m_diagonal) {
+        m_tasks.clear();
+        for(uint32 k = 0; k + 1 < m_subBlocks; ++k) {
+          uint64 lag = m_subBlocks - 2 - k;
+          if(m_diagonal < lag) continue;
+          uint64 c = m_diagonal - lag;
+          if(c*m_chunk < m_length - m_starts[k + 1]) m_tasks.push_back(k);
+        }
+        runInParts(m_pool, this, &MergingBuilder::scanChunk,
+                   static_cast<uint32>(m_tasks.size()));
+      }
+    }
+    for(uint32 k = 0; k < m_subBlocks; ++k) {
+      assert(k + 1 == m_subBlocks || m_counts[k] == m_sorted[k]->following());
+      std::vector<uint32>& gaps = m_gaps[k];
+      for(uint64 i = 1; i < gaps.size(); ++i) gaps[i] += gaps[i - 1];
+      std::vector<bool>().swap(m_selfGreater[k]);
+      std::vector<bool>().swap(m_bits[0][k]);
+      std::vector<bool>().swap(m_bits[1][k]);
+    }
+  }
+  PROFILE("MergingBuilder::write");
+  for(uint32 k = 0; k < m_subBlocks; ++k) {
+    for(size_t i = 0; i < m_points[k].size(); ++i) {
+      m_LFpowers[m_pointIndices[k][i]] =
+          finalRow(k, m_points[k][i].second) - 1;
+    }
+  }
+  if(runs) m_partRuns.assign(m_parts*256, 0);
+  runInParts(m_pool, this, &MergingBuilder::writePart, m_parts);
+  if(runs) {
+    for(uint32 p = 0; p < m_parts; ++p) {
+      for(int c = 0; c < 256; ++c) runs[c] += m_partRuns[p*256 + c];
+      uint64 first = m_length*p/m_parts;
+      if(first > 0 && first < m_length*(p + 1)/m_parts &&
+         m_text[first - 1] == m_text[first])
+        --runs[m_text[first]];
+    }
+  }
+}
+
+} //anonymous namespace
+
+const uint32 MergingBWTransform::kMaxSubBlocks;
+
+MergingBWTransform::MergingBWTransform(uint32 subBlocks)
+    : m_subBlocks(subBlocks) {}
+
+void MergingBWTransform::
+doTransform(byte *begin, uint64 length, std::vector<uint64>& LFpowers) const {
+  doTransform(begin, length, LFpowers, 0);
+}
+
+void MergingBWTransform::
+doTransform(byte *begin, uint64 length, std::vector<uint64>& LFpowers,
+            BWTStatistics *stats) const {
+  PROFILE("MergingBWTransform::doTransform");
+  assert(canTransform(length - 1));
+  if(stats) {
+    for(uint64 i = 0; i + 1 < length; ++i) ++stats->frequencies[begin[i]];
+  }
+  MergingBuilder builder(begin, length, m_subBlocks, m_pool, LFpowers);
+  builder.build(stats ? stats->runs : 0);
+}
+
+uint64 MergingBWTransform::maxSizeInBytes(uint64 block_size) const {
+  uint32 subBlocks = (m_subBlocks > 0) ? m_subBlocks : kMaxSubBlocks;
+  return (block_size + 1)*kBytesPerSymbol +
+      std::min(subBlocks, kMaxSubBlocks)*kFixedBytesPerSubBlock;
+}
+
+uint64 MergingBWTransform::maxBlockSize(uint64 memory_budget) const {
+  if(maxSizeInBytes(0) > memory_budget) return 0;
+  uint64 low = 0, high = kMaxBlockSize;
+  while(low < high) {
+    uint64 middle = low + (high - low + 1)/2;
+    if(maxSizeInBytes(middle) <= memory_budget) low = middle;
+    else high = middle - 1;
+  }
+  return low;
+}
+
+uint64 MergingBWTransform::suggestedBlockSize(uint64 memory_budget) const {
+  return maxBlockSize(memory_budget);
+}
+
+} //namespace bwtc
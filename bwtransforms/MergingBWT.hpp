@@ -0,0 +1,82 @@
+/**
+ * @file MergingBWT.hpp
+ * @author Pekka Mikkola <pmikkol@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This file is part of bwtc.
+ *
+ * bwtc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * bwtc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with bwtc.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Header for the Burrows-Wheeler transform which sorts the sub-blocks of
+ * a block in parallel and merges their rows.
+ */
+
+#ifndef BWTC_MERGING_BWT_HPP_
+#define BWTC_MERGING_BWT_HPP_
+
+#include <vector>
+
+#include "BWTransform.hpp"
+#include "../globaldefs.hpp"
+
+namespace bwtc {
+
+/**
+ * BWT of a block built from the BWTs of its sub-blocks, all steps running
+ * in the threads of the thread pool.
+ *
+ * The suffixes of each sub-block are sorted in the context of the text
+ * following it, as in "Lightweight Data Indexing and Compression in External
+ * Memory" by Ferragina, Gagie & Manzini. The comparisons crossing the end
+ * of a sub-block need only the order of the suffixes of the next sub-block
+ * against its first suffix, which is found from the Z-array of the text,
+ * so the sub-blocks are sorted independently. Then each sub-block scans
+ * the text following it to count for every suffix of that text the
+ * suffixes of the sub-block smaller than it. The scan of a sub-block uses
+ * the results of the scan of the next sub-block, so the scans proceed
+ * together chunk by chunk. Finally the rows of the sub-blocks are written
+ * in their merged order by parts of the output.
+ *
+ * The scans take time proportional to the block size times the number of
+ * sub-blocks, so there should be about as many sub-blocks as threads.
+ */
+class MergingBWTransform : public BWTransform {
+ public:
+  /** With zero sub-blocks there is one for every thread of the pool. */
+  explicit MergingBWTransform(uint32 subBlocks = 0);
+  virtual ~MergingBWTransform() {}
+
+  void
+  doTransform(byte *begin, uint64 length, std::vector<uint64>& LFpowers) const;
+
+  void
+  doTransform(byte *begin, uint64 length, std::vector<uint64>& LFpowers,
+              BWTStatistics* stats) const;
+
+  virtual uint64 maxSizeInBytes(uint64 block_size) const;
+  virtual uint64 maxBlockSize(uint64 memory_budget) const;
+  virtual uint64 suggestedBlockSize(uint64 memory_budget) const;
+
+  static const uint32 kMaxSubBlocks = 32;
+
+ private:
+  uint32 m_subBlocks;
+};
+
+} // namespace bwtc
+
+#endif
@@ -25,21 +25,68 @@
  * Implementation of the MTL-SA algorithm for inverting BWT.
  */
 
+#include <algorithm>
 #include <cassert>
 #include <numeric>  // For partial_sum.
 
+#include <sys/mman.h>
+
 #include "../globaldefs.hpp"
+#include "../ThreadPool.hpp"
 #include "MtlSaInverseBWT.hpp"
 #include "../Profiling.hpp"
 
 namespace bwtc {
 
+uint64 MtlSaInverseBWTransform::maxSizeInBytes(uint64 block_size) const {
+  if (block_size <= kMaxBlockSize) return (block_size + 1) * 6;
+  return FastInverseBWTransform().maxSizeInBytes(block_size);
+}
+
 uint64 MtlSaInverseBWTransform::maxBlockSize(uint64 memory_budget) const {
-  return memory_budget / sizeof(uint32);
+  // The data array of doTransform takes roughly 6n bytes. Larger blocks are
+  // restored with FastInverseBWTransform.
+  uint64 size = memory_budget / 6;
+  if (size <= kMaxBlockSize) return size;
+  return FastInverseBWTransform().maxBlockSize(memory_budget);
 }
 
+namespace {
+
+// Turns the counts of (first column, last column) character pairs into the
+// starting positions of the pairs stored in the layout of doTransform.
+void finishPairsCount(const byte *bwt, std::vector<uint32> &pairs_count,
+    bool little_endian) {
+  uint32 *pairs_count_ptr = &pairs_count[0];
+  if (little_endian) {
+    // Transpose pairs_count.
+    for (uint32 low = 0; low < 256; ++low) {
+      for (uint32 high = low + 1; high < 256; ++high) {
+        std::swap(pairs_count[(low << 8) + high + 1],
+                  pairs_count[(high << 8) + low + 1]);
+      }
+    }
+  }
+
+  // Count the only pair starting with an EOB.
+  ++pairs_count_ptr[0];
+
+  // Count the only pair ending with an EOB.
+  uint32 bwt_current = bwt[0];
+  if (little_endian) {
+    ++pairs_count_ptr[bwt_current << 8];
+  } else {
+    ++pairs_count_ptr[(255 << 8) + bwt_current];
+  }
+
+  // Accumulate the counts, so we can use it to compute LF^2.
+  std::partial_sum(pairs_count.begin(), pairs_count.end(), pairs_count.begin());
+}
+
+} //anonymous namespace
+
 void computeData(const byte *bwt, uint64 bwt_size, uint32 *data,
-    uint32 eob_position) {
+    uint32 eob_position, const uint64 *frequencies) {
   // The function assumes that bwt contains the EOB symbol, which conceptually
   // is the smallest character in the alphabet but never takes any action that
   // depends on its value, hence actual value of EOB is irrelevant, in
@@ -66,11 +113,20 @@ void computeData(const byte *bwt, uint64 bwt_size, uint32 *data,
   // Count EOB.
   count_ptr[0] = 1;
 
-  // Count other characters.
-  for (uint32 position = 0; position < bwt_size; ++position) {
-    if (position != eob_position) {
-      uint32 ch = bwt[position];
-      ++count_ptr[ch + 1];
+  // Count other characters, unless the frequencies of them are given.
+  // Frequencies which don't match the size of the BWT are not trusted.
+  uint64 total = 1;
+  if (frequencies) {
+    for (uint32 ch = 0; ch < 256; ++ch) total += frequencies[ch];
+  }
+  if (frequencies && total == bwt_size) {
+    for (uint32 ch = 0; ch < 256; ++ch) count_ptr[ch + 1] = frequencies[ch];
+  } else {
+    for (uint32 position = 0; position < bwt_size; ++position) {
+      if (position != eob_position) {
+        uint32 ch = bwt[position];
+        ++count_ptr[ch + 1];
+      }
     }
   }
   std::partial_sum(count.begin(), count.end(), count.begin());
@@ -140,13 +196,6 @@ void computeData(const byte *bwt, uint64 bwt_size, uint32 *data,
       }
       ++pairs_count_ptr[(first_column_ch << 8) + bwt_current + 1];
     }
-    // Transpose pairs_count.
-    for (uint32 low = 0; low < 256; ++low) {
-      for (uint32 high = low + 1; high < 256; ++high) {
-        std::swap(pairs_count[(low << 8) + high + 1],
-                  pairs_count[(high << 8) + low + 1]);
-      }
-    }
   } else {
     for (uint32 position = 1; position < eob_position; ++position) {
       bwt_current = bwt[position];
@@ -182,19 +231,7 @@ void computeData(const byte *bwt, uint64 bwt_size, uint32 *data,
     }
   }
 
-  // Count the only pair starting with an EOB.
-  ++pairs_count_ptr[0];
-
-  // Count the only pair ending with an EOB.
-  bwt_current = bwt[0];
-  if (little_endian) {
-    ++pairs_count_ptr[bwt_current << 8];
-  } else {
-    ++pairs_count_ptr[(255 << 8) + bwt_current];
-  }
-
-  // Accumulate the counts, so we can use it to compute LF^2.
-  std::partial_sum(pairs_count.begin(), pairs_count.end(), pairs_count.begin());
+  finishPairsCount(bwt, pairs_count, little_endian);
 
   uint32 *data_ptr = &data[0];
   uint32 bwt_index = 0;
@@ -243,10 +280,333 @@ void computeData(const byte *bwt, uint64 bwt_size, uint32 *data,
   }
 }
 
-void MtlSaInverseBWTransform::doTransform(byte* bwt, uint32 bwt_size,
-    const std::vector<uint32> &LFpowers) {
+namespace {
+
+// Asks for transparent huge pages for the part of [begin, begin + bytes)
+// aligned to them. The walks access the data array at random, and with the
+// normal pages nearly every access misses the TLB. Has to be called before
+// the memory is touched.
+void adviseHugePages(void *begin, size_t bytes) {
+#ifdef MADV_HUGEPAGE
+  const size_t huge_page = 1 << 21;
+  size_t first = (reinterpret_cast<size_t>(begin) + huge_page - 1) &
+      ~(huge_page - 1);
+  size_t last = (reinterpret_cast<size_t>(begin) + bytes) & ~(huge_page - 1);
+  if (first < last)
+    madvise(reinterpret_cast<void *>(first), last - first, MADV_HUGEPAGE);
+#else
+  (void) begin;
+  (void) bytes;
+#endif
+}
+
+// Position of the pair (bwt[LF[i]], bwt[i]) in the layout of doTransform.
+inline uint16 *pairAt(uint32 *data, uint32 position) {
+  return (uint16 *)(data + 3 * (position / 2) + 1) + (position & 1);
+}
+
+// Position of LF^2[i] in the layout of doTransform.
+inline uint32 *lf2At(uint32 *data, uint32 position) {
+  return data + 3 * (position / 2) + ((position & 1) << 1);
+}
+
+// Multi-threaded version of computeData. BWT is divided into chunks, one per
+// thread of the pool. The chunks are counted first, after which every chunk knows the
+// ranks of the characters at its beginning and the chunks can be scanned
+// independently. Result is identical to the one of computeData.
+class ParallelDataComputation {
+ public:
+  ParallelDataComputation(const byte *bwt, uint32 bwt_size, uint32 *data,
+      uint32 eob_position, uint32 chunks, ThreadPool* pool)
+      : m_pool(pool), m_bwt(bwt), m_bwt_size(bwt_size), m_data(data),
+        m_eob_position(eob_position), m_chunks(chunks),
+        m_second_eob_pair(0), m_count(256 + 1, 0),
+        m_chars(chunks, std::vector<uint32>(256, 0)),
+        m_pairs_count(chunks, std::vector<uint32>(256 * 256 + 1, 0)),
+        m_keys(chunks, std::vector<uint32>(256 * 256, 0)) {
+    uint16 value = 1;
+    m_little_endian = ((unsigned char *)&value)[0];
+    // Chunks start from even positions, so that they don't share the words
+    // of data storing the pairs.
+    uint32 chunk_size = (bwt_size / chunks) & ~1u;
+    for (uint32 i = 0; i < chunks; ++i) m_begin.push_back(i * chunk_size);
+    m_begin.push_back(bwt_size);
+  }
+
+  void run() {
+    runChunks(&ParallelDataComputation::countCharacters);
+
+    // Starting ranks of the chunks.
+    m_count[0] = 1;
+    for (uint32 ch = 0; ch < 256; ++ch) {
+      for (uint32 i = 0; i < m_chunks; ++i) m_count[ch + 1] += m_chars[i][ch];
+    }
+    std::partial_sum(m_count.begin(), m_count.end(), m_count.begin());
+    assert(m_count[256] == m_bwt_size);
+    for (uint32 ch = 0; ch < 256; ++ch) {
+      uint32 rank = m_count[ch];
+      for (uint32 i = 0; i < m_chunks; ++i) {
+        uint32 chunk_count = m_chars[i][ch];
+        m_chars[i][ch] = rank;
+        rank += chunk_count;
+      }
+    }
+
+    runChunks(&ParallelDataComputation::storePairs);
+
+    // Rows containing the EOB in the last 2 columns are handled separately
+    // and are not counted in the starting positions of the pairs. The row of
+    // EOB itself was not counted while storing the pairs.
+    uint32 second_eob_chunk = 0;
+    while (m_begin[second_eob_chunk + 1] <= m_second_eob_pair) {
+      ++second_eob_chunk;
+    }
+    --m_keys[second_eob_chunk][*pairAt(m_data, m_second_eob_pair)];
+
+    std::vector<uint32> &pairs_count = m_pairs_count[0];
+    for (uint32 i = 1; i < m_chunks; ++i) {
+      for (uint32 k = 0; k < pairs_count.size(); ++k) {
+        pairs_count[k] += m_pairs_count[i][k];
+      }
+    }
+    finishPairsCount(m_bwt, pairs_count, m_little_endian);
+    for (uint32 k = 0; k < 256 * 256; ++k) {
+      uint32 position = pairs_count[k];
+      for (uint32 i = 0; i < m_chunks; ++i) {
+        uint32 chunk_count = m_keys[i][k];
+        m_keys[i][k] = position;
+        position += chunk_count;
+      }
+    }
+
+    runChunks(&ParallelDataComputation::storeLF2);
+  }
+
+ private:
+  void runChunks(void (ParallelDataComputation::*function)(uint32)) {
+    runInParts(m_pool, this, function, m_chunks);
+  }
+
+  void countCharacters(uint32 chunk) {
+    uint32 *chars = &m_chars[chunk][0];
+    for (uint32 position = m_begin[chunk]; position < m_begin[chunk + 1];
+         ++position) {
+      if (position != m_eob_position) ++chars[m_bwt[position]];
+    }
+  }
+
+  void storePairs(uint32 chunk) {
+    uint32 *rank = &m_chars[chunk][0];
+    uint32 *pairs_count = &m_pairs_count[chunk][0];
+    uint32 *keys = &m_keys[chunk][0];
+    uint32 begin = m_begin[chunk], end = m_begin[chunk + 1];
+    uint32 first_column_ch = 0;
+    while (m_count[first_column_ch + 1] <= begin) ++first_column_ch;
+
+    for (uint32 position = begin; position < end; ++position) {
+      uint16 *pair = pairAt(m_data, position);
+      if (position == m_eob_position) {
+        *pair = m_little_endian ? (m_bwt[0] << 8) : m_bwt[0];
+        continue;
+      }
+      uint32 bwt_current = m_bwt[position];
+      uint32 LF_current = rank[bwt_current]++;
+      uint32 bwt_previous = m_bwt[LF_current];
+      *pair = m_little_endian ? bwt_current + (bwt_previous << 8)
+                              : (bwt_current << 8) + bwt_previous;
+      ++keys[*pair];
+      // Position 0 is a special case in the counts, see computeData.
+      if (position == 0) continue;
+      if (LF_current == m_eob_position) {
+        // Only one position can match, so no locking is needed.
+        m_second_eob_pair = position;
+      }
+      while (m_count[first_column_ch + 1] <= position) ++first_column_ch;
+      ++pairs_count[(first_column_ch << 8) + bwt_current + 1];
+    }
+  }
+
+  void storeLF2(uint32 chunk) {
+    uint32 *keys = &m_keys[chunk][0];
+    uint32 LF_0 = m_count[m_bwt[0]];
+    for (uint32 position = m_begin[chunk]; position < m_begin[chunk + 1];
+         ++position) {
+      uint32 *lf2 = lf2At(m_data, position);
+      if (position == m_eob_position) {
+        *lf2 = LF_0;
+      } else if (position == m_second_eob_pair) {
+        *lf2 = 0;
+      } else {
+        *lf2 = keys[*pairAt(m_data, position)]++;
+      }
+    }
+  }
+
+  ThreadPool *m_pool;
+  const byte *m_bwt;
+  uint32 m_bwt_size;
+  uint32 *m_data;
+  uint32 m_eob_position;
+  uint32 m_chunks;
+  bool m_little_endian;
+  uint32 m_second_eob_pair;
+  std::vector<uint32> m_begin;
+  // Counts of EOB and the characters, see computeData.
+  std::vector<uint32> m_count;
+  // Per chunk character counts, later the ranks at the beginning of chunk.
+  std::vector<std::vector<uint32> > m_chars;
+  std::vector<std::vector<uint32> > m_pairs_count;
+  // Per chunk counts of the stored pairs, later their starting positions.
+  std::vector<std::vector<uint32> > m_keys;
+};
+
+// Restores the text segments starting from the LF powers. Each of the
+// tasks walks its own group of segments interleaved. The walks form a ring
+// of pending positions: the entry of the next position of a walk is
+// prefetched as soon as the position is known, and read when the turn comes
+// back to the walk after the other walks of the group. A walk can't look
+// further ahead, as each position is read from the entry of the previous.
+class SegmentRestoration {
+ public:
+  SegmentRestoration(const uint32 *data, byte *result, uint32 *positions,
+      uint16 **dest_ptr, uint32 starting_positions, uint32 block_size,
+      uint32 to_restore)
+      : m_data(data), m_result(result), m_positions(positions),
+        m_dest_ptr(dest_ptr), m_starting_positions(starting_positions),
+        m_block_size(block_size), m_to_restore(to_restore), m_first(0),
+        m_last(starting_positions), m_groups(1) {}
+
+  // Restores the segments [first, last).
+  void restore(uint32 first, uint32 last, uint32 groups, ThreadPool* pool) {
+    m_first = first;
+    m_last = last;
+    m_groups = groups;
+    runInParts(pool, this, &SegmentRestoration::restoreGroup, groups);
+  }
+
+ private:
+  void restoreGroup(uint32 group) {
+    uint32 segments = m_last - m_first;
+    restoreSegments(m_first + (group * segments) / m_groups,
+                    m_first + ((group + 1) * segments) / m_groups);
+  }
+
+  void restoreSegments(uint32 first, uint32 last) {
+    const uint32 *data_ptr = m_data;
+    byte *result_ptr = m_result;
+    uint32 *positions = m_positions;
+    uint16 **dest_ptr = m_dest_ptr;
+    uint32 starting_positions = m_starting_positions;
+    uint32 block_size = m_block_size;
+    uint32 to_restore = m_to_restore;
+
+    // Restore the first pair from each block.
+    for (uint32 block_id = first; block_id < last; ++block_id) {
+      uint32 position = positions[block_id];
+      uint32 base = 3 * (position / 2);
+      uint32 offset = position & 1;
+      uint32 next_position = data_ptr[base + (offset << 1)];
+      uint16 char_pair = ((uint16 *)(data_ptr + base + 1))[offset];
+      positions[block_id] = next_position;
+      BWTC_PREFETCH(data_ptr + 3 * (next_position / 2));
+      if (block_id == 0) {
+        // Skip the EOB symbol.
+        ++dest_ptr[block_id];
+        result_ptr[0] = ((unsigned char *)&char_pair)[1];
+      } else { 
+        // Not the first pair, decode as normal.
+        *dest_ptr[block_id]++ = char_pair;
+      }
+    }
+
+    // Restore the main part of each block, two characters at a time,
+    // simultaneously from multiple starting positions.
+    for (uint32 filled = 1; filled < block_size / 2; ++filled) {
+      for (uint32 block_id = first; block_id < last; ++block_id) {
+        uint32 position = positions[block_id];
+        uint32 base = 3 * (position / 2);
+        uint32 offset = position & 1;
+        uint32 next_position = data_ptr[base + (offset << 1)];
+        uint16 char_pair = ((uint16 *)(data_ptr + base + 1))[offset];
+        positions[block_id] = next_position;
+        *dest_ptr[block_id]++ = char_pair;
+        BWTC_PREFETCH(data_ptr + 3 * (next_position / 2));
+      }
+    }
+
+    // If the block size is odd then there is one remaining character in each
+    // block. This loop takes case of that. The last block is handled
+    // separately because it might contain more than one remaining character.
+    if (block_size & 1) {
+      for (uint32 block_id = first; block_id < last &&
+               block_id + 1 < starting_positions; ++block_id) {
+        uint32 position = positions[block_id];
+        uint32 base = 3 * (position / 2);
+        uint32 offset = position & 1;
+        uint16 char_pair = ((uint16 *)(data_ptr + base + 1))[offset];
+        result_ptr[(block_id + 1) * block_size - 2] =
+          ((unsigned char *)&char_pair)[0];
+      }
+    }
+    if (last != starting_positions) return;
+
+    // Restore the remaining characters from the last (longest) block,
+    // possibly except the last character, if the last block has odd length.
+    uint32 index =
+        (starting_positions - 1) * block_size - 1 + 2 * (block_size / 2);
+    while (index + 1 < to_restore) {
+      uint32 position = positions[starting_positions - 1];
+      uint32 base = 3 * (position / 2);
+      uint32 offset = position & 1;
+      uint32 next_position = data_ptr[base + (offset << 1)];
+      uint16 char_pair = ((uint16 *)(data_ptr + base + 1))[offset];
+      positions[starting_positions - 1] = next_position;
+      *dest_ptr[starting_positions - 1]++ = char_pair;
+      index += 2;
+    }
+
+    // Single character left in the last block.
+    if (index != to_restore) {
+      uint32 position = positions[starting_positions - 1];
+      uint32 base = 3 * (position / 2);
+      uint32 offset = position & 1;
+      uint16 char_pair = ((uint16 *)(data_ptr + base + 1))[offset];
+      result_ptr[to_restore - 1] = ((unsigned char *)&char_pair)[0];
+    }
+  }
+
+  const uint32 *m_data;
+  byte *m_result;
+  uint32 *m_positions;
+  uint16 **m_dest_ptr;
+  uint32 m_starting_positions;
+  uint32 m_block_size;
+  uint32 m_to_restore;
+  uint32 m_first;
+  uint32 m_last;
+  uint32 m_groups;
+};
+
+// Blocks smaller than this per thread are not worth splitting.
+const uint32 kMinChunkSize = 1 << 16;
+
+} //anonymous namespace
+
+void MtlSaInverseBWTransform::doTransform(byte* bwt, uint64 bwt_size,
+    const std::vector<uint64> &LFpowers, const uint64 *frequencies) {
+  doTransformRange(bwt, bwt_size, LFpowers, 0, bwt_size - 1, frequencies);
+}
+
+void MtlSaInverseBWTransform::doTransformRange(byte* bwt, uint64 bwt_size,
+    const std::vector<uint64> &LFpowers, uint64 from, uint64 to,
+    const uint64 *frequencies) {
+  if (bwt_size - 1 > kMaxBlockSize) {
+    FastInverseBWTransform().doTransform(bwt, bwt_size, LFpowers, frequencies);
+    return;
+  }
   PROFILE("MtlSaInverseBWTransform::doTransform");
   assert(bwt_size >= 2);
+  assert(from < to && to < bwt_size);
   assert(LFpowers.size() > 0);
   uint32 eob_position = LFpowers[0];
 
@@ -265,9 +625,16 @@ void MtlSaInverseBWTransform::doTransform(byte* bwt, uint32 bwt_size,
   //
   // Where P[i] is a pair (bwt[LF[i]], bwt[i]).
   uint32 *data = new uint32[3 * ((bwt_size + 1) / 2)];
-  computeData(bwt, bwt_size, data, eob_position);
+  adviseHugePages(data, sizeof(uint32) * 3 * ((bwt_size + 1) / 2));
+  uint32 threads = m_pool ? m_pool->threads() : 1;
+  threads = std::min<uint64>(threads, bwt_size / kMinChunkSize);
+  if (threads > 1) {
+    ParallelDataComputation(bwt, bwt_size, data, eob_position, threads,
+                            m_pool).run();
+  } else {
+    computeData(bwt, bwt_size, data, eob_position, frequencies);
+  }
 
-  uint32 *data_ptr = &data[0];
   byte *result_ptr = bwt;
   uint32 starting_positions = LFpowers.size();
   uint32 block_size = bwt_size / starting_positions;
@@ -289,77 +656,20 @@ void MtlSaInverseBWTransform::doTransform(byte* bwt, uint32 bwt_size,
     dest_ptr[i] = (uint16 *)(result_ptr + i * block_size - 1);
   }
 
-  // Restore the first pair from each block.
-  for (uint32 block_id = 0; block_id < starting_positions; ++block_id) {
-    uint32 position = positions[block_id];
-    uint32 base = 3 * (position / 2);
-    uint32 offset = position & 1;
-    uint32 next_position = data_ptr[base + (offset << 1)];
-    uint16 char_pair = ((uint16 *)(data_ptr + base + 1))[offset];
-    positions[block_id] = next_position;
-    if (block_id == 0) {
-      // Skip the EOB symbol.
-      ++dest_ptr[block_id];
-      result_ptr[0] = ((unsigned char *)&char_pair)[1];
-    } else { 
-      // Not the first pair, decode as normal.
-      *dest_ptr[block_id]++ = char_pair;
-    }
-  }
+  // Segment i restores the text from position i * block_size - 1 onwards
+  // (the first one from 0), and the last one up to the end.
+  uint32 first = std::min<uint32>((from + 1) / block_size,
+                                 starting_positions - 1);
+  uint32 last = std::min<uint32>(to / block_size, starting_positions - 1) + 1;
 
-  // Restore the main part of each block, two characters at a time,
-  // simultaneously from multiple starting positions.
-  for (uint32 filled = 1; filled < block_size / 2; ++filled) {
-    for (uint32 block_id = 0; block_id < starting_positions; ++block_id) {
-      uint32 position = positions[block_id];
-      uint32 base = 3 * (position / 2);
-      uint32 offset = position & 1;
-      uint32 next_position = data_ptr[base + (offset << 1)];
-      uint16 char_pair = ((uint16 *)(data_ptr + base + 1))[offset];
-      positions[block_id] = next_position;
-      *dest_ptr[block_id]++ = char_pair;
-    }
-  }
-
-  // If the block size is odd then there is one remaining character in each
-  // block. This loop takes case of that. The last block is handled separately
-  // because it might contain more than one remaining character.
-  if (block_size & 1) {
-    for (uint32 block_id = 0; block_id + 1 < starting_positions; ++block_id) {
-      uint32 position = positions[block_id];
-      uint32 base = 3 * (position / 2);
-      uint32 offset = position & 1;
-      uint16 char_pair = ((uint16 *)(data_ptr + base + 1))[offset];
-      result_ptr[(block_id + 1) * block_size - 2] =
-        ((unsigned char *)&char_pair)[0];
-    }
-  }
-
-  // Restore the remaining characters from the last (longest) block,
-  // possibly except the last character, if the last block has odd length.
-  uint32 index = (starting_positions - 1) * block_size - 1 + 2 * (block_size / 2);
-  while (index + 1 < to_restore) {
-    uint32 position = positions[starting_positions - 1];
-    uint32 base = 3 * (position / 2);
-    uint32 offset = position & 1;
-    uint32 next_position = data_ptr[base + (offset << 1)];
-    uint16 char_pair = ((uint16 *)(data_ptr + base + 1))[offset];
-    positions[starting_positions - 1] = next_position;
-    *dest_ptr[starting_positions - 1]++ = char_pair;
-    index += 2;
-  }
-
-  // Single character left in the last block.
-  if (index != to_restore) {
-    uint32 position = positions[starting_positions - 1];
-    uint32 base = 3 * (position / 2);
-    uint32 offset = position & 1;
-    uint16 char_pair = ((uint16 *)(data_ptr + base + 1))[offset];
-    result_ptr[to_restore - 1] = ((unsigned char *)&char_pair)[0];
-  }
+  // The segments are independent of each other, so they can be restored in
+  // separate tasks.
+  SegmentRestoration restoration(data, result_ptr, positions, dest_ptr,
+      starting_positions, block_size, to_restore);
+  restoration.restore(first, last, std::max<uint32>(1,
+      std::min(threads, last - first)), m_pool);
 
   delete[] data;
 }
 
 } //namespace bwtc
-
@@ -30,6 +30,7 @@
 #include <vector>
 
 #include "../globaldefs.hpp"
+#include "../ThreadPool.hpp"
 #include "InverseBWT.hpp"
 
 namespace bwtc {
@@ -37,15 +38,41 @@ namespace bwtc {
 /**
  * Inverse Burrows-Wheeler transform using the MTL-SA algorithm described in
  * "Slashing the Time for BWT Inversion" by Karkkainen, Kempa and Puglisi.
+ *
+ * With a thread pool the computation of LF^2 is split into chunks of BWT,
+ * and the segments of text starting from the LF powers are divided into
+ * groups restored in separate tasks. The walks of a group take turns and
+ * prefetch their next entries, so their random accesses overlap, and the
+ * work array is backed by transparent huge pages where available.
  */
 class MtlSaInverseBWTransform : public InverseBWTransform {
  public:
-  MtlSaInverseBWTransform() {}
+  explicit MtlSaInverseBWTransform(ThreadPool* pool = 0) : m_pool(pool) {}
   virtual ~MtlSaInverseBWTransform() {}
+  virtual uint64 maxSizeInBytes(uint64 block_size) const;
   virtual uint64 maxBlockSize(uint64 memory_budget) const;
+  /** With frequencies the single-threaded transform skips its first pass
+   * over the BWT. The multi-threaded one still counts the symbols of each
+   * chunk, as the chunks start from the ranks at their beginning, which
+   * don't follow from the frequencies of the whole block. */
   virtual void doTransform(byte* source_bwt,
-                           uint32 bwt_size,
-                           const std::vector<uint32> &LFpowers);
+                           uint64 bwt_size,
+                           const std::vector<uint64> &LFpowers,
+                           const uint64 *frequencies);
+  /** Restores only the segments (starting from the LF powers) which
+   * overlap the range. Blocks larger than kMaxBlockSize don't fit in the
+   * 32-bit entries of the algorithm, and they are restored whole with
+   * FastInverseBWTransform. */
+  virtual void doTransformRange(byte* source_bwt,
+                                uint64 bwt_size,
+                                const std::vector<uint64> &LFpowers,
+                                uint64 from, uint64 to,
+                                const uint64 *frequencies);
+
+  static const uint64 kMaxBlockSize = 0x7fffffff - 2;
+
+ private:
+  ThreadPool *m_pool;
 };
 
 } //namespace bwtc
@@ -0,0 +1,349 @@
+/**
+ * @file ParallelBWT.cpp
+ * @author Pekka Mikkola <pmikkol@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This file is part of bwtc.
+ *
+ * bwtc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * bwtc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with bwtc.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Implementation of the parallel prefix doubling BWT.
+ */
+
+#include <cassert>
+#include <cstring>
+
+#include <algorithm>
+#include <vector>
+
+#include "BWTransform.hpp"
+#include "ParallelBWT.hpp"
+#include "../globaldefs.hpp"
+#include "../Profiling.hpp"
+#include "../ThreadPool.hpp"
+
+namespace bwtc {
+
+namespace {
+
+/* Buckets of the first two symbols. The second symbol of the last suffix
+ * is taken to be smaller than any symbol. */
+const uint32 kBuckets = 257*257;
+/* Each thread counting the buckets has counts of its own. Small blocks
+ * are counted by fewer threads, so that the counts don't take more memory
+ * than the block. */
+const uint32 kMaxCountingParts = 16;
+const uint64 kBytesPerCountingPart = 1 << 22;
+/* Parts of the doubling steps per thread, for balancing the work. */
+const uint32 kPartsPerThread = 4;
+
+uint32 countingParts(uint64 length) {
+  return std::min<uint64>(kMaxCountingParts, 1 + length/kBytesPerCountingPart);
+}
+
+/* Groups up to this size are sorted as pairs of key and suffix packed
+ * into 64-bit words in a buffer of the part, which is faster than
+ * fetching the keys in the comparisons. */
+const size_t kPackedGroupSize = 1 << 16;
+
+/* Flags for the positions of the suffix array. */
+const byte kGroupStart = 1;
+const byte kSortedNow = 2;
+const byte kSortedNowEnd = 4;
+
+/* Compares suffixes by the rank of the suffix h symbols later. Suffixes
+ * ending before that are the smallest. */
+class LaterRankLess {
+ public:
+  LaterRankLess(const int *rank, int h, int length)
+      : m_rank(rank), m_h(h), m_length(length) {}
+
+  int key(int suffix) const {
+    return (suffix < m_length - m_h) ? m_rank[suffix + m_h] : -1;
+  }
+
+  bool operator()(int a, int b) const { return key(a) < key(b); }
+
+ private:
+  const int *m_rank;
+  int m_h;
+  int m_length;
+};
+
+/**
+ * The suffix array is divided into groups of suffixes with equal prefixes.
+ * Rank of a suffix is the position of the first suffix of its group, and
+ * the first positions of the groups are flagged.
+ */
+class ParallelSorter {
+ public:
+  ParallelSorter(byte *text, int length, ThreadPool *pool)
+      : m_text(text), m_length(length), m_pool(pool), m_SA(length),
+        m_rank(length), m_flags(length, 0), m_h(2)
+  {
+    uint32 threads = pool ? pool->threads() : 1;
+    m_countingParts = std::min(threads, countingParts(length));
+    m_parts = threads*kPartsPerThread;
+  }
+
+  void sort();
+  /** Writes the BWT over the text in the format of the other transforms.
+   * If runs is given, the runs of the output are added to it. */
+  void writeBWT(std::vector<uint64>& LFpowers, uint32 *runs);
+
+ private:
+  uint32 bucket(int i) const {
+    uint32 second = (i + 1 < m_length) ? m_text[i + 1] + 1 : 0;
+    return (m_text[i] + 1)*257 + second;
+  }
+
+  int partBegin(uint32 part, uint32 parts) const {
+    return static_cast<int>(static_cast<uint64>(m_length)*part/parts);
+  }
+
+  void countBuckets(uint32 part);
+  void fillBuckets(uint32 part);
+  void sortGroups(uint32 part);
+  void sortPacked(int begin, int end, const LaterRankLess& less,
+                  std::vector<uint64>& packed);
+  void updateRanks(uint32 part);
+  void writePart(uint32 part);
+
+  byte *m_text;
+  int m_length;
+  ThreadPool *m_pool;
+  std::vector<int> m_SA;
+  std::vector<int> m_rank;
+  std::vector<byte> m_flags;
+  uint32 m_countingParts;
+  uint32 m_parts;
+  /* Bucket counts of the counting parts, turned into the positions where
+   * the parts put their suffixes. */
+  std::vector<uint32> m_counts;
+  std::vector<uint32> m_bucketStarts;
+  /* Parts of the doubling steps start at the groups. */
+  std::vector<int> m_bounds;
+  std::vector<byte> m_foundGroups;
+  int m_h;
+  /* For writing the BWT. */
+  byte *m_output;
+  std::vector<uint64> *m_LFpowers;
+  int m_interval;
+  /* Runs of the output counted by each part. */
+  std::vector<uint32> m_partRuns;
+};
+
+void ParallelSorter::countBuckets(uint32 part) {
+  uint32 *counts = &m_counts[part*kBuckets];
+  int end = partBegin(part + 1, m_countingParts);
+  for(int i = partBegin(part, m_countingParts); i < end; ++i)
+    ++counts[bucket(i)];
+}
+
+void ParallelSorter::fillBuckets(uint32 part) {
+  uint32 *next = &m_counts[part*kBuckets];
+  int end = partBegin(part + 1, m_countingParts);
+  for(int i = partBegin(part, m_countingParts); i < end; ++i) {
+    uint32 b = bucket(i);
+    m_SA[next[b]++] = i;
+    m_rank[i] = m_bucketStarts[b];
+  }
+}
+
+/* Sorts the groups of more than one suffix within the part. The rank
+ * array is only read, so the new ranks are set by updateRanks. */
+void ParallelSorter::sortGroups(uint32 part) {
+  LaterRankLess less(&m_rank[0], m_h, m_length);
+  std::vector<uint64> packed;
+  int end = m_bounds[part + 1];
+  for(int k = m_bounds[part]; k < end; ) {
+    int groupEnd = k + 1;
+    while(groupEnd < end && !(m_flags[groupEnd] & kGroupStart)) ++groupEnd;
+    if(groupEnd - k > 1) {
+      m_foundGroups[part] = 1;
+      if(static_cast<size_t>(groupEnd - k) <= kPackedGroupSize) {
+        sortPacked(k, groupEnd, less, packed);
+      } else {
+        std::sort(&m_SA[0] + k, &m_SA[0] + groupEnd, less);
+        for(int j = k + 1; j < groupEnd; ++j) {
+          if(less.key(m_SA[j]) != less.key(m_SA[j - 1]))
+            m_flags[j] |= kGroupStart;
+        }
+      }
+      m_flags[k] |= kSortedNow;
+      m_flags[groupEnd - 1] |= kSortedNowEnd;
+    }
+    k = groupEnd;
+  }
+}
+
+/* Keys are shifted by one so that the suffixes ending early get zero. */
+void ParallelSorter::sortPacked(int begin, int end, const LaterRankLess& less,
+                                std::vector<uint64>& packed) {
+  packed.clear();
+  for(int j = begin; j < end; ++j) {
+    uint64 key = static_cast<uint64>(less.key(m_SA[j]) + 1);
+    packed.push_back((key << 32) | static_cast<uint32>(m_SA[j]));
+  }
+  std::sort(packed.begin(), packed.end());
+  for(int j = begin; j < end; ++j) {
+    const uint64 word = packed[j - begin];
+    m_SA[j] = static_cast<int>(word & 0xffffffff);
+    if(j > begin && (word >> 32) != (packed[j - begin - 1] >> 32))
+      m_flags[j] |= kGroupStart;
+  }
+}
+
+void ParallelSorter::updateRanks(uint32 part) {
+  int end = m_bounds[part + 1];
+  for(int k = m_bounds[part]; k < end; ++k) {
+    if(!(m_flags[k] & kSortedNow)) continue;
+    int start = k;
+    for(; ; ++k) {
+      if(m_flags[k] & kGroupStart) start = k;
+      m_rank[m_SA[k]] = start;
+      bool last = (m_flags[k] & kSortedNowEnd) != 0;
+      m_flags[k] &= kGroupStart;
+      if(last) break;
+    }
+  }
+}
+
+void ParallelSorter::sort() {
+  m_counts.assign(m_countingParts*kBuckets, 0);
+  runInParts(m_pool, this, &ParallelSorter::countBuckets, m_countingParts);
+  m_bucketStarts.resize(kBuckets);
+  uint32 sum = 0;
+  for(uint32 b = 0; b < kBuckets; ++b) {
+    m_bucketStarts[b] = sum;
+    if(sum < static_cast<uint32>(m_length)) m_flags[sum] = kGroupStart;
+    for(uint32 p = 0; p < m_countingParts; ++p) {
+      uint32 count = m_counts[p*kBuckets + b];
+      m_counts[p*kBuckets + b] = sum;
+      sum += count;
+    }
+  }
+  runInParts(m_pool, this, &ParallelSorter::fillBuckets, m_countingParts);
+  std::vector<uint32>().swap(m_counts);
+  std::vector<uint32>().swap(m_bucketStarts);
+
+  m_bounds.resize(m_parts + 1);
+  for(m_h = 2; m_h < m_length; m_h *= 2) {
+    for(uint32 p = 0; p < m_parts; ++p) {
+      int k = partBegin(p, m_parts);
+      while(k < m_length && !(m_flags[k] & kGroupStart)) ++k;
+      m_bounds[p] = k;
+    }
+    m_bounds[m_parts] = m_length;
+    m_foundGroups.assign(m_parts, 0);
+    runInParts(m_pool, this, &ParallelSorter::sortGroups, m_parts);
+    if(std::count(m_foundGroups.begin(), m_foundGroups.end(), 1) == 0) break;
+    runInParts(m_pool, this, &ParallelSorter::updateRanks, m_parts);
+    /* Prefixes of length 2h are now sorted. */
+    if(m_h >= m_length - m_h) break;
+  }
+}
+
+void ParallelSorter::writePart(uint32 part) {
+  int begin = partBegin(part, m_parts), end = partBegin(part + 1, m_parts);
+  uint32 points = m_LFpowers->size();
+  uint32 *runs = m_partRuns.empty() ? 0 : &m_partRuns[part*256];
+  byte previous = 0;
+  for(int k = begin; k < end; ++k) {
+    int suffix = m_SA[k];
+    byte c = (suffix > 0) ? m_text[suffix - 1] : 0;
+    m_output[k] = c;
+    if(runs && (k == begin || c != previous)) ++runs[c];
+    previous = c;
+    if(suffix == 0) {
+      (*m_LFpowers)[0] = k;
+      continue;
+    }
+    if(points > 1 && (m_length - suffix) % m_interval == 0) {
+      uint32 i = (m_length - suffix)/m_interval;
+      if(i < points) (*m_LFpowers)[i] = k;
+    }
+  }
+}
+
+/* The BWT is written into the memory of the rank array, which is no longer
+ * needed, and then copied over the text. Each part counts its runs as if
+ * a run began at its start, which is corrected where the symbols on both
+ * sides of a part boundary are equal. */
+void ParallelSorter::writeBWT(std::vector<uint64>& LFpowers, uint32 *runs) {
+  m_output = reinterpret_cast<byte*>(&m_rank[0]);
+  m_LFpowers = &LFpowers;
+  m_interval = m_length/LFpowers.size();
+  if(runs) m_partRuns.assign(m_parts*256, 0);
+  runInParts(m_pool, this, &ParallelSorter::writePart, m_parts);
+  if(runs) {
+    for(uint32 p = 0; p < m_parts; ++p) {
+      for(int c = 0; c < 256; ++c) runs[c] += m_partRuns[p*256 + c];
+      int begin = partBegin(p, m_parts);
+      if(begin > 0 && begin < partBegin(p + 1, m_parts) &&
+         m_output[begin - 1] == m_output[begin])
+        --runs[m_output[begin]];
+    }
+    std::vector<uint32>().swap(m_partRuns);
+  }
+  std::memcpy(m_text, m_output, m_length);
+}
+
+} //anonymous namespace
+
+void ParallelBWTransform::
+doTransform(byte *begin, uint64 length, std::vector<uint64>& LFpowers) const {
+  doTransform(begin, length, LFpowers, 0);
+}
+
+void ParallelBWTransform::
+doTransform(byte *begin, uint64 length, std::vector<uint64>& LFpowers,
+            BWTStatistics *stats) const {
+  PROFILE("ParallelBWTransform::doTransform");
+  assert(canTransform(length - 1));
+  if(stats) {
+    for(uint64 i = 0; i + 1 < length; ++i) ++stats->frequencies[begin[i]];
+  }
+  ParallelSorter sorter(begin, static_cast<int>(length), m_pool);
+  sorter.sort();
+  sorter.writeBWT(LFpowers, stats ? stats->runs : 0);
+}
+
+/* Block with the sentinel and for each of its bytes a suffix array entry,
+ * a rank and a flag. Bucket starts and the bucket counts of the counting
+ * threads are freed before the doubling steps. */
+uint64 ParallelBWTransform::maxSizeInBytes(uint64 block_size) const {
+  return (block_size + 1)*(1 + 2*sizeof(int) + 1) +
+      (countingParts(block_size + 1) + 1)*kBuckets*sizeof(uint32);
+}
+
+uint64 ParallelBWTransform::maxBlockSize(uint64 memory_budget) const {
+  if(maxSizeInBytes(0) > memory_budget) return 0;
+  uint64 low = 0, high = kMaxBlockSize;
+  while(low < high) {
+    uint64 middle = low + (high - low + 1)/2;
+    if(maxSizeInBytes(middle) <= memory_budget) low = middle;
+    else high = middle - 1;
+  }
+  return low;
+}
+
+uint64 ParallelBWTransform::suggestedBlockSize(uint64 memory_budget) const {
+  return maxBlockSize(memory_budget);
+}
+
+} //namespace bwtc
@@ -0,0 +1,69 @@
+/**
+ * @file ParallelBWT.hpp
+ * @author Pekka Mikkola <pmikkol@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This file is part of bwtc.
+ *
+ * bwtc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * bwtc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with bwtc.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Header for the Burrows-Wheeler transform which sorts the suffixes of a
+ * block in the threads of the thread pool.
+ */
+
+#ifndef BWTC_PARALLEL_BWT_HPP_
+#define BWTC_PARALLEL_BWT_HPP_
+
+#include <vector>
+
+#include "BWTransform.hpp"
+#include "../globaldefs.hpp"
+
+namespace bwtc {
+
+/**
+ * BWT by prefix doubling where every step runs in parallel. Suffixes are
+ * first bucketed by their first two symbols with a counting sort, which is
+ * split between the threads. Then the groups of suffixes with equal
+ * prefixes of length h are sorted by the rank of the suffix h symbols
+ * later, which doubles the length of the sorted prefixes. The groups are
+ * divided into parts which are sorted concurrently in the slots of the
+ * thread pool.
+ *
+ * Unlike block-level parallelism this speeds up a single large block, but
+ * it takes twice the memory of divsufsort and more time on one thread.
+ */
+class ParallelBWTransform : public BWTransform {
+ public:
+  ParallelBWTransform() {}
+  virtual ~ParallelBWTransform() {}
+
+  void
+  doTransform(byte *begin, uint64 length, std::vector<uint64>& LFpowers) const;
+
+  void
+  doTransform(byte *begin, uint64 length, std::vector<uint64>& LFpowers,
+              BWTStatistics* stats) const;
+
+  virtual uint64 maxSizeInBytes(uint64 block_size) const;
+  virtual uint64 maxBlockSize(uint64 memory_budget) const;
+  virtual uint64 suggestedBlockSize(uint64 memory_budget) const;
+};
+
+} // namespace bwtc
+
+#endif
@@ -26,6 +26,9 @@
 
 #include <cassert>
 
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
 #include <vector>
 
 #include "BWTransform.hpp"
@@ -36,21 +39,110 @@
 
 namespace bwtc {
 
+namespace {
+
+/* Memory model of the transform with suffix array of index_size bytes per
+ * entry. The block with the sentinel and the suffix array of the block and
+ * the sentinel take (1 + index_size)(n+1) bytes. The four bucket arrays of
+ * the first level (C, B and D of sais.hxx) are allocated separately. The
+ * bucket arrays of the recursion levels are placed in the unused part of
+ * the suffix array when they fit, which is the case for typical data.
+ * Otherwise up to two arrays of one entry per name are allocated, and there
+ * are at most (n+2)/2 names for the n+1 suffixes. */
+uint64 bytesPerSymbol(uint64 index_size) {
+  return 1 + 2*index_size;
+}
+
+uint64 fixedBytes(uint64 index_size) {
+  return 1 + 3*index_size + 4*256*index_size;
+}
+
+/* Reverse of text[0..length-1) followed by 0, read from the text as it
+ * is. The algorithm only accesses the string by indexing. */
+class ReversedText {
+ public:
+  typedef std::random_access_iterator_tag iterator_category;
+  typedef byte value_type;
+  typedef std::ptrdiff_t difference_type;
+  typedef const byte* pointer;
+  typedef const byte& reference;
+
+  ReversedText(const byte *text, uint64 length)
+      : m_text(text), m_size(length - 1) {}
+
+  byte operator[](int64 i) const {
+    return (static_cast<uint64>(i) < m_size) ? m_text[m_size - 1 - i] : 0;
+  }
+
+ private:
+  const byte *m_text;
+  uint64 m_size;
+};
+
+template <typename Index, typename Text>
+void transform(Text text, uint64 length, byte *output,
+               std::vector<uint64>& LFpowers, BWTStatistics *stats)
+{
+  std::vector<Index> SA(length);
+  Index n = static_cast<Index>(length);
+  if(stats) {
+    saisxx_bwt(text, output, &SA[0], n, LFpowers, static_cast<Index>(256),
+               stats->frequencies, stats->runs);
+  } else {
+    saisxx_bwt(text, output, &SA[0], n, LFpowers, static_cast<Index>(256));
+  }
+}
+
+} //anonymous namespace
+
 SAISBWTransform::SAISBWTransform() {}
 
 void SAISBWTransform::
-doTransform(byte *begin, uint32 length, std::vector<uint32>& LFpowers) const {
-  PROFILE("SAISBWTransform::doTransform");
-  std::vector<int> SA(length);
-  saisxx_bwt(begin, begin, &SA[0], (int)length, LFpowers);
+doTransform(byte *begin, uint64 length, std::vector<uint64>& LFpowers) const {
+  doTransform(begin, length, LFpowers, 0);
 }
 
 void SAISBWTransform::
-doTransform(byte *begin, uint32 length, std::vector<uint32>& LFpowers,
-            uint32 *freqs) const {
+doTransform(byte *begin, uint64 length, std::vector<uint64>& LFpowers,
+            BWTStatistics *stats) const {
   PROFILE("SAISBWTransform::doTransform");
-  std::vector<int> SA(length);
-  saisxx_bwt(begin, begin, &SA[0], (int)length, LFpowers, 256, freqs);
+  assert(canTransform(length - 1));
+  if(length - 1 <= kMaxBlockSize)
+    transform<int>(begin, length, begin, LFpowers, stats);
+  else
+    transform<int64>(begin, length, begin, LFpowers, stats);
+}
+
+void SAISBWTransform::
+doTransformReversed(const byte *text, uint64 length, byte *output,
+                    std::vector<uint64>& LFpowers,
+                    BWTStatistics *stats) const {
+  PROFILE("SAISBWTransform::doTransformReversed");
+  assert(canTransform(length - 1));
+  ReversedText reversed(text, length);
+  if(length - 1 <= kMaxBlockSize)
+    transform<int>(reversed, length, output, LFpowers, stats);
+  else
+    transform<int64>(reversed, length, output, LFpowers, stats);
+}
+
+uint64 SAISBWTransform::maxSizeInBytes(uint64 block_size) const {
+  uint64 index = (block_size <= kMaxBlockSize) ? sizeof(int) : sizeof(int64);
+  return block_size*bytesPerSymbol(index) + fixedBytes(index);
+}
+
+uint64 SAISBWTransform::maxBlockSize(uint64 memory_budget) const {
+  if(memory_budget < fixedBytes(sizeof(int))) return 0;
+  uint64 n = (memory_budget - fixedBytes(sizeof(int)))/
+      bytesPerSymbol(sizeof(int));
+  if(n <= kMaxBlockSize) return n;
+  /* Blocks above kMaxBlockSize take more memory per byte. */
+  n = (memory_budget - fixedBytes(sizeof(int64)))/bytesPerSymbol(sizeof(int64));
+  return std::max(n, kMaxBlockSize);
+}
+
+uint64 SAISBWTransform::suggestedBlockSize(uint64 memory_budget) const {
+  return std::min(maxBlockSize(memory_budget), kMaxLargeBlockSize);
 }
 
 } //namespace bwtc
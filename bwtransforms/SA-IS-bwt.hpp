@@ -54,17 +54,28 @@ class SAISBWTransform : public BWTransform {
   SAISBWTransform();
   virtual ~SAISBWTransform() {}
   void
-  doTransform(byte *begin, uint32 length, std::vector<uint32>& LFpowers) const;
+  doTransform(byte *begin, uint64 length, std::vector<uint64>& LFpowers) const;
 
   void
-  doTransform(byte *begin, uint32 length, std::vector<uint32>& LFpowers,
-              uint32* freqs) const;
+  doTransform(byte *begin, uint64 length, std::vector<uint64>& LFpowers,
+              BWTStatistics* stats) const;
 
-  /* The following values aren't correct */
-  virtual uint64 maxSizeInBytes(uint64) const { return 0; }
-  virtual uint64 maxBlockSize(uint64) const { return 0; }
-  virtual uint64 suggestedBlockSize(uint64) const { return 0; }
-  
+  /**Reads the text in reverse order while sorting, so it is not reversed
+   * beforehand and stays as it is unless it is also the output. */
+  void
+  doTransformReversed(const byte *text, uint64 length, byte *output,
+                      std::vector<uint64>& LFpowers,
+                      BWTStatistics* stats) const;
+
+  /**Blocks larger than kMaxBlockSize are transformed with a suffix array of
+   * 64-bit integers. */
+  virtual bool canTransform(uint64 block_size) const {
+    return block_size <= kMaxLargeBlockSize;
+  }
+
+  virtual uint64 maxSizeInBytes(uint64 block_size) const;
+  virtual uint64 maxBlockSize(uint64 memory_budget) const;
+  virtual uint64 suggestedBlockSize(uint64 memory_budget) const;
 };
 } // namespace bwtc
 
@@ -0,0 +1,256 @@
+/**
+ * @file SampledInverseBWT.cpp
+ * @author Pekka Mikkola <pmikkol@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This file is part of bwtc.
+ *
+ * bwtc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * bwtc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with bwtc.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Implementation for the inverse of BWT using sampled ranks.
+ */
+
+#include <cassert>
+
+#include <algorithm>
+#include <vector>
+
+#include "../globaldefs.hpp"
+#include "../ThreadPool.hpp"
+#include "SampledInverseBWT.hpp"
+#include "../Profiling.hpp"
+
+namespace bwtc {
+
+namespace {
+
+const uint64 kMaxSmallBlock = 0xffffffff;
+
+inline uint64 countSize(uint64 bwt_size) {
+  return bwt_size > kMaxSmallBlock ? sizeof(uint64) : sizeof(uint32);
+}
+
+// Number of occurrences of c in [begin, end), at most 255 bytes. The count
+// fits in a byte, which lets the compiler compare many bytes at a time.
+inline byte shortOccurrences(const byte *begin, const byte *end, byte c) {
+  byte count = 0;
+  for (; begin != end; ++begin) count += (*begin == c);
+  return count;
+}
+
+// Number of occurrences of c in [begin, end).
+inline uint32 occurrences(const byte *begin, const byte *end, byte c) {
+  uint32 count = 0;
+  for (; end - begin > 255; begin += 255)
+    count += shortOccurrences(begin, begin + 255, c);
+  return count + shortOccurrences(begin, end, c);
+}
+
+// Restores the text segments starting from the LF powers. The counts of
+// the symbols before each checkpoint are of type Count, which has to hold
+// the size of the BWT.
+template <typename Count>
+class SampledRestoration {
+ public:
+  SampledRestoration(byte *bwt, uint64 bwt_size,
+                     const std::vector<uint64>& LFpowers, uint64 interval)
+      : m_result(bwt), m_bwt(bwt, bwt + bwt_size), m_size(bwt_size),
+        m_LFpowers(LFpowers), m_eob(LFpowers[0]), m_eob_byte(bwt[m_eob]),
+        m_shift(0), m_last_checkpoint(0), m_streams(LFpowers.size()),
+        m_segment_size(0), m_first(0), m_last(0), m_groups(1)
+  {
+    while ((static_cast<uint64>(1) << m_shift) < interval) ++m_shift;
+    m_last_checkpoint = m_size >> m_shift;
+    m_checkpoints.resize((m_last_checkpoint + 1) << 8);
+
+    // The checkpoints count the byte in the EOB position like the others,
+    // it is subtracted from the ranks after the position.
+    Count counts[256] = {0};
+    for (uint64 k = 0; k <= m_last_checkpoint; ++k) {
+      std::copy(counts, counts + 256, &m_checkpoints[k << 8]);
+      uint64 end = std::min(m_size, (k + 1) << m_shift);
+      for (uint64 position = k << m_shift; position < end; ++position)
+        ++counts[m_bwt[position]];
+    }
+    --counts[m_eob_byte];
+    // m_count[c] is the total number of characters smaller than c
+    // (including the single EOB symbol).
+    m_count[0] = 1;
+    for (uint32 c = 1; c < 256; ++c)
+      m_count[c] = m_count[c - 1] + counts[c - 1];
+    assert(m_count[255] + counts[255] == m_size);
+
+    m_segment_size = m_size / m_streams;
+    if (m_segment_size <= 1) {
+      m_streams = 1;
+      m_segment_size = m_size;
+    }
+  }
+
+  // Restores the segments overlapping the range [from, to) of the text.
+  void restore(uint64 from, uint64 to, ThreadPool* pool) {
+    // Segment i restores the text from position i * m_segment_size - 1
+    // onwards (the first one from 0), and the last one up to the end.
+    m_first = std::min((from + 1) / m_segment_size, m_streams - 1);
+    m_last = std::min(to / m_segment_size, m_streams - 1) + 1;
+    uint64 threads = pool ? pool->threads() : 1;
+    m_groups = std::max<uint64>(1, std::min(threads, m_last - m_first));
+    runInParts(pool, this, &SampledRestoration::restoreGroup, m_groups);
+  }
+
+ private:
+  // The walks of the group take steps in turns, so that the memory accesses
+  // of the walks overlap. In each turn the symbols at the positions of the
+  // walks are read and the checkpoints of their ranks prefetched, and then
+  // the next positions are counted and prefetched.
+  void restoreGroup(uint32 group) {
+    uint64 segments = m_last - m_first;
+    uint64 first = m_first + (group * segments) / m_groups;
+    uint64 walks = m_first + ((group + 1) * segments) / m_groups - first;
+    std::vector<uint64> positions(walks), indices(walks), ends(walks);
+    std::vector<byte> chars(walks);
+    uint64 steps = m_size;
+    for (uint64 j = 0; j < walks; ++j) {
+      uint64 i = first + j;
+      indices[j] = (i == 0) ? 0 : i * m_segment_size - 1;
+      ends[j] = (i + 1 < m_streams) ? (i + 1) * m_segment_size - 1
+                                    : m_size - 1;
+      positions[j] = (i == 0) ? 0 : m_LFpowers[i];
+      steps = std::min(steps, ends[j] - indices[j]);
+    }
+    for (uint64 step = 0; step < steps; ++step) {
+      for (uint64 j = 0; j < walks; ++j) {
+        chars[j] = m_bwt[positions[j]];
+        BWTC_PREFETCH(&m_checkpoints[(checkpoint(positions[j]) << 8) +
+                                     chars[j]]);
+      }
+      for (uint64 j = 0; j < walks; ++j) {
+        m_result[indices[j]++] = chars[j];
+        positions[j] = next(positions[j], chars[j]);
+        BWTC_PREFETCH(&m_bwt[positions[j]]);
+      }
+    }
+    // Segments have different lengths, the rest of them are restored one
+    // at a time.
+    for (uint64 j = 0; j < walks; ++j) {
+      while (indices[j] < ends[j]) {
+        byte c = m_bwt[positions[j]];
+        m_result[indices[j]++] = c;
+        positions[j] = next(positions[j], c);
+      }
+    }
+  }
+
+  // Index of the checkpoint nearest to the position.
+  uint64 checkpoint(uint64 position) const {
+    return std::min((position + (1 << (m_shift - 1))) >> m_shift,
+                    m_last_checkpoint);
+  }
+
+  // Returns the position following the position of symbol c in the walk.
+  // The rank is counted from the nearest checkpoint.
+  uint64 next(uint64 position, byte c) const {
+    const byte *bwt = &m_bwt[0];
+    uint64 k = checkpoint(position);
+    uint64 checkpoint_position = k << m_shift;
+    uint64 rank = m_checkpoints[(k << 8) + c];
+    if (checkpoint_position <= position)
+      rank += occurrences(bwt + checkpoint_position, bwt + position, c);
+    else
+      rank -= occurrences(bwt + position, bwt + checkpoint_position, c);
+    if (m_eob < position && c == m_eob_byte) --rank;
+    return m_count[c] + rank;
+  }
+
+  byte *m_result;
+  // The result overwrites the BWT, so the walks use a copy of it.
+  std::vector<byte> m_bwt;
+  // m_checkpoints[(k << 8) + c] is the number of occurrences of c in
+  // m_bwt[0..(k << m_shift) - 1].
+  std::vector<Count> m_checkpoints;
+  uint64 m_count[256];
+  uint64 m_size;
+  const std::vector<uint64>& m_LFpowers;
+  uint64 m_eob;
+  byte m_eob_byte;
+  uint32 m_shift;
+  uint64 m_last_checkpoint;
+  uint64 m_streams;
+  uint64 m_segment_size;
+  uint64 m_first;
+  uint64 m_last;
+  uint64 m_groups;
+};
+
+} //anonymous namespace
+
+uint64 SampledInverseBWTransform::
+memoryUsage(uint64 bwt_size, uint64 interval) {
+  return bwt_size + (bwt_size / interval + 1) * 256 * countSize(bwt_size);
+}
+
+uint64 SampledInverseBWTransform::interval(uint64 bwt_size) const {
+  uint64 result = kMinInterval;
+  if (m_memoryBudget == 0) return result;
+  while (result < kMaxInterval &&
+         memoryUsage(bwt_size, result) > m_memoryBudget)
+    result <<= 1;
+  return result;
+}
+
+uint64 SampledInverseBWTransform::maxSizeInBytes(uint64 block_size) const {
+  return memoryUsage(block_size + 1, interval(block_size + 1));
+}
+
+uint64 SampledInverseBWTransform::maxBlockSize(uint64 memory_budget) const {
+  // With kMaxInterval the transform uses at most 1.25n + 1024 bytes, or
+  // 1.5n + 2048 bytes when the counts are 64-bit.
+  if (memory_budget <= 4096) return 0;
+  uint64 size = (memory_budget - 2048) / 5 * 4;
+  if (size > kMaxSmallBlock)
+    size = std::max(kMaxSmallBlock, (memory_budget - 4096) / 3 * 2);
+  return size - 1;
+}
+
+void SampledInverseBWTransform::doTransform(
+    byte* bwt, uint64 bwt_size, const std::vector<uint64>& LFpowers,
+    const uint64 *frequencies)
+{
+  doTransformRange(bwt, bwt_size, LFpowers, 0, bwt_size - 1, frequencies);
+}
+
+void SampledInverseBWTransform::doTransformRange(
+    byte* bwt, uint64 bwt_size, const std::vector<uint64>& LFpowers,
+    uint64 from, uint64 to, const uint64 *frequencies)
+{
+  (void) frequencies;
+  PROFILE("SampledInverseBWTransform::doTransform");
+  assert(bwt_size >= 2);
+  assert(from < to && to < bwt_size);
+  assert(LFpowers.size() > 0);
+  // If the BWT or the EOB position contain errors (or are garbage),
+  // the walks restore garbage.
+  if (bwt_size > kMaxSmallBlock) {
+    SampledRestoration<uint64>(bwt, bwt_size, LFpowers, interval(bwt_size)).
+        restore(from, to, m_pool);
+  } else {
+    SampledRestoration<uint32>(bwt, bwt_size, LFpowers, interval(bwt_size)).
+        restore(from, to, m_pool);
+  }
+}
+
+} //namespace bwtc
@@ -0,0 +1,92 @@
+/**
+ * @file SampledInverseBWT.hpp
+ * @author Pekka Mikkola <pmikkol@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This file is part of bwtc.
+ *
+ * bwtc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * bwtc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with bwtc.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Header for the inverse of BWT using sampled ranks.
+ */
+
+#ifndef BWTC_SAMPLED_INVERSE_BWT_HPP_
+#define BWTC_SAMPLED_INVERSE_BWT_HPP_
+
+#include <vector>
+
+#include "../globaldefs.hpp"
+#include "../ThreadPool.hpp"
+#include "InverseBWT.hpp"
+
+namespace bwtc {
+
+/**
+ * Inverse Burrows-Wheeler transform for small memory budgets. Instead of
+ * storing the rank of each position, the counts of all symbols are stored
+ * only at checkpoints every interval:th position of a copy of the BWT, and
+ * a rank is counted by scanning the BWT from the nearer checkpoint. The
+ * interval is the smallest power of two between kMinInterval and
+ * kMaxInterval, with which the copy and the checkpoints fit in the memory
+ * budget. With kMaxInterval the transform uses roughly 1.25n bytes in
+ * addition to the block.
+ *
+ * The text is restored in segments starting from the LF powers, as in
+ * MtlSaInverseBWTransform, and with a thread pool the segments are divided
+ * into groups restored in separate tasks. The walks of a group take turns as
+ * in FastInverseBWTransform.
+ */
+class SampledInverseBWTransform : public InverseBWTransform {
+ public:
+  /** Memory budget of 0 means no limit. */
+  explicit SampledInverseBWTransform(uint64 memoryBudget,
+                                     ThreadPool* pool = 0)
+      : m_memoryBudget(memoryBudget), m_pool(pool) {}
+  virtual ~SampledInverseBWTransform() {}
+  /** With the interval chosen for the block in the memory budget. */
+  virtual uint64 maxSizeInBytes(uint64 block_size) const;
+  virtual uint64 maxBlockSize(uint64 memory_budget) const;
+  /** Frequencies are ignored, as they are counted in the same pass as the
+   * checkpoints. */
+  virtual void doTransform(byte* source_bwt,
+                           uint64 bwt_size,
+                           const std::vector<uint64>& LFpowers,
+                           const uint64 *frequencies);
+  /** Restores only the segments overlapping the range. */
+  virtual void doTransformRange(byte* source_bwt,
+                                uint64 bwt_size,
+                                const std::vector<uint64>& LFpowers,
+                                uint64 from, uint64 to,
+                                const uint64 *frequencies);
+
+  /** Checkpoint interval used for BWT of the given size. */
+  uint64 interval(uint64 bwt_size) const;
+
+  /** Bytes used in addition to the block with the given interval. */
+  static uint64 memoryUsage(uint64 bwt_size, uint64 interval);
+
+  static const uint64 kMinInterval = 256;
+  static const uint64 kMaxInterval = 4096;
+
+ private:
+  uint64 m_memoryBudget;
+  ThreadPool *m_pool;
+};
+
+} //namespace bwtc
+
+#endif
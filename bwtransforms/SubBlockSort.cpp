@@ -0,0 +1,134 @@
+/**
+ * @file SubBlockSort.cpp
+ * @author Pekka Mikkola <pmikkol@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This file is part of bwtc.
+ *
+ * bwtc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * bwtc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with bwtc.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Implementation of sorting the suffixes of a sub-block in the context of
+ * the text following it.
+ */
+
+#include <cassert>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "SubBlockSort.hpp"
+#include "sais.hxx"
+#include "../globaldefs.hpp"
+
+namespace bwtc {
+
+namespace {
+
+/* Symbol c of a sub-block is mapped to 3c+1 or 3c+3 and the text following
+ * the sub-block to 3c+2 or 0. */
+const int kAlphabet = 3*256 + 1;
+
+} //anonymous namespace
+
+void zArray(const byte* text, uint64 length, uint64 count,
+            std::vector<uint32>& Z) {
+  assert(count <= length);
+  Z.resize(count);
+  if(count == 0) return;
+  Z[0] = length;
+  uint64 left = 0, right = 0;
+  for(uint64 i = 1; i < count; ++i) {
+    uint64 z = (i < right) ? std::min<uint64>(Z[i - left], right - i) : 0;
+    while(i + z < length && text[z] == text[i + z]) ++z;
+    Z[i] = z;
+    if(i + z > right) { left = i; right = i + z; }
+  }
+}
+
+/* Greater-bit of a suffix of B is found by comparing it to the beginning
+ * of T using the Z-array of T. If the suffix is a prefix of T, the
+ * comparison continues between T and a suffix of T, which is the opposite
+ * of the greater-bit of that suffix. */
+void greaterBits(const byte* B, uint64 length, const std::vector<uint32>& Z,
+                 const std::vector<bool>& selfGreater,
+                 std::vector<bool>& greater) {
+  const byte *T = B + length;
+  greater.assign(length, false);
+  uint64 left = 0, right = 0;
+  for(uint64 i = 0; i < length; ++i) {
+    uint64 z = (i < right) ? std::min<uint64>(Z[i - left], right - i) : 0;
+    while(i + z < length && B[i + z] == T[z]) ++z;
+    if(i + z > right) { left = i; right = i + z; }
+    if(i + z == length) greater[i] = !selfGreater[length - i];
+    else greater[i] = B[i + z] > T[z];
+  }
+}
+
+/* Suffixes of B are compared in the context of T. If a suffix of B is a
+ * prefix of another, the comparison continues from T and some suffix of
+ * B, which is decided by the greater-bit of that suffix. Thus B is sorted
+ * as a string of symbols 3c+1+2g, where g is the greater-bit, followed by
+ * symbol 3T[0]+2 for T (or 0 if T is empty).
+ * Two symbols with equal c and different greater-bits compare as the
+ * suffixes starting from them, because T is between the suffixes. */
+SortedSubBlock::
+SortedSubBlock(const byte* B, uint64 length, const std::vector<bool>& greater,
+               byte before, std::vector<std::pair<uint64, uint64> >& points)
+    : m_length(length), m_rows(length + 1), m_following(0), m_first(0),
+      m_greater(length + 1)
+{
+  assert(greater.empty() || greater.size() == length);
+  std::vector<int> SA(length + 1);
+  {
+    std::vector<uint16> X(length + 1);
+    for(uint64 i = 0; i < length; ++i) {
+      bool g = greater.empty() || greater[i];
+      X[i] = 3*B[i] + (g ? 3 : 1);
+    }
+    X[length] = greater.empty() ? 0 : 3*B[length] + 2;
+    saisxx(&X[0], &SA[0], static_cast<int>(length + 1), kAlphabet);
+  }
+  for(uint64 i = 0; i <= length; ++i) {
+    if(static_cast<uint64>(SA[i]) == length) m_following = i;
+    if(SA[i] == 0) m_first = i;
+  }
+  std::vector<bool> isPoint(length, false);
+  for(size_t j = 0; j < points.size(); ++j) isPoint[points[j].first] = true;
+  for(uint64 i = 0; i <= length; ++i) {
+    uint64 suffix = SA[i];
+    m_rows[i] = (suffix > 0) ? B[suffix - 1] : before;
+    if(suffix > 0) m_greater[suffix] = i > m_first;
+    if(suffix == length || !isPoint[suffix]) continue;
+    for(size_t j = 0; j < points.size(); ++j) {
+      if(points[j].first == suffix) points[j].second = i - (i > m_following);
+    }
+  }
+  std::vector<int>().swap(SA);
+
+  m_occ.resize((length + 1)/kOccInterval*256 + 256);
+  std::fill(m_C, m_C + 257, 0);
+  for(uint64 i = 0; i <= length + 1; ++i) {
+    if(i % kOccInterval == 0) {
+      for(int c = 0; c < 256; ++c) m_occ[i/kOccInterval*256 + c] = m_C[c + 1];
+    }
+    if(i <= length && i != m_first) ++m_C[m_rows[i] + 1];
+  }
+  for(int c = 0; c < 256; ++c) m_C[c + 1] += m_C[c];
+}
+
+} //namespace bwtc
@@ -0,0 +1,123 @@
+/**
+ * @file SubBlockSort.hpp
+ * @author Pekka Mikkola <pmikkol@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This file is part of bwtc.
+ *
+ * bwtc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * bwtc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with bwtc.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Header for sorting the suffixes of a sub-block in the context of the
+ * text following it. Shared by the transforms which build the BWT of a
+ * block by merging the rows of its sub-blocks.
+ */
+
+#ifndef BWTC_SUB_BLOCK_SORT_HPP_
+#define BWTC_SUB_BLOCK_SORT_HPP_
+
+#include <utility>
+#include <vector>
+
+#include "../globaldefs.hpp"
+
+namespace bwtc {
+
+/** Z[i] = lcp(text[i..length), text[0..length)) for 0 <= i < count. */
+void zArray(const byte* text, uint64 length, uint64 count,
+            std::vector<uint32>& Z);
+
+/**
+ * Greater-bits of the suffixes of sub-block B = text[0..length) followed by
+ * non-empty text T: bit i tells whether B[i..]T > T. Z is the Z-array of T
+ * for at least length offsets, and selfGreater[d] tells whether T[d..] > T
+ * for 1 <= d <= length.
+ */
+void greaterBits(const byte* B, uint64 length, const std::vector<uint32>& Z,
+                 const std::vector<bool>& selfGreater,
+                 std::vector<bool>& greater);
+
+/**
+ * Suffixes of sub-block B sorted in the context of the text T following
+ * it. The rows are those of the suffixes of B and of T itself. Only the
+ * symbols of the rows and their counts are kept, which are enough for
+ * LF-mapping the suffixes of T to their places among the suffixes of B.
+ */
+class SortedSubBlock {
+ public:
+  /**
+   * Sorts B = text[0..length). T starts from text[length] and greater holds
+   * the greater-bits of the suffixes of B, or is empty if T is empty.
+   * before is the symbol preceding B. For each pair in points the rank of
+   * the suffix at the offset given in first is stored to second.
+   */
+  SortedSubBlock(const byte* B, uint64 length,
+                 const std::vector<bool>& greater, byte before,
+                 std::vector<std::pair<uint64, uint64> >& points);
+
+  uint64 length() const { return m_length; }
+
+  /** Number of suffixes of B smaller than cZ, when rows is the number of
+   * rows smaller than Z. The symbols are counted from the nearer one of
+   * the surrounding checkpoints. */
+  uint64 lf(byte c, uint64 rows) const {
+    uint64 base = rows/kOccInterval*kOccInterval;
+    const byte *L = &m_rows[0];
+    uint32 rank;
+    if(rows - base > kOccInterval/2 && base + kOccInterval <= m_length + 1) {
+      uint64 end = base + kOccInterval;
+      rank = m_occ[(base/kOccInterval + 1)*256 + c];
+      for(const byte *i = L + rows; i < L + end; ++i) rank -= (*i == c);
+      if(rows <= m_first && m_first < end && L[m_first] == c) ++rank;
+    } else {
+      rank = m_occ[base/kOccInterval*256 + c];
+      for(const byte *i = L + base; i < L + rows; ++i) rank += (*i == c);
+      if(base <= m_first && m_first < rows && L[m_first] == c) --rank;
+    }
+    return m_C[c] + rank;
+  }
+
+  /** Symbol preceding the suffix of B with the given rank. */
+  byte symbol(uint64 rank) const {
+    return m_rows[rank + (rank >= m_following)];
+  }
+
+  /** Number of suffixes of B smaller than T. */
+  uint64 following() const { return m_following; }
+
+  /** Rank of the whole B among its suffixes. */
+  uint64 firstRank() const { return m_first - (m_first > m_following); }
+
+  /** Tells whether (BT)[d..] > BT for 1 <= d <= length. */
+  const std::vector<bool>& greater() const { return m_greater; }
+
+  static const uint64 kOccInterval = 256;
+
+ private:
+  uint64 m_length;
+  std::vector<byte> m_rows;
+  /* Symbol counts before every kOccInterval:th row. The row of the whole
+   * B has the symbol before B, which is not counted. */
+  std::vector<uint32> m_occ;
+  uint64 m_C[257];
+  uint64 m_following;
+  uint64 m_first;
+  std::vector<bool> m_greater;
+};
+
+} //namespace bwtc
+
+#endif
@@ -34,12 +34,13 @@
 
 /*- Private Functions -*/
 
-/* Sorts suffixes of type B*. */
+/* Sorts suffixes of type B*. With OpenMP the type B* substrings are sorted
+   using the given number of threads (the default of OpenMP if threads <= 0). */
 static
 saidx_t
 sort_typeBstar(const sauchar_t *T, saidx_t *SA,
                saidx_t *bucket_A, saidx_t *bucket_B,
-               saidx_t n) {
+               saidx_t n, saint_t threads) {
   saidx_t *PAb, *ISAb, *buf;
 #ifdef _OPENMP
   saidx_t *curbuf;
@@ -103,10 +104,10 @@ note:
 
     /* Sort the type B* substrings using sssort. */
 #ifdef _OPENMP
-    tmp = omp_get_max_threads();
-    buf = SA + m, bufsize = (n - (2 * m)) / tmp;
+    if(threads <= 0) { threads = omp_get_max_threads(); }
+    buf = SA + m, bufsize = (n - (2 * m)) / threads;
     c0 = ALPHABET_SIZE - 2, c1 = ALPHABET_SIZE - 1, j = m;
-#pragma omp parallel default(shared) private(curbuf, k, l, d0, d1, tmp)
+#pragma omp parallel num_threads(threads) default(shared) private(curbuf, k, l, d0, d1, tmp)
     {
       tmp = omp_get_thread_num();
       curbuf = buf + tmp * bufsize;
@@ -132,6 +133,7 @@ note:
       }
     }
 #else
+    (void)threads;
     buf = SA + m, bufsize = n - (2 * m);
     for(c0 = ALPHABET_SIZE - 2, j = m; 0 < j; --c0) {
       for(c1 = ALPHABET_SIZE - 1; c0 < c1; j = i, --c1) {
@@ -425,7 +427,7 @@ divsufsort(const sauchar_t *T, saidx_t *SA, saidx_t n) {
 
   /* Suffixsort. */
   if((bucket_A != NULL) && (bucket_B != NULL)) {
-    m = sort_typeBstar(T, SA, bucket_A, bucket_B, n);
+    m = sort_typeBstar(T, SA, bucket_A, bucket_B, n, 0);
     construct_SA(T, SA, bucket_A, bucket_B, n, m);
   } else {
     err = -2;
@@ -439,7 +441,7 @@ divsufsort(const sauchar_t *T, saidx_t *SA, saidx_t n) {
 
 saidx_t
 divbwt(const sauchar_t *T, sauchar_t *U, saidx_t *A, saidx_t n,
-       unsigned *LFpowers, unsigned nLFpowers) {
+       unsigned *LFpowers, unsigned nLFpowers, saint_t threads) {
   saidx_t *B;
   saidx_t *bucket_A, *bucket_B;
   saidx_t m, pidx, i;
@@ -454,7 +456,7 @@ divbwt(const sauchar_t *T, sauchar_t *U, saidx_t *A, saidx_t n,
 
   /* Burrows-Wheeler Transform. */
   if((B != NULL) && (bucket_A != NULL) && (bucket_B != NULL)) {
-    m = sort_typeBstar(T, B, bucket_A, bucket_B, n);
+    m = sort_typeBstar(T, B, bucket_A, bucket_B, n, threads);
     if(nLFpowers > 1) {
       pidx = construct_BWT(T, B, bucket_A, bucket_B, n, m, LFpowers, nLFpowers);
       LFpowers[0] = pidx;
@@ -479,14 +481,15 @@ divbwt(const sauchar_t *T, sauchar_t *U, saidx_t *A, saidx_t n,
 
 saidx_t
 divbwtf(const sauchar_t *T, sauchar_t *U, saidx_t *A, saidx_t n,
-        unsigned *LFpowers, unsigned nLFpowers, unsigned freqs[256]) {
+        unsigned *LFpowers, unsigned nLFpowers, unsigned freqs[256],
+        unsigned runs[256], saint_t threads) {
   saidx_t *B;
   saidx_t *bucket_A, *bucket_B;
   saidx_t m, pidx, i;
 
   /* Check arguments. */
   if((T == NULL) || (U == NULL) || (n < 0)) { return -1; }
-  else if(n <= 1) { if(n == 1) { U[0] = T[0]; } return n; }
+  else if(n <= 1) { if(n == 1) { U[0] = T[0]; ++runs[U[0]]; } return n; }
 
   if((B = A) == NULL) { B = (saidx_t *)malloc((size_t)(n + 1) * sizeof(saidx_t)); }
   bucket_A = (saidx_t *)malloc(BUCKET_A_SIZE * sizeof(saidx_t));
@@ -494,7 +497,7 @@ divbwtf(const sauchar_t *T, sauchar_t *U, saidx_t *A, saidx_t n,
 
   /* Burrows-Wheeler Transform. */
   if((B != NULL) && (bucket_A != NULL) && (bucket_B != NULL)) {
-    m = sort_typeBstar(T, B, bucket_A, bucket_B, n);
+    m = sort_typeBstar(T, B, bucket_A, bucket_B, n, threads);
     if(nLFpowers > 1) {
       pidx = construct_BWT(T, B, bucket_A, bucket_B, n, m, LFpowers, nLFpowers);
       LFpowers[0] = pidx;
@@ -509,6 +512,7 @@ divbwtf(const sauchar_t *T, sauchar_t *U, saidx_t *A, saidx_t n,
         U[i] = (sauchar_t)B[i];
         ++freqs[U[i]];
       }
+      if((i == 0) || (U[i] != U[i - 1])) { ++runs[U[i]]; }
     }
   } else {
     pidx = -2;
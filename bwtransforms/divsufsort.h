@@ -81,17 +81,25 @@ divsufsort(const sauchar_t *T, saidx_t *SA, saidx_t n);
  * @param U[0..n-1] The output string. (can be T)
  * @param A[0..n-1] The temporary array. (can be NULL)
  * @param n The length of the given string.
+ * @param threads Number of threads used for sorting when compiled with
+ *        OpenMP (<= 0 for the default of OpenMP). Ignored otherwise.
  * @return The primary index if no error occurred, -1 or -2 otherwise.
  */
 DIVSUFSORT_API
 saidx_t
 divbwt(const sauchar_t *T, sauchar_t *U, saidx_t *A, saidx_t n,
-       unsigned *LFpowers, unsigned nLFpowers);
+       unsigned *LFpowers, unsigned nLFpowers, saint_t threads);
 
+/**
+ * As divbwt, but adds the frequencies of the symbols of T[0..n-2] to
+ * freqs and the runs of each symbol in U, as written, to runs. U[pidx]
+ * is left untouched and counted as it is.
+ */
 DIVSUFSORT_API
 saidx_t
 divbwtf(const sauchar_t *T, sauchar_t *U, saidx_t *A, saidx_t n,
-        unsigned *LFpowers, unsigned nLFpowers, unsigned *freqs);
+        unsigned *LFpowers, unsigned nLFpowers, unsigned *freqs,
+        unsigned *runs, saint_t threads);
 
 /**
  * Returns the version of the divsufsort library.
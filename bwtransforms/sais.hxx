@@ -33,6 +33,9 @@
 #include <cassert>
 #include <iterator>
 #include <limits>
+#include <vector>
+
+#include "../globaldefs.hpp"
 
 #ifdef __INTEL_COMPILER
 #pragma warning(disable : 383 981 1418)
@@ -289,10 +292,10 @@ typedef typename std::iterator_traits<string_type>::value_type char_type;
 }
 template<typename string_type, typename sarray_type,
          typename bucketC_type, typename bucketB_type, typename index_type>
-int
+index_type
 computeBWT(string_type T, sarray_type SA, bucketC_type C, bucketB_type B,
            index_type n, index_type k, bool recount,
-           std::vector<uint32>& LFpowers) {
+           std::vector<bwtc::uint64>& LFpowers) {
 typedef typename std::iterator_traits<string_type>::value_type char_type;
   index_type i, j, pidx = -1;
   char_type c0, c1;
@@ -342,7 +345,7 @@ typedef typename std::iterator_traits<string_type>::value_type char_type;
 
 template<typename string_type, typename sarray_type,
          typename bucketC_type, typename bucketB_type, typename index_type>
-int
+index_type
 computeBWT(string_type T, sarray_type SA, bucketC_type C, bucketB_type B,
            index_type n, index_type k, bool recount) {
 typedef typename std::iterator_traits<string_type>::value_type char_type;
@@ -446,7 +449,7 @@ template<typename string_type, typename sarray_type,
 index_type
 stage3sort(string_type T, sarray_type SA, bucketC_type C, bucketB_type B,
            index_type n, index_type m, index_type k,
-           unsigned flags, bool isbwt, std::vector<uint32>& LFpowers) {
+           unsigned flags, bool isbwt, std::vector<bwtc::uint64>& LFpowers) {
 typedef typename std::iterator_traits<string_type>::value_type char_type;
   index_type i, j, p, q, pidx = 0;
   char_type c0, c1;
@@ -504,7 +507,7 @@ typedef typename std::iterator_traits<string_type>::value_type char_type;
 /* find the suffix array SA of T[0..n-1] in {0..k}^n
    use a working space (excluding s and SA) of at most 2n+O(1) for a constant alphabet */
 template<typename string_type, typename sarray_type, typename index_type>
-int
+index_type
 suffixsort(string_type T, sarray_type SA,
            index_type fs, index_type n, index_type k,
            bool isbwt) {
@@ -624,10 +627,10 @@ typedef typename std::iterator_traits<string_type>::value_type char_type;
 /* find the suffix array SA of T[0..n-1] in {0..k}^n
    use a working space (excluding s and SA) of at most 2n+O(1) for a constant alphabet */
 template<typename string_type, typename sarray_type, typename index_type>
-int
+index_type
 suffixsort(string_type T, sarray_type SA,
            index_type fs, index_type n, index_type k,
-           bool isbwt, std::vector<uint32>& LFpowers) {
+           bool isbwt, std::vector<bwtc::uint64>& LFpowers) {
 typedef typename std::iterator_traits<string_type>::value_type char_type;
   sarray_type RA, C, B;
   index_type *Cp, *Bp;
@@ -768,16 +771,18 @@ typedef typename std::iterator_traits<sarray_type>::value_type savalue_type;
 /**
  * @brief Constructs the burrows-wheeler transformed string of a given string in linear time.
  * @param T[0..n-1] The input string. (random access iterator)
- * @param U[0..n-1] The output string. (random access iterator)
+ * @param U[0..n-1] The output string. (random access iterator, written after
+ *                  T has been read)
  * @param A[0..n-1] The temporary array. (random access iterator)
  * @param n The length of the given string.
  * @param k The alphabet size.
  * @return The primary index if no error occurred, -1 or -2 otherwise.
  */
-template<typename string_type, typename sarray_type, typename index_type>
+template<typename string_type, typename output_type, typename sarray_type,
+         typename index_type>
 void
-saisxx_bwt(string_type T, string_type U, sarray_type A, index_type n,
-           std::vector<uint32>& LFpowers, index_type k = 256) {
+saisxx_bwt(string_type T, output_type U, sarray_type A, index_type n,
+           std::vector<bwtc::uint64>& LFpowers, index_type k = 256) {
 typedef typename std::iterator_traits<sarray_type>::value_type savalue_type;
 typedef typename std::iterator_traits<string_type>::value_type char_type;
 index_type i, pidx;
@@ -788,9 +793,9 @@ index_type i, pidx;
   if((n < 0) || (k <= 0)) { LFpowers[0] = -1; }
   if(n <= 1) { if(n == 1) { U[0] = T[0]; } LFpowers[0] = 0; }
   if(LFpowers.size() == 1) {
-    LFpowers[0] = pidx = saisxx_private::suffixsort(T, A, 0, n, k, true);
+    LFpowers[0] = pidx = saisxx_private::suffixsort(T, A, static_cast<index_type>(0), n, k, true);
   } else {
-    pidx = saisxx_private::suffixsort(T, A, 0, n, k, true, LFpowers);
+    pidx = saisxx_private::suffixsort(T, A, static_cast<index_type>(0), n, k, true, LFpowers);
   }
 
   if(0 <= pidx) {
@@ -800,10 +805,12 @@ index_type i, pidx;
   }
 }
 
-template<typename string_type, typename sarray_type, typename index_type>
+template<typename string_type, typename output_type, typename sarray_type,
+         typename index_type>
 void
-saisxx_bwt(string_type T, string_type U, sarray_type A, index_type n,
-           std::vector<uint32>& LFpowers, index_type k, uint32 *freqs) {
+saisxx_bwt(string_type T, output_type U, sarray_type A, index_type n,
+           std::vector<bwtc::uint64>& LFpowers, index_type k, bwtc::uint32 *freqs,
+           bwtc::uint32 *runs) {
 typedef typename std::iterator_traits<sarray_type>::value_type savalue_type;
 typedef typename std::iterator_traits<string_type>::value_type char_type;
 index_type i, pidx;
@@ -814,9 +821,9 @@ index_type i, pidx;
   if((n < 0) || (k <= 0)) { LFpowers[0] = -1; }
   if(n <= 1) { if(n == 1) { U[0] = T[0]; } LFpowers[0] = 0; }
   if(LFpowers.size() == 1) {
-    LFpowers[0] = pidx = saisxx_private::suffixsort(T, A, 0, n, k, true);
+    LFpowers[0] = pidx = saisxx_private::suffixsort(T, A, static_cast<index_type>(0), n, k, true);
   } else {
-    pidx = saisxx_private::suffixsort(T, A, 0, n, k, true, LFpowers);
+    pidx = saisxx_private::suffixsort(T, A, static_cast<index_type>(0), n, k, true, LFpowers);
   }
 
   if(0 <= pidx) {
@@ -825,6 +832,7 @@ index_type i, pidx;
         U[i] = (char_type)A[i];
         ++freqs[U[i]];
       }
+      if((i == 0) || (U[i] != U[i - 1])) { ++runs[U[i]]; }
     }
   }
 }
@@ -32,6 +32,10 @@
 #include <string>
 #include <iterator>
 
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
 #include <boost/program_options.hpp>
 namespace po = boost::program_options;
 
@@ -103,6 +107,7 @@ int main(int argc, char** argv) {
   std::string input_name, output_name, preprocessing;
   bool stdout, stdin;
   uint32 startingPoints;
+  size_t threads;
 
   try {
     po::options_description description(
@@ -116,6 +121,8 @@ int main(int argc, char** argv) {
         ("starts,s", po::value<uint32>(&startingPoints)->default_value(8)->
          notifier(&validateStartingPoints),
          "Starting points for decompression (more means faster decompression).")
+        ("threads,t", po::value<size_t>(&threads)->default_value(1),
+         "Number of threads to use. Memory limit is shared by the threads.")
         ("verb,v", po::value<int>(&verbosity)->default_value(0),
          "verbosity level")
         ("input-file", po::value<std::string>(&input_name),
@@ -126,7 +133,9 @@ int main(int argc, char** argv) {
          "BWT-algorithm to use:\n"
          "  d -- Yuta Mori's libdivsufsort\n"
          "  s -- Yuta Mori's sais\n"
-         "  a -- Chosen automatically from the algorithms above")
+         "  p -- Prefix doubling in all threads (for few large blocks)\n"
+         "  m -- Sub-blocks sorted in all threads and merged (as p)\n"
+         "  a -- Chosen automatically from d and s")
         ("prepr", po::value<std::string>(&preprocessing)->default_value("")->
          notifier(&validatePreprocOption),
          "preprocessor options:\n"
@@ -178,6 +187,7 @@ int main(int argc, char** argv) {
     std::clog << "Maximum memory to use = " << mem <<  "MB" << std::endl;
   }
   if (mem <= 0) mem = 1;
+  if (threads == 0) threads = 1;
 
   if (stdout) output_name = "";
   if (stdin)  input_name = "";
@@ -190,10 +200,16 @@ int main(int argc, char** argv) {
   }
 
 
+#ifdef __GLIBC__
+  /* Blocks are freed in other threads than where they were allocated. Large
+   * allocations are mapped, so that they are returned to the system when
+   * freed instead of piling up in the heaps of the threads. */
+  mallopt(M_MMAP_THRESHOLD, 1 << 20);
+#endif
   bwtc::Compressor compressor(input_name, output_name, preprocessing,
                               mem*1000000, encoding);
   compressor.initializeBwtAlgorithm(bwtAlgo, startingPoints);
-  size_t compressedBytes = compressor.compress(1);
+  size_t compressedBytes = compressor.compress(threads);
 
   if(verbosity > 0) {
     std::clog << "Compressed size is " << compressedBytes << std::endl;
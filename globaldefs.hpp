@@ -69,6 +69,17 @@ typedef unsigned char byte;
 /** Maximum number of starting points in inverse transform. */
 static const uint32 s_maxStartingPoints = 256;
 
+/**
+ * Version of the compressed file format, written as the first byte of the
+ * file. Files from before the version was added begin with the entropy coder,
+ * which is always a letter. They are of version 1, which is still
+ * decompressed.
+ *
+ * Version 2: each BWT-block is preceded by its compressed length and size,
+ * and the file ends with an index of the blocks.
+ */
+static const byte s_formatVersion = 2;
+
 } // namespace bwtc
 
 enum MetaData {
@@ -76,6 +87,16 @@ enum MetaData {
   PRECOMP_COMPRESSED_SIZE
 };
 
+/**
+ * Hint to fetch the cache line of the address ahead of its use, for the
+ * random accesses of the walks of the inverse transforms.
+ */
+#ifdef __GNUC__
+#define BWTC_PREFETCH(address) __builtin_prefetch(address)
+#else
+#define BWTC_PREFETCH(address)
+#endif
+
 /**
  * Name of the compressor program
  */
@@ -60,7 +60,7 @@ Postprocessor::Replacement::operator=(const Postprocessor::Replacement& r) {
 }
 
 Postprocessor::Postprocessor(bool verbose, const Grammar& grammar)
-    : m_verbose(verbose), m_hasRules(false) {
+    : m_verbose(verbose), m_hasRules(false), m_pending(-1) {
   for(size_t i = 0; i < 256; ++i) {
     m_replacements[i].push_back((byte)i);
   }
@@ -116,11 +116,43 @@ uncompress(const byte* data, size_t length, OutStream* to) const {
     to->writeBlock(data, data+length);
     return length;
   }
-  
+  int pending;
+  size_t uncompressedLength = expand(data, length, to, pending);
+  assert(pending < 0);
+  return uncompressedLength;
+}
+
+size_t Postprocessor::
+uncompressPart(const byte* data, size_t length, OutStream* to) {
+  PROFILE("Postprocessor::uncompressPart");
+  if(!m_hasRules) {
+    to->writeBlock(data, data+length);
+    return length;
+  }
+  size_t uncompressedLength = 0;
+  if(m_pending >= 0 && length > 0) {
+    int key = (1 << 16) | (m_pending << 8) | data[0];
+    size_t len = m_replacements[key].size();
+    to->writeBlock(&m_replacements[key][0], &m_replacements[key][len]);
+    uncompressedLength += len;
+    m_pending = -1;
+    ++data;
+    --length;
+  }
+  return uncompressedLength + expand(data, length, to, m_pending);
+}
+
+size_t Postprocessor::
+expand(const byte* data, size_t length, OutStream* to, int& pending) const {
+  pending = -1;
   size_t uncompressedLength = 0;
   for(size_t i = 0; i < length; ++i) {
     int key = data[i];
     if(m_isSpecial[key]) {
+      if(i + 1 == length) {
+        pending = key;
+        break;
+      }
       key = (1 << 16) | (data[i] << 8 )| data[i+1];
       ++i;
     }
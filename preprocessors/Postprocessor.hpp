@@ -52,14 +52,34 @@ class Postprocessor {
 
   void uncompress(const byte* from, size_t length, std::vector<byte>& to);
   size_t uncompress(const byte* data, size_t length, OutStream* to) const;
+
+  /**
+   * Uncompresses data given in consecutive parts, for example BWT-blocks as
+   * soon as they are inverted. A special symbol at the end of a part is
+   * expanded together with the first byte of the next part.
+   *
+   * @return Number of bytes written.
+   */
+  size_t uncompressPart(const byte* data, size_t length, OutStream* to);
+
+  /** True if the parts given so far have ended with a complete symbol. */
+  bool isComplete() const { return m_pending < 0; }
  
  private:
+  /** Writes the symbols of data, except a special symbol at the end,
+   * which is returned in pending (-1 if there is none). */
+  size_t expand(const byte* data, size_t length, OutStream* to,
+                int& pending) const;
+
+
   // Almost half of the array is unused but that area of memory
   // is never touched
   std::vector<byte> m_replacements[1 << 17];
   bool m_isSpecial[256];
   bool m_verbose;
   bool m_hasRules;
+  /* Special symbol at the end of the last part given to uncompressPart. */
+  int m_pending;
 };
   
 } //namespace bwtc
@@ -31,17 +31,41 @@
 
 namespace bwtc {
 
-Precompressor::Precompressor() {}
+Precompressor::Precompressor() : m_pool(0) {}
 
 Precompressor::Precompressor(const std::string& preprocessing)
-    : m_preprocessingOptions(preprocessing) {}
+    : m_preprocessingOptions(preprocessing), m_pool(0) {}
 
 Precompressor::~Precompressor() {}
 
+namespace {
+
+class PrecompressionTask : public Task {
+ public:
+  PrecompressionTask(const Precompressor& precompressor,
+                     PrecompressorBlock& block)
+      : m_precompressor(precompressor), m_block(block) {}
+
+  void run() { m_precompressor.precompress(m_block); }
+
+ private:
+  const Precompressor& m_precompressor;
+  PrecompressorBlock& m_block;
+};
+
+} //anonymous namespace
+
 PrecompressorBlock*
 Precompressor::readBlock(size_t blockSize, InStream* in) const {
   PrecompressorBlock *result = new PrecompressorBlock(blockSize, in);
-  if(result->originalSize() > 0) precompress(*result);
+  if(result->originalSize() == 0) return result;
+  if(m_pool && m_preprocessingOptions.size() > 0) {
+    PrecompressionTask task(*this, *result);
+    m_pool->submit(&task);
+    m_pool->wait(&task);
+  } else {
+    precompress(*result);
+  }
   return result;
 }
 
@@ -69,7 +93,9 @@ void Precompressor::precompress(PrecompressorBlock& block) const {
 
   size_t roundsWithTempArray = 0;
 
-  if(m_preprocessingOptions.size() > 0) {
+  /* Pairs can't shorten the last few bytes of the input, which may end up
+   * in a block of their own. */
+  if(m_preprocessingOptions.size() > 0 && length > 2) {
     size_t oldLength = length;
     bool useTempArray = false;
 
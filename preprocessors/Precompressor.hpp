@@ -33,6 +33,7 @@
 #include "../globaldefs.hpp"
 #include "../Streams.hpp"
 #include "../PrecompressorBlock.hpp"
+#include "../ThreadPool.hpp"
 
 namespace bwtc {
 
@@ -42,7 +43,8 @@ class Precompressor {
   Precompressor(const std::string& prepr);
   ~Precompressor();
 
-  /* Reads and preprocesses data to byte array */
+  /* Reads and preprocesses data to byte array. If thread pool is given,
+   * preprocessing is run as a task in the pool. */
   PrecompressorBlock* readBlock(size_t blockSize, InStream* in) const;
 
   // TODO: give also the temporary memory to parameter (to be able
@@ -50,12 +52,15 @@ class Precompressor {
   void precompress(PrecompressorBlock& block) const;
 
   const std::string options() const { return m_preprocessingOptions; }
+
+  void setThreadPool(ThreadPool* pool) { m_pool = pool; }
   
  private:
   Precompressor& operator=(const Precompressor& p);
   Precompressor(const Precompressor&);
 
   const std::string m_preprocessingOptions;
+  ThreadPool *m_pool;
 };
 
 } // namespace bwtc
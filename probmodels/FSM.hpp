@@ -150,6 +150,7 @@ class FSM6 : public ProbabilityModel {
     o1.resetModel();
     o2.resetModel();
     o3.resetModel();
+    m_currentState = 3;
   }
   
   
@@ -211,6 +212,7 @@ class FSM8 : public ProbabilityModel {
     o2.resetModel();
     o3.resetModel();
     o4.resetModel();
+    m_currentState = 4;
   }
   
   
@@ -275,6 +277,7 @@ class FSM9 : public ProbabilityModel {
     o2.resetModel();
     o3.resetModel();
     o4.resetModel();
+    m_currentState = 4;
   }
 
  private:
@@ -125,6 +125,7 @@ void SimpleMarkov<UnsignedInt>::resetModel() {
    * contexts. */
   uint64 size = (static_cast<uint64>(1) << 8*sizeof(UnsignedInt)) - 1;
   std::fill(m_history, m_history + size, 0);
+  m_prev = static_cast<UnsignedInt>(0);
 }
 
 } //namespace bwtc
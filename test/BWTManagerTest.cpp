@@ -0,0 +1,490 @@
+/**
+ * @file BWTManagerTest.cpp
+ * @author Pekka Mikkola <pmikkol@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This file is part of bwtc.
+ *
+ * bwtc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * bwtc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with bwtc.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Tests for the profiling of blocks, the automatic choice of the
+ * BWT-algorithm and the memory models in BWTManager, and for the transforms
+ * and inverse transforms used for large blocks, in limited memory and with
+ * the statistics of the transform.
+ */
+
+#define BOOST_TEST_MODULE 
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include "../BWTBlock.hpp"
+#include "../Streams.hpp"
+#include "../ThreadPool.hpp"
+#include "../bwtransforms/BWTManager.hpp"
+#include "../bwtransforms/Divsufsorter.hpp"
+#include "../bwtransforms/InverseBWT.hpp"
+#include "../bwtransforms/MergingBWT.hpp"
+#include "../bwtransforms/MtlSaInverseBWT.hpp"
+#include "../bwtransforms/ParallelBWT.hpp"
+#include "../bwtransforms/SampledInverseBWT.hpp"
+#include "../bwtransforms/sais.hxx"
+
+namespace bwtc {
+int verbosity = 0;
+
+namespace tests {
+
+void makeRandomData(std::vector<byte>& data, size_t length) {
+  for(size_t i = 0; i < length; ++i) data.push_back(rand() & 0xff);
+}
+
+/* Random text repeated with a few changes in each copy. */
+void makeRepetitiveData(std::vector<byte>& data, size_t length, int times) {
+  makeRandomData(data, length);
+  for(int j = 1; j < times; ++j) {
+    for(size_t i = 0; i < length; ++i) data.push_back(data[i]);
+    for(int k = 0; k < 10; ++k) data[j*length + rand() % length] = rand();
+  }
+}
+
+/* Transforms the data in blocks of the given size and returns the
+ * result. */
+std::vector<byte> transform(char choice, const std::vector<byte>& data,
+                            size_t blockSize) {
+  BWTManager manager(4);
+  manager.initialize(choice);
+  std::vector<byte> result;
+  for(size_t begin = 0; begin < data.size(); begin += blockSize) {
+    size_t length = std::min(blockSize, data.size() - begin);
+    std::vector<byte> block(data.begin() + begin,
+                            data.begin() + begin + length);
+    block.push_back(0);
+    BWTBlock bwtBlock(&block[0], length, false);
+    manager.doTransform(bwtBlock);
+    result.insert(result.end(), block.begin(), block.begin() + length);
+    for(size_t i = 0; i < bwtBlock.LFpowers().size(); ++i) {
+      uint32 LFpower = bwtBlock.LFpowers()[i];
+      for(int j = 0; j < 4; ++j) result.push_back(LFpower >> (8*j));
+    }
+  }
+  return result;
+}
+
+BOOST_AUTO_TEST_SUITE(Profiling)
+
+BOOST_AUTO_TEST_CASE(RandomBlock) {
+  std::vector<byte> data;
+  makeRandomData(data, 1 << 20);
+  BlockProfile p = BWTManager::profile(&data[0], data.size());
+  BOOST_CHECK_EQUAL(p.alphabetSize, 256);
+  BOOST_CHECK(p.runDensity < 0.01);
+  BOOST_CHECK(p.repetitiveness < 0.01);
+}
+
+BOOST_AUTO_TEST_CASE(RepetitiveBlock) {
+  std::vector<byte> data;
+  makeRepetitiveData(data, 1 << 17, 8);
+  BlockProfile p = BWTManager::profile(&data[0], data.size());
+  BOOST_CHECK(p.runDensity < 0.01);
+  BOOST_CHECK(p.repetitiveness > 0.8);
+}
+
+BOOST_AUTO_TEST_CASE(RunsAndShortPeriods) {
+  std::vector<byte> zeros(1 << 20, 0);
+  BlockProfile p = BWTManager::profile(&zeros[0], zeros.size());
+  BOOST_CHECK_EQUAL(p.alphabetSize, 1);
+  BOOST_CHECK(p.runDensity > 0.99);
+  BOOST_CHECK(p.repetitiveness < 0.01);
+
+  std::vector<byte> periodic;
+  for(size_t i = 0; i < (1 << 20); ++i) periodic.push_back("abcabd"[i % 6]);
+  p = BWTManager::profile(&periodic[0], periodic.size());
+  BOOST_CHECK(p.repetitiveness < 0.01);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(AutomaticChoice)
+
+/* Both algorithms are used for the repetitive blocks (SA-IS is preferred
+ * and divsufsort is tried once), and result has to be the same. */
+BOOST_AUTO_TEST_CASE(SameResultAsDivsufsort) {
+  std::vector<byte> data;
+  makeRepetitiveData(data, 1 << 16, 48);
+  makeRandomData(data, 1 << 20);
+  BOOST_CHECK(transform('a', data, 1 << 19) == transform('d', data, 1 << 19));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(MemoryModels)
+
+/* maxBlockSize has to give the largest block whose worst case fits. */
+void checkInverse(char choice) {
+  BWTManager manager;
+  manager.initialize(choice);
+  for(uint64 budget = 1 << 20; budget < (1 << 30); budget = budget*3 + 7) {
+    uint64 n = manager.suggestedBlockSize(budget);
+    BOOST_CHECK(manager.maxSizeInBytes(n) <= budget);
+    BOOST_CHECK(manager.maxSizeInBytes(n + 1) > budget);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(LargestBlockThatFits) {
+  checkInverse('d');
+  checkInverse('s');
+  checkInverse('p');
+  checkInverse('m');
+}
+
+/* SA-IS is chosen only for the blocks for which its worst case fits. */
+BOOST_AUTO_TEST_CASE(AutomaticChoiceWithinBudget) {
+  BWTManager divsufsort, sais, automatic;
+  divsufsort.initialize('d');
+  sais.initialize('s');
+  automatic.initialize('a');
+  uint64 length = 1 << 20;
+  automatic.setMemoryBudget(sais.maxSizeInBytes(length));
+  BOOST_CHECK(automatic.maxSizeInBytes(length) ==
+              sais.maxSizeInBytes(length));
+  automatic.setMemoryBudget(divsufsort.maxSizeInBytes(length));
+  BOOST_CHECK(automatic.maxSizeInBytes(length) ==
+              divsufsort.maxSizeInBytes(length));
+  BOOST_CHECK(automatic.suggestedBlockSize(1 << 24) ==
+              divsufsort.suggestedBlockSize(1 << 24));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(LargeBlocks)
+
+/* Blocks above 2^31 bytes are transformed with 64-bit suffix array, which
+ * has to give the same result as the 32-bit one. */
+BOOST_AUTO_TEST_CASE(SaisWith64BitIndices) {
+  std::vector<byte> data;
+  makeRepetitiveData(data, 1 << 12, 16);
+  data.push_back(0);
+  std::vector<byte> bwt32(data.size()), bwt64(data.size());
+  std::vector<int> SA32(data.size());
+  std::vector<int64> SA64(data.size());
+  std::vector<uint64> LF32(16), LF64(16);
+  saisxx_bwt(&data[0], &bwt32[0], &SA32[0], (int)data.size(), LF32);
+  saisxx_bwt(&data[0], &bwt64[0], &SA64[0], (int64)data.size(), LF64,
+             (int64)256);
+  BOOST_CHECK(LF32 == LF64);
+  bwt32[LF32[0]] = bwt64[LF64[0]] = 0;
+  BOOST_CHECK(bwt32 == bwt64);
+}
+
+BOOST_AUTO_TEST_CASE(InverseWith64BitIndices) {
+  std::vector<byte> data;
+  makeRepetitiveData(data, 1 << 12, 16);
+  makeRandomData(data, 1 << 16);
+  std::vector<byte> block(data);
+  block.push_back(0);
+  BWTManager manager(8);
+  manager.initialize('d');
+  BWTBlock bwtBlock(&block[0], data.size(), false);
+  manager.doTransform(bwtBlock);
+  FastInverseBWTransform fast;
+  InverseBWTransform& inverse = fast;
+  inverse.doTransform(bwtBlock);
+  BOOST_CHECK(std::equal(data.begin(), data.end(), block.begin()));
+}
+
+/* Starting points beyond 31 bits are written with the wide format. */
+BOOST_AUTO_TEST_CASE(WideStartingPoints) {
+  uint64 length = (static_cast<uint64>(1) << 33) + 5;
+  BWTBlock block(0, length, true);
+  block.LFpowers().push_back(length);
+  block.LFpowers().push_back(123);
+  block.LFpowers().push_back(length - 77);
+  MemoryOutStream out;
+  block.writeHeader(&out);
+  out.writeByte(0xAB);
+  MemoryInStream in(&out.data()[0], &out.data()[0] + out.data().size());
+  BWTBlock result;
+  result.readHeader(&in);
+  BOOST_CHECK(result.LFpowers() == block.LFpowers());
+  BOOST_CHECK_EQUAL(in.readByte(), 0xAB);
+}
+
+/* Divsufsort gives the blocks beyond its own limit to its large transformer,
+ * but no choice takes blocks beyond the 48-bit positions. */
+BOOST_AUTO_TEST_CASE(LargestBlockOfChoice) {
+  uint64 large = static_cast<uint64>(1) << 33;
+  BWTManager divsufsort, sais;
+  divsufsort.initialize('d');
+  sais.initialize('s');
+  BOOST_CHECK(divsufsort.canTransform(large));
+  BOOST_CHECK(sais.canTransform(large));
+  BOOST_CHECK(!sais.canTransform(static_cast<uint64>(1) << 50));
+  BOOST_CHECK(!divsufsort.canTransform(static_cast<uint64>(1) << 50));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(Statistics)
+
+/* Block "ba" is transformed to "ba". Its first row is that of the
+ * sentinel and the row of b is left out. */
+BOOST_AUTO_TEST_CASE(ContextLengthsFromStatistics) {
+  byte block[] = {'b', 'a', 0};
+  BWTManager manager;
+  manager.initialize('d');
+  BWTBlock bwtBlock(block, 2, false);
+  BWTStatistics stats;
+  manager.doTransform(bwtBlock, stats);
+  BOOST_CHECK_EQUAL(stats.runs['a'], 1);
+  BOOST_CHECK_EQUAL(stats.runs['b'], 1);
+  std::vector<uint32> lengths;
+  stats.contextLengths(lengths);
+  BOOST_CHECK_EQUAL(lengths[0], 1);
+  BOOST_CHECK_EQUAL(lengths['a'], 1);
+  BOOST_CHECK_EQUAL(lengths['b'], 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(SeparateOutput)
+
+/* Transform to a separate output leaves the block and the byte after it as
+ * they are. */
+void checkSeparateOutput(char choice) {
+  std::vector<byte> data;
+  makeRepetitiveData(data, 1 << 10, 8);
+  makeRandomData(data, 1 << 12);
+  std::vector<byte> inPlace(data), input(data);
+  inPlace.push_back(0);
+  input.push_back(0xAB);
+  BWTManager manager(8);
+  manager.initialize(choice);
+  BWTBlock block(&inPlace[0], data.size(), false);
+  BWTStatistics stats;
+  manager.doTransform(block, stats);
+
+  BWTBlock source(&input[0], data.size(), false);
+  std::vector<byte> output(data.size() + 1);
+  BWTStatistics outputStats;
+  manager.doTransform(source, &output[0], outputStats);
+  BOOST_CHECK(std::equal(data.begin(), data.end(), input.begin()));
+  BOOST_CHECK_EQUAL(input.back(), 0xAB);
+  BOOST_CHECK(!source.isTransformed());
+  BOOST_CHECK(std::equal(output.begin(), output.end() - 1, inPlace.begin()));
+  BOOST_CHECK(source.LFpowers() == block.LFpowers());
+  BOOST_CHECK(std::equal(stats.runs, stats.runs + 256, outputStats.runs));
+  BOOST_CHECK(std::equal(stats.frequencies, stats.frequencies + 256,
+                         outputStats.frequencies));
+}
+
+BOOST_AUTO_TEST_CASE(TransformToSeparateOutput) {
+  checkSeparateOutput('s');
+  checkSeparateOutput('d');
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(SampledInverse)
+
+/* Blocks which don't fit in the budget of the default inverse transform
+ * are restored with sampled ranks, using at most 1.25n bytes. */
+BOOST_AUTO_TEST_CASE(InverseWithinSmallBudget) {
+  std::vector<byte> data;
+  makeRepetitiveData(data, 1 << 12, 16);
+  makeRandomData(data, 1 << 16);
+  std::vector<byte> bwt(data);
+  bwt.push_back(0);
+  BWTManager manager(8);
+  manager.initialize('d');
+  BWTBlock bwtBlock(&bwt[0], data.size(), false);
+  manager.doTransform(bwtBlock);
+
+  uint64 n = data.size() + 1;
+  uint64 budget = n + n / 4 + 4096;
+  SampledInverseBWTransform sampled(budget);
+  BOOST_CHECK(sampled.interval(n) == SampledInverseBWTransform::kMaxInterval);
+  BOOST_CHECK(SampledInverseBWTransform::memoryUsage(n, sampled.interval(n))
+              <= budget);
+  BOOST_CHECK(sampled.maxBlockSize(budget) >= data.size());
+  BOOST_CHECK(sampled.maxBlockSize(budget) <= budget * 4 / 5);
+
+  std::vector<byte> block(bwt);
+  BWTBlock sampledBlock(&block[0], data.size(), true);
+  sampledBlock.LFpowers() = bwtBlock.LFpowers();
+  InverseBWTransform *inverse = giveInverseTransformer(0, budget);
+  BOOST_CHECK(inverse->maxBlockSize(budget) >= data.size());
+  inverse->doTransform(sampledBlock);
+  BOOST_CHECK(std::equal(data.begin(), data.end(), block.begin()));
+  delete inverse;
+
+  ThreadPool pool(4);
+  SampledInverseBWTransform threaded(0, &pool);
+  std::vector<byte> rangeBlock(bwt);
+  BWTBlock range(&rangeBlock[0], data.size(), true);
+  range.LFpowers() = bwtBlock.LFpowers();
+  InverseBWTransform& rangeInverse = threaded;
+  rangeInverse.doTransformRange(range, 1000, 2000);
+  BOOST_CHECK(std::equal(data.begin() + 1000, data.begin() + 2000,
+                         rangeBlock.begin() + 1000));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(GivenFrequencies)
+
+/* Symbol frequencies given by the entropy decoder replace the counting pass
+ * of the inverse transform, and frequencies which don't match the size of
+ * the block are ignored. */
+BOOST_AUTO_TEST_CASE(InverseWithGivenFrequencies) {
+  std::vector<byte> data;
+  makeRepetitiveData(data, 1 << 12, 16);
+  makeRandomData(data, 1 << 16);
+  std::vector<byte> bwt(data);
+  bwt.push_back(0);
+  BWTManager manager(8);
+  manager.initialize('d');
+  BWTBlock bwtBlock(&bwt[0], data.size(), false);
+  manager.doTransform(bwtBlock);
+
+  uint64 frequencies[256] = {0};
+  for(size_t i = 0; i < data.size(); ++i) ++frequencies[data[i]];
+  MtlSaInverseBWTransform mtlsa;
+  InverseBWTransform& inverse = mtlsa;
+  std::vector<byte> block(bwt);
+  BWTBlock known(&block[0], data.size(), true);
+  known.LFpowers() = bwtBlock.LFpowers();
+  inverse.doTransform(known, frequencies);
+  BOOST_CHECK(std::equal(data.begin(), data.end(), block.begin()));
+
+  ++frequencies[0];
+  std::vector<byte> wrongBlock(bwt);
+  BWTBlock wrong(&wrongBlock[0], data.size(), true);
+  wrong.LFpowers() = bwtBlock.LFpowers();
+  inverse.doTransform(wrong, frequencies);
+  BOOST_CHECK(std::equal(data.begin(), data.end(), wrongBlock.begin()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+/* Transforms the data with the given transform, 16 starting points and
+ * statistics, and returns the result with the starting points and the
+ * statistics. Runs gathered by the transform are checked against the
+ * transformed block. */
+std::vector<byte> transformWith(BWTransform& transformer,
+                                const std::vector<byte>& data) {
+  std::vector<byte> block(data);
+  block.push_back(0);
+  BWTBlock bwtBlock(&block[0], data.size(), false);
+  bwtBlock.prepareLFpowers(16);
+  BWTStatistics stats;
+  transformer.doTransform(bwtBlock, stats);
+  uint32 runs[256] = {0};
+  for(size_t i = 0; i < data.size(); ++i) {
+    if(i == 0 || block[i] != block[i - 1]) ++runs[block[i]];
+  }
+  BOOST_CHECK(std::equal(runs, runs + 256, stats.runs));
+  block[bwtBlock.LFpowers()[0]] = 0;
+  block.pop_back();
+  for(size_t i = 0; i < bwtBlock.LFpowers().size(); ++i) {
+    for(int j = 0; j < 8; ++j)
+      block.push_back(bwtBlock.LFpowers()[i] >> (8*j));
+  }
+  for(size_t i = 0; i < 256; ++i) {
+    for(int j = 0; j < 4; ++j) {
+      block.push_back(stats.frequencies[i] >> (8*j));
+      block.push_back(stats.runs[i] >> (8*j));
+    }
+  }
+  return block;
+}
+
+BOOST_AUTO_TEST_SUITE(ParallelSorting)
+
+/* Result doesn't depend on the number of threads. */
+void checkParallelSameAsDivsufsort(const std::vector<byte>& data) {
+  Divsufsorter divsufsort;
+  std::vector<byte> expected = transformWith(divsufsort, data);
+  ParallelBWTransform sequential;
+  BOOST_CHECK(transformWith(sequential, data) == expected);
+  ThreadPool pool(4);
+  ParallelBWTransform parallel;
+  parallel.setThreadPool(&pool);
+  BOOST_CHECK(transformWith(parallel, data) == expected);
+}
+
+BOOST_AUTO_TEST_CASE(SameResultAsDivsufsort) {
+  std::vector<byte> data;
+  makeRepetitiveData(data, 1 << 12, 16);
+  makeRandomData(data, 1 << 16);
+  checkParallelSameAsDivsufsort(data);
+}
+
+BOOST_AUTO_TEST_CASE(RunsAndPeriods) {
+  std::vector<byte> data(5000, 0);
+  checkParallelSameAsDivsufsort(data);
+  data.clear();
+  for(size_t i = 0; i < 5000; ++i) data.push_back("abaababa"[i % 8]);
+  checkParallelSameAsDivsufsort(data);
+  checkParallelSameAsDivsufsort(std::vector<byte>(1, 'x'));
+  checkParallelSameAsDivsufsort(std::vector<byte>(2, 'x'));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(MergingSubBlocks)
+
+/* Scans of blocks over a few chunks pass the greater-bits between the
+ * chunks. */
+void checkMergedSameAsDivsufsort(const std::vector<byte>& data) {
+  Divsufsorter divsufsort;
+  std::vector<byte> expected = transformWith(divsufsort, data);
+  ThreadPool pool(4);
+  uint32 subBlocks[] = {0, 1, 2, 7, 32};
+  for(size_t i = 0; i < sizeof(subBlocks)/sizeof(subBlocks[0]); ++i) {
+    MergingBWTransform sequential(subBlocks[i]);
+    BOOST_CHECK(transformWith(sequential, data) == expected);
+    MergingBWTransform parallel(subBlocks[i]);
+    parallel.setThreadPool(&pool);
+    BOOST_CHECK(transformWith(parallel, data) == expected);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(SameResultAsDivsufsort) {
+  std::vector<byte> data;
+  makeRepetitiveData(data, 1 << 12, 8);
+  makeRandomData(data, 1 << 15);
+  checkMergedSameAsDivsufsort(data);
+}
+
+BOOST_AUTO_TEST_CASE(RunsAndPeriods) {
+  std::vector<byte> data(20000, 0);
+  checkMergedSameAsDivsufsort(data);
+  data.clear();
+  for(size_t i = 0; i < 20000; ++i) data.push_back("abaababa"[i % 8]);
+  checkMergedSameAsDivsufsort(data);
+  checkMergedSameAsDivsufsort(std::vector<byte>(1, 'x'));
+  checkMergedSameAsDivsufsort(std::vector<byte>(2, 'x'));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} //namespace tests
+} //namespace bwtc
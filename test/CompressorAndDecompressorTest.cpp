@@ -29,8 +29,11 @@
 #define BOOST_TEST_DYN_LINK
 
 #include <boost/test/unit_test.hpp>
+#include <algorithm>
 #include <cstdlib>
 #include <ctime>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 #include "../Compressor.hpp"
@@ -92,6 +95,82 @@ void test(size_t length, size_t reps, const char* prep, size_t mem,
   }
 }
 
+/**Compresses the same data with one and with several threads and checks
+ * that the compressed files are identical. The result is decompressed
+ * with several threads, also with memory limits too small for more than
+ * one block at a time. */
+void testThreads(size_t length, size_t reps, const char* prep, size_t mem,
+                 char entropyCoder, size_t threads)
+{
+  srand(time(0));
+  std::vector<byte> orig, comp, compThreaded, decomp;
+  TestStream *original = new TestStream(orig),
+      *compressed = new TestStream(comp),
+      *original2 = new TestStream(orig),
+      *compressedThreaded = new TestStream(compThreaded),
+      *compr2 = new TestStream(compThreaded),
+      *decompressed = new TestStream(decomp);
+  makeRepetitiveData(orig, length/reps, reps);
+
+  {
+    Compressor compressor(original, compressed, prep, mem, entropyCoder);
+    compressor.initializeBwtAlgorithm('d', 8);
+    compressor.compress(1);
+  }
+  {
+    Compressor compressor(original2, compressedThreaded, prep, mem,
+                          entropyCoder);
+    compressor.initializeBwtAlgorithm('d', 8);
+    compressor.compress(threads);
+  }
+  BOOST_CHECK(comp == compThreaded);
+
+  std::vector<byte> compCopy(compThreaded);
+  Decompressor decompressor(compr2, decompressed);
+  decompressor.decompress(threads);
+  BOOST_CHECK(orig == decomp);
+
+  const uint64 limits[] = {1, mem, 20*mem};
+  for(size_t i = 0; i < sizeof(limits)/sizeof(limits[0]); ++i) {
+    std::vector<byte> limited;
+    std::vector<byte> copy(compCopy);
+    Decompressor decompressor(new TestStream(copy), new TestStream(limited),
+                              limits[i]);
+    decompressor.decompress(threads);
+    BOOST_CHECK(orig == limited);
+  }
+}
+/**Compresses the data and checks that ranges of it are decompressed
+ * correctly using the index of the compressed file. */
+void testRanges(size_t length, size_t reps, const char* prep, size_t mem,
+                char entropyCoder)
+{
+  srand(time(0));
+  std::vector<byte> orig, comp;
+  TestStream *original = new TestStream(orig),
+      *compressed = new TestStream(comp);
+  makeRepetitiveData(orig, length/reps, reps);
+  {
+    Compressor compressor(original, compressed, prep, mem, entropyCoder);
+    compressor.initializeBwtAlgorithm('d', 8);
+    compressor.compress(1);
+  }
+
+  for(int i = 0; i < 20; ++i) {
+    size_t offset = rand() % length;
+    size_t rangeLength = rand() % (length/(i%4 + 1));
+    std::vector<byte> compCopy(comp), decomp;
+    Decompressor decompressor(new TestStream(compCopy),
+                              new TestStream(decomp));
+    uint64 written = decompressor.decompressRange(offset, rangeLength);
+    size_t expected = std::min(rangeLength, length - offset);
+    BOOST_CHECK_EQUAL(written, expected);
+    BOOST_CHECK(decomp.size() == expected &&
+                std::equal(decomp.begin(), decomp.end(),
+                           orig.begin() + offset));
+  }
+}
+
 
 BOOST_AUTO_TEST_SUITE(WithWaveletCoders)
 
@@ -204,6 +283,171 @@ BOOST_AUTO_TEST_CASE(MultipleStartingPoints) {
 
 BOOST_AUTO_TEST_SUITE_END()
 
+BOOST_AUTO_TEST_SUITE(WithThreads)
+
+BOOST_AUTO_TEST_CASE(ThreadedCompressionGivesIdenticalOutput) {
+  testThreads(100000, 10, "", 10000, 'H', 2);
+  testThreads(100000, 10, "", 10000, 'B', 4);
+  testThreads(100000, 10, "pp", 100000, 'H', 3);
+  testThreads(100000, 10, "pp", 100000, 'W', 8);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(WithIndex)
+
+BOOST_AUTO_TEST_CASE(RangesAreDecompressed) {
+  testRanges(100000, 10, "", 10000, 'H');
+  testRanges(100000, 10, "", 100000, 'B');
+  testRanges(100000, 10, "pp", 100000, 'H');
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(WithFormatVersion)
+
+/* Text compressed by the version of bwtc before the format version was
+ * added (compress -m 1, entropy coders F and H). */
+const char kOldText[] =
+    "bwtc is free software: you can redistribute it and/or modify it under "
+    "the terms of the GNU General Public License as published by the Free "
+    "Software Foundation, either version 3 of the License, or (at your "
+    "option) any later version. bwtc is distributed in the hope that it will "
+    "be useful, but WITHOUT ANY WARRANTY; without even the implied warranty "
+    "of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.\n";
+
+const byte kOldArchiveF[] = {
+  0x46, 0xbc, 0x09, 0x01, 0x00, 0x07, 0x00, 0x00, 0x00, 0x06, 0x00, 0x00,
+  0x0d, 0xfc, 0x00, 0x00, 0x07, 0x88, 0x00, 0x00, 0x1c, 0xa0, 0x00, 0x00,
+  0x85, 0x60, 0x00, 0x00, 0xaa, 0xc0, 0x00, 0x00, 0xee, 0x80, 0x00, 0x04,
+  0x77, 0x00, 0x00, 0x00, 0x00, 0x01, 0x89, 0x01, 0xbc, 0x09, 0xbc, 0x09,
+  0x79, 0x45, 0x09, 0x0c, 0x58, 0x16, 0xb6, 0x34, 0x24, 0x85, 0x61, 0x6b,
+  0x92, 0x21, 0x67, 0x00, 0x42, 0x08, 0x44, 0x42, 0x22, 0x44, 0x51, 0x24,
+  0x44, 0xa2, 0xaa, 0xd5, 0xec, 0xb7, 0xfd, 0x7e, 0xd5, 0x5d, 0xa5, 0x80,
+  0x1b, 0xc0, 0x63, 0x78, 0x57, 0x66, 0x3b, 0xaf, 0x7c, 0x2f, 0x91, 0xe3,
+  0x3f, 0x04, 0xe0, 0xad, 0x78, 0x2f, 0x08, 0x67, 0x60, 0xdc, 0x83, 0xe8,
+  0x64, 0xb7, 0xcb, 0xe0, 0xfc, 0x8b, 0x6e, 0x4b, 0x37, 0x0a, 0x65, 0xf4,
+  0xb5, 0xeb, 0xd4, 0xcc, 0xd9, 0xf0, 0x76, 0x9e, 0x96, 0x5f, 0x33, 0xe0,
+  0x8d, 0x79, 0x1f, 0xc0, 0xfa, 0x18, 0x5b, 0x0d, 0xcb, 0xe4, 0x39, 0x0e,
+  0xcc, 0x47, 0x29, 0xa7, 0x87, 0xe1, 0xf8, 0x86, 0x25, 0x90, 0xe9, 0xe7,
+  0x64, 0x5a, 0x19, 0x2c, 0x53, 0xff, 0x8b, 0xeb, 0xd9, 0xaf, 0xff, 0x8e,
+  0x7c, 0x7b, 0xeb, 0xc2, 0x3b, 0xe1, 0x3c, 0x7f, 0x1c, 0xd9, 0x8b, 0x60,
+  0xcc, 0x7b, 0x15, 0xd1, 0xcf, 0xca, 0xe8, 0xe5, 0xb6, 0xe0, 0x4c, 0x7f,
+  0xe3, 0x9a, 0xf5, 0x7e, 0x7e, 0xdc, 0x77, 0x20, 0xcd, 0xfa, 0x9b, 0x34,
+  0xf7, 0xd3, 0xdb, 0xbe, 0x25, 0x86, 0x6a, 0xe7, 0xe7, 0x61, 0x9b, 0x33,
+  0xb2, 0xda, 0x9a, 0x1a, 0x39, 0xba, 0x7a, 0x5a, 0xb9, 0xfb, 0xe5, 0x33,
+  0x75, 0x35, 0xe9, 0x69, 0x6d, 0xcd, 0xcc, 0xf8, 0x4b, 0x2f, 0x8c, 0x6b,
+  0xc4, 0xf5, 0xeb, 0xff, 0x13, 0xdf, 0x10, 0xff, 0x00, 0xe1, 0xda, 0xf0,
+  0x16, 0x25, 0xb3, 0xed, 0xf8, 0xae, 0xcf, 0xa3, 0xfe, 0x00, 0xd7, 0xf5,
+  0xeb, 0xc6, 0xb6, 0x66, 0x66, 0x7c, 0x5f, 0x47, 0x6e, 0xbf, 0xa3, 0xbf,
+  0xc5, 0xb5, 0xff, 0xff, 0xdf, 0x7d, 0x7b, 0xef, 0x9d, 0xbe, 0x37, 0xbe,
+  0xf8, 0xd6, 0x5b, 0x6f, 0xdb, 0x99, 0xbf, 0xce, 0xd7, 0xa5, 0x93, 0xcc,
+  0xff, 0x4f, 0xe2, 0x9a, 0x19, 0x3d, 0x7f, 0xff, 0xfe, 0xf9, 0x5f, 0x92,
+  0xc5, 0xf6, 0xff, 0x96, 0xf9, 0x9f, 0x4b, 0x66, 0xcd, 0x99, 0xd8, 0xc7,
+  0xcf, 0xff, 0xe6, 0xea, 0xe8, 0x68, 0xe1, 0xbf, 0x66, 0xfb, 0xea, 0x6d,
+  0xc0, 0xba, 0x19, 0x4c, 0xae, 0x76, 0x86, 0x19, 0x9b, 0xf6, 0x7f, 0x96,
+  0xc9, 0x63, 0x39, 0xdf, 0x57, 0x53, 0x5e, 0x8e, 0xff, 0x7d, 0x5d, 0xf6,
+  0x6f, 0xab, 0xff, 0xcd, 0xcc, 0xd9, 0xfe, 0x9e, 0x96, 0x97, 0xf9, 0xfa,
+  0xfe, 0x19, 0xf5, 0x35, 0x77, 0xca, 0x7c, 0xcd, 0xff, 0xcc, 0xca, 0xfd,
+  0xf2, 0xba, 0xff, 0xcf, 0xf8, 0x1b, 0x7d, 0xbf, 0x37, 0xeb, 0xfb, 0x3f,
+  0xff, 0xfd, 0x9b, 0x35, 0xec, 0xc4, 0x7e, 0xff, 0xe6, 0x7d, 0x5c, 0xdd,
+  0x1f, 0x99, 0xb7, 0xeb, 0xc3, 0xbe, 0x8e, 0xa6, 0x1d, 0xa3, 0xfe, 0x53,
+  0x66, 0xfb, 0x73, 0xf3, 0x73, 0xff, 0xc9, 0x64, 0xf5, 0xed, 0xfb, 0xfc,
+  0x9f, 0xce, 0xff, 0xc0, 0x00,
+};
+
+const byte kOldArchiveH[] = {
+  0x48, 0xbc, 0x09, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x8c, 0x07,
+  0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x0d, 0xfc, 0x00, 0x00, 0x07, 0x88,
+  0x00, 0x00, 0x1c, 0xa0, 0x00, 0x00, 0x85, 0x60, 0x00, 0x00, 0xaa, 0xc0,
+  0x00, 0x00, 0xee, 0x80, 0x00, 0x04, 0x77, 0x01, 0xbc, 0x09, 0xae, 0x02,
+  0x79, 0x31, 0x08, 0xef, 0x38, 0x50, 0x54, 0x8a, 0x01, 0x86, 0xd9, 0x65,
+  0x04, 0x3c, 0xf2, 0x18, 0x3b, 0xf1, 0xa9, 0x52, 0x65, 0x49, 0x25, 0x44,
+  0x48, 0x84, 0x90, 0x8a, 0x22, 0x42, 0x21, 0x14, 0x90, 0x6f, 0x64, 0x5b,
+  0x4d, 0x8a, 0xaa, 0x0b, 0x59, 0x0b, 0x10, 0x32, 0x25, 0x5b, 0x54, 0xb9,
+  0x9b, 0x22, 0x84, 0x5a, 0x5a, 0x46, 0x90, 0xcb, 0xd0, 0x91, 0x6d, 0xcd,
+  0x05, 0xd1, 0xe0, 0x24, 0x0e, 0x8a, 0x68, 0xba, 0x2a, 0xdb, 0x14, 0x98,
+  0xca, 0x43, 0x6d, 0xf1, 0x67, 0x00, 0xf1, 0xe5, 0x98, 0x58, 0x41, 0x84,
+  0x9e, 0x24, 0xc3, 0x40, 0xc5, 0x64, 0x49, 0xa2, 0xd6, 0x28, 0xa3, 0x83,
+  0x1d, 0x64, 0xac, 0x38, 0xd3, 0x8f, 0x0e, 0x61, 0xe6, 0xac, 0xf9, 0x8a,
+  0xe7, 0x18, 0x1b, 0xac, 0x5c, 0x4d, 0x0f, 0xcb, 0x1a, 0x25, 0x63, 0x49,
+  0xe5, 0x73, 0x8c, 0x59, 0x3c, 0x1e, 0x12, 0x86, 0xc3, 0x5f, 0x0c, 0x52,
+  0x6a, 0x2b, 0x53, 0x7b, 0x2b, 0xdf, 0xbe, 0x09, 0x4c, 0xb1, 0xf0, 0xf0,
+  0xce, 0xef, 0x8e, 0xce, 0xea, 0xe0, 0xd5, 0xc2, 0xa3, 0x8e, 0xf9, 0x0c,
+  0x9a, 0xbf, 0x63, 0x4c, 0xa8, 0xca, 0x03, 0xb5, 0x09, 0x23, 0xa8, 0x4a,
+  0x9b, 0x1d, 0x7b, 0x3d, 0xbf, 0xd8, 0x58, 0xa7, 0x25, 0x5d, 0xf6, 0xa5,
+  0xc0, 0xc2, 0x81, 0x3b, 0x11, 0xc4, 0xd1, 0xc9, 0xa2, 0x9c, 0xe0, 0xe4,
+  0x66, 0xfd, 0xac, 0xae, 0xc1, 0xde, 0x55, 0xd9, 0x7e, 0x3f, 0x52, 0xf5,
+  0x74, 0x97, 0xbf, 0x4a, 0x74, 0x95, 0xbc, 0xf5, 0xd0, 0x94, 0x1b, 0xaf,
+  0x86, 0xfc, 0x6d, 0x5b, 0x2f, 0x59, 0x1e, 0x76, 0xdb, 0x6d, 0xb3, 0x36,
+  0xdb, 0x6c, 0xcd, 0xb6, 0xdb, 0x6d, 0xb6, 0xdb, 0x66, 0x6d, 0xb3, 0x36,
+  0x66, 0xdb, 0x6d, 0xb6, 0xdb, 0x6d, 0xb6, 0xdb, 0x63, 0x1b, 0x63, 0x0c,
+  0x66, 0xdb, 0x6d, 0xb6, 0xdb, 0x6d, 0xb6, 0xcc, 0xd9, 0x9b, 0x6c, 0xcd,
+  0xb6, 0xdb, 0x6d, 0xb6, 0xdb, 0x6d, 0xb6, 0xdb, 0x6d, 0xb6, 0xdb, 0x6c,
+  0xcd, 0xb6, 0xd8, 0x96, 0xc4, 0xb6, 0xdb, 0x31, 0x99, 0x84, 0xb3, 0x36,
+  0xdb, 0x33, 0x6c, 0xcc, 0xcc, 0x24, 0xdb, 0x6d, 0xb6, 0xdb, 0x66, 0x6c,
+  0xcd, 0xb6, 0x24, 0xcd, 0xb0, 0xab, 0x33, 0x62, 0x4c, 0x66, 0xdb, 0x66,
+  0x18, 0xdb, 0x66, 0x6d, 0xb6, 0xdb, 0x6d, 0xb3, 0x09, 0x6d, 0x99, 0xb6,
+  0xcc, 0xdb, 0x6c, 0x63, 0x62, 0x5b, 0x12, 0xcc, 0x66, 0xd9, 0x98, 0x96,
+  0x66, 0xc4, 0x99, 0xb3, 0x18, 0xc1, 0x56, 0xdb, 0x30, 0x93, 0x36, 0x66,
+  0x66, 0x66, 0xd8, 0x96, 0xdb, 0x6c, 0x4b, 0x6c, 0xc6, 0x30, 0xb0, 0x00,
+};
+
+void checkOldArchive(const byte* begin, const byte* end) {
+  std::string text;
+  for(int i = 0; i < 3; ++i) text += kOldText;
+  for(size_t threads = 1; threads <= 2; ++threads) {
+    std::vector<byte> comp(begin, end), decomp;
+    Decompressor decompressor(new TestStream(comp), new TestStream(decomp));
+    decompressor.decompress(threads);
+    BOOST_CHECK(decomp == std::vector<byte>(text.begin(), text.end()));
+  }
+  std::vector<byte> comp(begin, end), decomp;
+  Decompressor decompressor(new TestStream(comp), new TestStream(decomp));
+  decompressor.decompressRange(100, 300);
+  BOOST_CHECK(decomp == std::vector<byte>(text.begin() + 100,
+                                          text.begin() + 400));
+}
+
+/* Files without the format version begin with the entropy coder, and they
+ * are decompressed as version 1. */
+BOOST_AUTO_TEST_CASE(FilesWithoutVersionAreDecompressed) {
+  checkOldArchive(kOldArchiveF, kOldArchiveF + sizeof(kOldArchiveF));
+  checkOldArchive(kOldArchiveH, kOldArchiveH + sizeof(kOldArchiveH));
+}
+
+/* Newer versions are rejected before anything is allocated from their
+ * headers. */
+BOOST_AUTO_TEST_CASE(NewerVersionsAreRejected) {
+  std::vector<byte> orig, comp;
+  makeRepetitiveData(orig, 1000, 10);
+  {
+    Compressor compressor(new TestStream(orig), new TestStream(comp), "",
+                          10000, 'H');
+    compressor.initializeBwtAlgorithm('d', 8);
+    compressor.compress(1);
+  }
+  BOOST_REQUIRE(comp.size() > 2);
+  BOOST_CHECK_EQUAL(comp[0], s_formatVersion);
+  BOOST_CHECK_EQUAL(comp[1], 'H');
+
+  std::vector<byte> decomp;
+  for(size_t threads = 1; threads <= 2; ++threads) {
+    std::vector<byte> newer(comp);
+    newer[0] = s_formatVersion + 1;
+    Decompressor decompressor(new TestStream(newer), new TestStream(decomp));
+    BOOST_CHECK_THROW(decompressor.decompress(threads), std::runtime_error);
+  }
+  std::vector<byte> newer(comp);
+  newer[0] = s_formatVersion + 1;
+  Decompressor rangeDecompressor(new TestStream(newer),
+                                 new TestStream(decomp));
+  BOOST_CHECK_THROW(rangeDecompressor.decompressRange(100, 100),
+                    std::runtime_error);
+  BOOST_CHECK(decomp.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
 
 } //namespace tests
 } //namespace bwtc
@@ -24,6 +24,7 @@
  * Test of the libivsufsort.
  */
 
+#include <cassert>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
@@ -50,7 +51,7 @@ void BwtDivSufTest(char *arg) {
 
   std::vector<uint32> LFpowers;
   LFpowers.resize(1);
-  divbwt(str, res, 0, len+1, &LFpowers[0], LFpowers.size());
+  divbwt(str, res, 0, len+1, &LFpowers[0], LFpowers.size(), 1);
 
   for(int i = 0; i < len + 1; ++i) {
     //std::cout << res[i];
@@ -62,6 +63,41 @@ void BwtDivSufTest(char *arg) {
   delete [] res;
 }
 
+/* Sorting with several threads has to give the same BWT, LFpowers,
+ * frequencies and runs as sorting with one thread. Small alphabets and repetitions
+ * make sure that there is work for the threads. */
+void test_parallel(int threads) {
+  int size = (rand() & 0x000FFFFF) + 2;
+  int sigma = (rand() & 0x3) ? (rand() & 0xF) + 1 : 256;
+  int period = (rand() & 0x1) ? (rand() & 0xFFF) + 1 : size;
+  std::vector<byte> str(size + 1);
+  for(int i = 0; i < size; ++i) {
+    str[i] = (i < period) ? rand() % sigma : str[i - period];
+  }
+  str[size] = 0;
+  std::vector<uint32> LFpowers((rand() & 0xFF) + 1), LFpowersPar(LFpowers);
+  std::vector<uint32> freqs(256, 0), freqsPar(256, 0);
+  std::vector<uint32> runs(256, 0), runsPar(256, 0);
+  std::vector<byte> res(size + 1), resPar(size + 1);
+
+  divbwtf(&str[0], &res[0], 0, size + 1, &LFpowers[0], LFpowers.size(),
+          &freqs[0], &runs[0], 1);
+  divbwtf(&str[0], &resPar[0], 0, size + 1, &LFpowersPar[0],
+          LFpowersPar.size(), &freqsPar[0], &runsPar[0], threads);
+  res[LFpowers[0]] = resPar[LFpowersPar[0]] = 0;
+  assert(res == resPar);
+  assert(LFpowers == LFpowersPar);
+  assert(freqs == freqsPar);
+  assert(runs == runsPar);
+
+  divbwt(&str[0], &resPar[0], 0, size + 1, &LFpowersPar[0],
+         LFpowersPar.size(), threads);
+  resPar[LFpowersPar[0]] = 0;
+  assert(res == resPar);
+  assert(LFpowers == LFpowersPar);
+  std::cout << "." << std::flush;
+}
+
 }
 
 
@@ -70,4 +106,9 @@ int main(int argc, char** argv) {
   if(argc > 1) {
     BwtDivSufTest(argv[1]);
   }
+  srand(time(NULL));
+  for(int i = 0; i < 20; ++i) {
+    test_parallel(2 + (i & 0x3));
+  }
+  std::cout << "\nParallel divsufsort passed all tests.\n";
 }
@@ -0,0 +1,150 @@
+/**
+ * @file InverseBwtBenchmark.cpp
+ * @author Pekka Mikkola <pmikkol@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This file is part of bwtc.
+ *
+ * bwtc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * bwtc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with bwtc.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Throughput of the inverse transforms for blocks of given sizes. The
+ * blocks are generated text of random words, so that the walks of the
+ * inverse transform access the memory in random order. Between the
+ * transforms the BWT is kept in a temporary file and the text is generated
+ * again for checking the result, so the memory needed is that of the
+ * transforms themselves: about 5n bytes for the forward transform and 7n
+ * bytes for MTL-SA. The default 1000 MB block needs about 7 GB of memory.
+ */
+
+#define MAIN
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <sys/time.h>
+
+#include "../globaldefs.hpp"
+#include "../bwtransforms/BWTransform.hpp"
+#include "../bwtransforms/InverseBWT.hpp"
+#include "../bwtransforms/MtlSaInverseBWT.hpp"
+
+using namespace bwtc;
+
+namespace {
+
+/* Same seed gives the same text. */
+void makeText(std::vector<byte>& text, uint64 length, unsigned seed) {
+  srand(seed);
+  std::vector<std::string> words(4096);
+  for(size_t i = 0; i < words.size(); ++i) {
+    int wordLength = 1 + rand() % 10;
+    for(int j = 0; j < wordLength; ++j) words[i] += 'a' + rand() % 26;
+  }
+  text.clear();
+  while(text.size() < length) {
+    const std::string& word = words[rand() % words.size()];
+    text.insert(text.end(), word.begin(), word.end());
+    text.push_back(rand() % 8 ? ' ' : '\n');
+  }
+  text.resize(length);
+}
+
+/* Wall-clock time, as the transforms may run in the threads of a pool. */
+double seconds() {
+  timeval now;
+  gettimeofday(&now, 0);
+  return now.tv_sec + now.tv_usec / 1e6;
+}
+
+/* Inverts the BWT read from the file and reports the throughput, or an
+ * error if the result differs from the text of the seed. */
+void benchmark(const char *name, InverseBWTransform& inverse, FILE *bwt,
+               uint64 n, unsigned seed, const std::vector<uint64>& LFpowers) {
+  std::vector<byte> data(n + 1);
+  rewind(bwt);
+  if(fread(&data[0], 1, n + 1, bwt) != n + 1) {
+    perror("Reading the BWT");
+    exit(1);
+  }
+  double start = seconds();
+  inverse.doTransform(&data[0], data.size(), LFpowers);
+  double elapsed = seconds() - start;
+  std::vector<byte> text;
+  makeText(text, n, seed);
+  bool correct = std::equal(text.begin(), text.end(), data.begin());
+  printf("%-12s %6.0f MB/s%s\n", name,
+         n / (1024.0*1024.0) / std::max(elapsed, 1e-9),
+         correct ? "" : " (wrong result)");
+}
+
+} //anonymous namespace
+
+int main(int argc, char **argv) {
+  if(argc > 1 && argv[1][0] == '-') {
+    fprintf(stderr, "usage: %s [starting-points (default 8)] "
+            "[block sizes in MB (default 10 100 1000)]\n", argv[0]);
+    return 1;
+  }
+  uint32 startingPoints = (argc > 1) ? atoi(argv[1]) : 8;
+  if(startingPoints < 1 || startingPoints > s_maxStartingPoints) {
+    fprintf(stderr, "Wrong number of starting points!\n");
+    return 1;
+  }
+  std::vector<uint64> sizes;
+  for(int i = 2; i < argc; ++i) sizes.push_back(atol(argv[i]));
+  if(sizes.empty()) {
+    sizes.push_back(10);
+    sizes.push_back(100);
+    sizes.push_back(1000);
+  }
+
+  for(size_t i = 0; i < sizes.size(); ++i) {
+    uint64 n = sizes[i] << 20;
+    unsigned seed = i + 1;
+    std::vector<byte> bwt;
+    {
+      std::vector<byte> text;
+      makeText(text, n, seed);
+      bwt.reserve(n + 1);
+      bwt.assign(text.rbegin(), text.rend());
+    }
+    bwt.push_back(0);
+    std::vector<uint64> LFpowers(startingPoints);
+    BWTransform *transform = giveTransformer('s');
+    transform->doTransform(&bwt[0], n + 1, LFpowers);
+    delete transform;
+    FILE *file = tmpfile();
+    if(!file || fwrite(&bwt[0], 1, n + 1, file) != n + 1) {
+      perror("Writing the BWT");
+      return 1;
+    }
+    std::vector<byte>().swap(bwt);
+
+    printf("Block of %lu MB, %u starting points:\n",
+           static_cast<unsigned long>(sizes[i]), startingPoints);
+    FastInverseBWTransform fast;
+    benchmark("fast", fast, file, n, seed, LFpowers);
+    MtlSaInverseBWTransform mtlSa;
+    if(n <= MtlSaInverseBWTransform::kMaxBlockSize)
+      benchmark("mtl-sa", mtlSa, file, n, seed, LFpowers);
+    fclose(file);
+  }
+  return 0;
+}
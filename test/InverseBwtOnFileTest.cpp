@@ -86,7 +86,7 @@ int main(int argc, char **argv) {
   std::reverse(data.begin(), data.end());
   data.push_back(0);
 
-  std::vector<uint32> LFpowers;
+  std::vector<uint64> LFpowers;
   LFpowers.resize(starting_positions);
 
   fprintf(stderr,"Forward transform... ");
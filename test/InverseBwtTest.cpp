@@ -37,9 +37,11 @@
 #include <vector>
 
 #include "../globaldefs.hpp"
+#include "../ThreadPool.hpp"
 #include "../bwtransforms/BWTransform.hpp"
 #include "../bwtransforms/InverseBWT.hpp"
 #include "../bwtransforms/MtlSaInverseBWT.hpp"
+#include "../bwtransforms/SampledInverseBWT.hpp"
 #include "../bwtransforms/SA-IS-bwt.hpp"
 
 using namespace bwtc;
@@ -58,13 +60,35 @@ void test(byte *t, uint32 n) {
   std::reverse(data.begin(), data.end());
   data.push_back(0);
 
-  std::vector<uint32> LFpowers;
+  std::vector<uint64> LFpowers;
   int starting_points = my_random(1, std::min(256, (int)n));
   LFpowers.resize(starting_points);
 
   transform->doTransform(&data[0], n+1, LFpowers);
+  std::vector<byte> bwt(data);
+  std::vector<byte> sampled(data);
   inverse_transform->doTransform(&data[0], n+1, LFpowers);
 
+  // Multi-threaded inverse has to give the same result.
+  static ThreadPool pool(4);
+  MtlSaInverseBWTransform threaded_transform(&pool);
+  InverseBWTransform& threaded = threaded_transform;
+  threaded.doTransform(&bwt[0], n+1, LFpowers);
+  if (!std::equal(t, t + n, bwt.begin())) {
+    fprintf(stderr,"FAIL with threads, n = %u\n", n);
+    exit(1);
+  }
+
+  // So has the inverse with sampled ranks, with the shortest and the
+  // longest interval.
+  SampledInverseBWTransform sampled_transform(my_random(0, 1), &pool);
+  InverseBWTransform& sampled_inverse = sampled_transform;
+  sampled_inverse.doTransform(&sampled[0], n+1, LFpowers);
+  if (!std::equal(t, t + n, sampled.begin())) {
+    fprintf(stderr,"FAIL with sampled ranks, n = %u\n", n);
+    exit(1);
+  }
+
   bool ok = true;
   for (uint32 j = 0; j < n; ++j) {
     if (data[j] != t[j]) {
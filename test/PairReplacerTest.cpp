@@ -35,6 +35,7 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -240,6 +241,22 @@ BOOST_AUTO_TEST_CASE(simpleSpecialScenario) {
   BOOST_CHECK_EQUAL(original.size(), data.size());
   for(size_t i = 0; i < original.size(); ++i)
     BOOST_CHECK_EQUAL(original[i], data[i]);
+
+  // Same result when given in parts, which split some of the pairs of a
+  // special symbol and the following byte.
+  size_t partSizes[] = {1, 2, 3, 1000};
+  for(size_t j = 0; j < sizeof(partSizes)/sizeof(partSizes[0]); ++j) {
+    Postprocessor streaming(false, postGrammar);
+    MemoryOutStream out;
+    size_t written = 0;
+    for(size_t begin = 0; begin < cSize; begin += partSizes[j]) {
+      size_t length = std::min(partSizes[j], cSize - begin);
+      written += streaming.uncompressPart(&result[begin], length, &out);
+    }
+    BOOST_CHECK(streaming.isComplete());
+    BOOST_CHECK_EQUAL(written, data.size());
+    BOOST_CHECK(out.data() == data);
+  }
 }
 
 
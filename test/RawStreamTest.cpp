@@ -22,12 +22,13 @@
  *
  * @section DESCRIPTION
  *
- * Testing of RawInStream and RawOutStream.
+ * Testing of the input and output streams.
  *
  */
 
 #include <cassert>
 
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -37,6 +38,7 @@ namespace fs = boost::filesystem;
 
 #include "../globaldefs.hpp"
 #include "../Streams.hpp"
+#include "../AsyncStreams.hpp"
 
 #undef NDEBUG
 
@@ -131,6 +133,172 @@ void ReadFromFileTest() {
 }
 /*********** end: ReadFromFileTest ***********/
 
+/* MmapInStream has to read the same bits, bytes and blocks as
+ * RawInStream. */
+void MmapReadTest() {
+  std::vector<byte> data(100000);
+  for(size_t i = 0; i < data.size(); ++i) data[i] = (i*i + 7*i) & 0xff;
+  {
+    bwtc::RawOutStream o(test_fname);
+    o.writeBlock(&data[0], &data[0] + data.size());
+  }
+  assert(bwtc::MmapInStream::canMap(test_fname));
+  assert(!bwtc::MmapInStream::canMap(""));
+  bwtc::RawInStream raw(test_fname);
+  bwtc::MmapInStream mapped(test_fname);
+  for(int i = 0; i < 21; ++i) assert(raw.readBit() == mapped.readBit());
+  for(int i = 0; i < 10; ++i) assert(raw.readByte() == mapped.readByte());
+  raw.flushBuffer();
+  mapped.flushBuffer();
+  assert(raw.read48bits() == mapped.read48bits());
+
+  std::vector<byte> a(5000), b(5000);
+  assert(raw.readBlock(&a[0], a.size()) == mapped.readBlock(&b[0], b.size()));
+  assert(a == b);
+  const byte *inPlace = mapped.readInPlace(70000);
+  assert(inPlace);
+  a.resize(70000);
+  assert(raw.readBlock(&a[0], a.size()) == a.size());
+  assert(std::equal(a.begin(), a.end(), inPlace));
+  assert(mapped.readInPlace(data.size()) == 0);
+
+  size_t left = data.size() - (3 + 10 + 6) - 5000 - 70000;
+  a.resize(2*left);
+  b.resize(2*left);
+  assert(raw.readBlock(&a[0], a.size()) == left);
+  assert(mapped.readBlock(&b[0], b.size()) == left);
+  assert(std::equal(a.begin(), a.begin() + left, b.begin()));
+  assert(std::equal(data.end() - left, data.end(), b.begin()));
+  assert(mapped.compressedDataEnding());
+}
+
+/* Pages behind the reading position are dropped from the mapping, but
+ * the blocks read in place before that still have the data of the file. */
+void MmapReleaseTest() {
+  size_t interval = bwtc::MmapInStream::kReleaseInterval;
+  std::vector<byte> data(3*interval + 12345);
+  for(size_t i = 0; i < data.size(); ++i) data[i] = (i*i + 5*i) & 0xff;
+  {
+    bwtc::RawOutStream o(test_fname);
+    o.writeBlock(&data[0], &data[0] + data.size());
+  }
+  bwtc::MmapInStream mapped(test_fname);
+  const byte *first = mapped.readInPlace(interval + 100);
+  std::vector<byte> block(interval);
+  size_t position = interval + 100;
+  while(position < data.size()) {
+    size_t read = mapped.readBlock(&block[0], block.size());
+    assert(read > 0);
+    assert(std::equal(block.begin(), block.begin() + read,
+                      data.begin() + position));
+    position += read;
+  }
+  assert(std::equal(data.begin(), data.begin() + interval + 100, first));
+}
+
+/* Data goes through several buffers of the background streams. */
+void AsyncWriteReadTest() {
+  std::vector<byte> data(3500000);
+  for(size_t i = 0; i < data.size(); ++i) data[i] = (i*i + 3*i) & 0xff;
+  {
+    bwtc::WriteBehindOutStream o(test_fname);
+    o.writeBlock(&data[0], &data[0] + 1000);
+    for(size_t i = 1000; i < 2000000; ++i) o.writeByte(data[i]);
+    o.writeBlock(&data[0] + 2000000, &data[0] + data.size());
+    assert(o.getPos() == (long int)data.size());
+    /* First one is patched in memory, second one on the disk. */
+    o.write48bits(0x123456789aULL, data.size() - 10);
+    o.write48bits(0xa1a2a3a4a5a6ULL, 10);
+  }
+  byte first[] = {0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6};
+  byte last[] = {0x00, 0x12, 0x34, 0x56, 0x78, 0x9a};
+  std::copy(first, first + 6, data.begin() + 10);
+  std::copy(last, last + 6, data.end() - 10);
+
+  bwtc::ReadAheadInStream in(test_fname);
+  for(int i = 0; i < 21; ++i) {
+    assert(in.readBit() == (((data[i/8] << (i%8)) & 0x80) != 0));
+  }
+  in.flushBuffer();
+  std::vector<byte> read(data.size() + 1);
+  size_t total = 3;
+  while(size_t n = in.readBlock(&read[total], 777777)) {
+    total += n;
+    assert(total < data.size() || in.compressedDataEnding());
+  }
+  assert(total == data.size());
+  assert(std::equal(data.begin() + 3, data.end(), read.begin() + 3));
+}
+
+/* Writes the data with writeByte, reserve and commit (both smaller and
+ * larger than the buffers of the streams) and SpanWriter. */
+void writeWithReservations(bwtc::OutStream& out, const std::vector<byte>& data) {
+  size_t i = 0;
+  for(; i < 100; ++i) out.writeByte(data[i]);
+  size_t sizes[] = {1, 5000, 70000, 3000000, 1 << 20};
+  for(size_t j = 0; j < sizeof(sizes)/sizeof(size_t); ++j) {
+    byte *room = out.reserve(sizes[j]);
+    size_t used = std::min(sizes[j] - 1, data.size() - i);
+    std::copy(&data[i], &data[i] + used, room);
+    out.commit(used);
+    i += used;
+  }
+  bwtc::SpanWriter writer(&out);
+  for(; i < data.size(); ++i) writer.writeByte(data[i]);
+  writer.commit();
+}
+
+void ReserveCommitTest() {
+  std::vector<byte> data(5000000);
+  for(size_t i = 0; i < data.size(); ++i) data[i] = (i*i + 7*i) & 0xff;
+
+  bwtc::MemoryOutStream memory;
+  writeWithReservations(memory, data);
+  assert(memory.data() == data);
+  {
+    bwtc::RawOutStream raw(test_fname);
+    writeWithReservations(raw, data);
+  }
+  std::vector<byte> read(data.size() + 1);
+  {
+    bwtc::RawInStream in(test_fname);
+    assert(in.readBlock(&read[0], read.size()) == data.size());
+    assert(std::equal(data.begin(), data.end(), read.begin()));
+  }
+  {
+    bwtc::WriteBehindOutStream async(test_fname);
+    writeWithReservations(async, data);
+  }
+  bwtc::RawInStream in(test_fname);
+  assert(in.readBlock(&read[0], read.size()) == data.size());
+  assert(std::equal(data.begin(), data.end(), read.begin()));
+}
+void PositionalWriteTest() {
+  std::vector<byte> data(3000000);
+  for(size_t i = 0; i < data.size(); ++i) data[i] = (i*i + 5*i) & 0xff;
+  assert(bwtc::PositionalOutStream::canWrite(test_fname));
+  assert(!bwtc::PositionalOutStream::canWrite(""));
+  {
+    bwtc::PositionalOutStream out(test_fname);
+    out.preallocate(data.size());
+    /* Parts are written in reverse order, the first one sequentially. */
+    bwtc::OutStream *last = out.writerAt(2000000);
+    last->writeBlock(&data[2000000], &data[0] + data.size());
+    bwtc::OutStream *middle = out.writerAt(1000);
+    for(size_t i = 1000; i < 2000000; ++i) middle->writeByte(data[i]);
+    delete last;
+    delete middle;
+    out.writeBlock(&data[0], &data[1000]);
+    out.write48bits(0x123456789aULL, 10);
+  }
+  byte patched[] = {0x00, 0x12, 0x34, 0x56, 0x78, 0x9a};
+  std::copy(patched, patched + 6, data.begin() + 10);
+
+  bwtc::RawInStream in(test_fname);
+  std::vector<byte> read(data.size() + 1);
+  assert(in.readBlock(&read[0], read.size()) == data.size());
+  assert(std::equal(data.begin(), data.end(), read.begin()));
+}
 
 } //namespace tests
 
@@ -146,6 +314,11 @@ int main(int argc, char **argv) {
   tests::EmptyWriteTest();
   tests::SimpleWriteReadTest();
   tests::ReadFromFileTest();
+  tests::MmapReadTest();
+  tests::MmapReleaseTest();
+  tests::AsyncWriteReadTest();
+  tests::ReserveCommitTest();
+  tests::PositionalWriteTest();
   std::cout << "Streams passed all tests.\n";
   return 0;
 }
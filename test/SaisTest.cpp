@@ -76,7 +76,7 @@ void BwtSaisTest(char *arg) {
   strcpy((char*)str, arg);
   int *SA = new int[len+1];
   byte *res = new byte[len+1];
-  std::vector<uint32> LFpowers;
+  std::vector<uint64> LFpowers;
   LFpowers.resize(1);
   saisxx_bwt(str, res, SA, len + 1, LFpowers, 256);
   int val = LFpowers[0];
@@ -117,6 +117,14 @@ class TestStream : public InStream, public OutStream {
   bool compressedDataEnding() {
     return m_currByte >= m_data.size();
   }
+
+  bool seek(uint64 position) {
+    m_currByte = position;
+    m_currBit = 0;
+    return true;
+  }
+
+  uint64 size() const { return m_data.size(); }
   
  private:
   std::vector<byte>& m_data;
@@ -0,0 +1,130 @@
+/**
+ * @file ThreadPoolTest.cpp
+ * @author Pekka Mikkola <pmikkol@gmail.com>
+ *
+ * @section LICENSE
+ *
+ * This file is part of bwtc.
+ *
+ * bwtc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * bwtc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with bwtc.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @section DESCRIPTION
+ *
+ * Unit tests for ThreadPool.
+ */
+
+#define BOOST_TEST_MODULE
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <vector>
+
+#include "../globaldefs.hpp"
+#include "../ThreadPool.hpp"
+
+namespace bwtc {
+int verbosity = 0;
+
+namespace tests {
+
+/* Splits its work into parts which again split theirs until the depth
+ * runs out, and keeps track of the number of leaf parts running at once. */
+class NestedWork {
+ public:
+  NestedWork(ThreadPool* pool, uint32 depth)
+      : m_pool(pool), m_depth(depth), m_leaves(0) {}
+
+  void run(uint32 part) {
+    (void) part;
+    if(m_depth > 0) {
+      NestedWork child(m_pool, m_depth - 1);
+      runInParts(m_pool, &child, &NestedWork::run, 3);
+      add(child);
+    } else {
+      enter();
+      for(volatile int i = 0; i < 100000; ++i) {}
+      leave();
+      boost::mutex::scoped_lock lock(m_mutex);
+      ++m_leaves;
+    }
+  }
+
+  uint32 leaves() const { return m_leaves; }
+
+  static uint32 maxRunning() { return s_maxRunning; }
+
+ private:
+  void enter() {
+    boost::mutex::scoped_lock lock(s_mutex);
+    ++s_running;
+    if(s_running > s_maxRunning) s_maxRunning = s_running;
+  }
+
+  void leave() {
+    boost::mutex::scoped_lock lock(s_mutex);
+    --s_running;
+  }
+
+  void add(const NestedWork& child) {
+    boost::mutex::scoped_lock lock(m_mutex);
+    m_leaves += child.m_leaves;
+  }
+
+  ThreadPool *m_pool;
+  uint32 m_depth;
+  uint32 m_leaves;
+  boost::mutex m_mutex;
+
+  static boost::mutex s_mutex;
+  static uint32 s_running;
+  static uint32 s_maxRunning;
+};
+
+boost::mutex NestedWork::s_mutex;
+uint32 NestedWork::s_running = 0;
+uint32 NestedWork::s_maxRunning = 0;
+
+BOOST_AUTO_TEST_SUITE(ThreadPoolTests)
+
+BOOST_AUTO_TEST_CASE(NestedTasksAreRun) {
+  ThreadPool pool(3);
+  NestedWork work(&pool, 4);
+  runInParts(&pool, &work, &NestedWork::run, 2);
+  BOOST_CHECK_EQUAL(work.leaves(), 2u*3*3*3*3);
+  BOOST_CHECK(NestedWork::maxRunning() <= 3);
+}
+
+BOOST_AUTO_TEST_CASE(WorkWithoutPool) {
+  NestedWork work(0, 3);
+  runInParts<NestedWork>(0, &work, &NestedWork::run, 2);
+  BOOST_CHECK_EQUAL(work.leaves(), 2u*3*3*3);
+}
+
+BOOST_AUTO_TEST_CASE(BorrowedSlotsAreLimited) {
+  ThreadPool pool(4);
+  BOOST_CHECK_EQUAL(pool.tryBorrowSlots(3), 3u);
+  BOOST_CHECK_EQUAL(pool.tryBorrowSlots(3), 1u);
+  BOOST_CHECK_EQUAL(pool.tryBorrowSlots(1), 0u);
+  pool.returnSlots(4);
+  pool.borrowSlot();
+  BOOST_CHECK_EQUAL(pool.tryBorrowSlots(4), 3u);
+  pool.returnSlots(4);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} //namespace tests
+} //namespace bwtc
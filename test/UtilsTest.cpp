@@ -32,6 +32,8 @@
 #include <vector>
 
 #include "../globaldefs.hpp"
+#include "../BitStreams.hpp"
+#include "../Streams.hpp"
 #include "../Utils.hpp"
 
 #include "TestStreams.hpp"
@@ -415,6 +417,54 @@ BOOST_AUTO_TEST_CASE(InterpolativeDecode2) {
 }
 
 
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(BitStreams)
+
+BOOST_AUTO_TEST_CASE(WriteAndReadBits) {
+  MemoryOutStream out;
+  BitWriter writer(&out);
+  writer.writeBits(5, 3);
+  writer.writeUnary(1);
+  writer.writeUnary(70);
+  writer.writeBits(0x123456789abcdefULL, 60);
+  writer.writeGamma(1);
+  writer.writeGamma(1000000);
+  writer.push_back(true);
+  BOOST_CHECK_EQUAL(writer.flush(), (3 + 1 + 70 + 60 + 1 + 39 + 1 + 7)/8);
+  out.writeByte(0xAB);
+
+  MemoryInStream in(&out.data()[0], &out.data()[0] + out.data().size());
+  BitReader reader(&in);
+  BOOST_CHECK_EQUAL(reader.readBits(3), 5);
+  BOOST_CHECK_EQUAL(reader.readUnary(), 1);
+  BOOST_CHECK_EQUAL(reader.readUnary(), 70);
+  BOOST_CHECK_EQUAL(reader.readBits(60), 0x123456789abcdefULL);
+  BOOST_CHECK_EQUAL(reader.readGamma(), 1);
+  BOOST_CHECK_EQUAL(reader.readGamma(), 1000000);
+  BOOST_CHECK(reader.readBit());
+  reader.flushBuffer();
+  BOOST_CHECK_EQUAL(in.readByte(), 0xAB);
+}
+
+BOOST_AUTO_TEST_CASE(GammaAndDeltaCodes) {
+  std::vector<uint32> ints;
+  for(uint32 i = 0; i < 1000; ++i) ints.push_back(i*i*7 % 100003);
+  MemoryOutStream out;
+  size_t bytes = gammaEncode(ints, &out, 1);
+  bytes += deltaEncode(ints, &out, 1);
+  BOOST_CHECK_EQUAL(bytes, out.data().size());
+  out.writeByte(0xAB);
+
+  MemoryInStream in(&out.data()[0], &out.data()[0] + out.data().size());
+  std::vector<uint32> gamma(ints.size()), delta(ints.size());
+  gammaDecode(gamma, &in, 1);
+  deltaDecode(delta, &in, 1);
+  BOOST_CHECK(gamma == ints);
+  BOOST_CHECK(delta == ints);
+  BOOST_CHECK_EQUAL(in.readByte(), 0xAB);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 } //namespace tests
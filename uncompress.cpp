@@ -31,6 +31,11 @@
 #include <iostream>
 #include <iterator>
 #include <algorithm>
+#include <sstream>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 #include <boost/program_options.hpp>
 namespace po = boost::program_options;
@@ -46,8 +51,10 @@ namespace po = boost::program_options;
 using bwtc::verbosity;
 
 int main(int argc, char** argv) {
-  std::string input_name, output_name;
+  std::string input_name, output_name, range;
   bool stdout, stdin;
+  size_t threads;
+  bwtc::uint64 rangeOffset = 0, rangeLength = 0, mem;
 
   try {
     po::options_description description(
@@ -56,6 +63,14 @@ int main(int argc, char** argv) {
         ("help,h", "print help message")
         ("stdin,i", "input from standard in")
         ("stdout,c", "output to standard out")
+        ("threads,t", po::value<size_t>(&threads)->default_value(1),
+         "Number of threads to use")
+        ("mem,m", po::value<bwtc::uint64>(&mem)->default_value(0),
+         "Maximum memory to use (in MB), shared by the threads. 0 for no "
+         "limit, in which case the threads work on one block at a time")
+        ("range", po::value<std::string>(&range),
+         "decompress only the given range of the original data, given as "
+         "offset:length in bytes")
         ("verb,v", po::value<int>(&verbosity)->default_value(0),
          "verbosity level")
         ("input-file", po::value<std::string>(&input_name),
@@ -81,6 +96,16 @@ int main(int argc, char** argv) {
 
     stdout = varmap.count("stdout") != 0;
     stdin  = varmap.count("stdin") != 0;
+    if (varmap.count("range")) {
+      std::istringstream rangeStream(range);
+      char separator = 0;
+      rangeStream >> rangeOffset >> separator >> rangeLength;
+      if (!rangeStream || separator != ':' || !rangeStream.eof()) {
+        std::cerr << "error: range has to be given as offset:length"
+                  << std::endl;
+        return 1;
+      }
+    }
   } /* try-block */
 
   catch(std::exception& e) {
@@ -94,9 +119,26 @@ int main(int argc, char** argv) {
 
   if (stdout) output_name = "";
   if (stdin)  input_name = "";
+  if (threads == 0) threads = 1;
 
-  bwtc::Decompressor decompressor(input_name, output_name);
-  decompressor.decompress(1);
+#ifdef __GLIBC__
+  /* Blocks are allocated by the reader thread and freed in the threads of
+   * the pool. Large allocations are mapped, so that they are returned to the
+   * system when freed. */
+  mallopt(M_MMAP_THRESHOLD, 1 << 20);
+#endif
+  bwtc::Decompressor decompressor(input_name, output_name, mem*1000000);
+  try {
+    if (range != "") {
+      decompressor.decompressRange(rangeOffset, rangeLength);
+    } else {
+      decompressor.decompress(threads);
+    }
+  }
+  catch(std::exception& e) {
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+  }
 
   PRINT_PROFILE_DATA
   return 0;